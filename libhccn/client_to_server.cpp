@@ -47,15 +47,15 @@ static size_t encode_ids (char* encoded, const std::optional<uint64_t>& session_
     size_t off = session_id.has_value () ? HCCN::Internal::EncodeUint64Id (encoded, *session_id) : 0;
     return off + HCCN::Internal::EncodeUint64Id (encoded + off, request_id);
 }
-static bool parse_meta (const std::vector<char>& data, size_t& off, bool& is_tail, bool& session_id_present, uint64_t& fragment_number)
+static bool parse_meta (const char* data, size_t size, size_t& off, bool& is_tail, bool& session_id_present, uint64_t& fragment_number)
 {
-    if (data.size () < 1) {
+    if (size < 1) {
         qDebug () << "Empty message";
         return false;
     }
-    uint8_t meta = data.at (0);
+    uint8_t meta = data[0];
     if (meta & 0x80) {
-        qDebug () << "Acknowledge mode not implemented";
+        qDebug () << "Unexpected control message";
         return false;
     }
     if (!(meta & 0x10)) {
@@ -68,32 +68,32 @@ static bool parse_meta (const std::vector<char>& data, size_t& off, bool& is_tai
         fragment_number = meta & 0x7;
         off = 1;
     } else if (!(meta & 0x04)) {
-        if (data.size () < 2) {
+        if (size < 2) {
             qDebug () << "Unexpected end of message";
             return false;
         }
-        fragment_number = ((uint64_t (meta & 0x3) << 8) | uint8_t (data.at (1))) + 0x08;
+        fragment_number = ((uint64_t (meta & 0x3) << 8) | uint8_t (data[1])) + 0x08;
         off = 2;
     } else if (!(meta & 0x02)) {
-        if (data.size () < 3) {
+        if (size < 3) {
             qDebug () << "Unexpected end of message";
             return false;
         }
-        fragment_number = ((uint64_t (meta & 0x1) << 16) | (uint64_t (uint8_t (data.at (1))) << 8) | uint8_t (data.at (2))) + 0x0408;
+        fragment_number = ((uint64_t (meta & 0x1) << 16) | (uint64_t (uint8_t (data[1])) << 8) | uint8_t (data[2])) + 0x0408;
         off = 3;
     } else if (!(meta & 0x01)) {
-        if (data.size () < 4) {
+        if (size < 4) {
             qDebug () << "Unexpected end of message";
             return false;
         }
-        fragment_number = ((uint64_t (uint8_t (data.at (1))) << 16) | (uint64_t (uint8_t (data.at (2))) << 8) | uint8_t (data.at (3))) + 0x020408;
+        fragment_number = ((uint64_t (uint8_t (data[1])) << 16) | (uint64_t (uint8_t (data[2])) << 8) | uint8_t (data[3])) + 0x020408;
         off = 4;
     } else {
-        if (data.size () < 5) {
+        if (size < 5) {
             qDebug () << "Unexpected end of message";
             return false;
         }
-        fragment_number = ((uint64_t (uint8_t (data.at (1))) << 24) | (uint64_t (uint8_t (data.at (2))) << 16) | (uint64_t (uint8_t (data.at (3))) << 8) | uint8_t (data.at (4))) + 0x01020408;
+        fragment_number = ((uint64_t (uint8_t (data[1])) << 24) | (uint64_t (uint8_t (data[2])) << 16) | (uint64_t (uint8_t (data[3])) << 8) | uint8_t (data[4])) + 0x01020408;
         off = 5;
     }
 
@@ -112,21 +112,23 @@ Message::Message (
     uint16_t port,
     const std::optional<uint64_t>& session_id,
     uint64_t request_id,
-    const std::vector<char>& message)
+    const std::vector<char>& message,
+    bool reliable)
     : host (host)
     , port (port)
     , session_id (session_id)
     , request_id (request_id)
     , message (message)
+    , reliable (reliable)
 {
 }
-std::vector<QNetworkDatagram> Message::encode () const
+std::vector<QNetworkDatagram> Message::encode (size_t max_datagram_size) const
 {
     char id_set[18];
     size_t id_set_len = encode_ids (id_set, session_id, request_id);
     size_t single_message_len = 1 + id_set_len + message.size ();
     std::vector<QNetworkDatagram> datagrams;
-    if (single_message_len <= 508) { // Single message
+    if (single_message_len <= max_datagram_size) { // Single message
         std::vector<char> encoded;
         encoded.reserve (single_message_len);
         encoded.push_back (encode_single_message_meta (session_id.has_value (), true));
@@ -134,7 +136,7 @@ std::vector<QNetworkDatagram> Message::encode () const
         encoded.insert (encoded.end (), message.begin (), message.end ());
         datagrams.push_back ({QByteArray (encoded.data (), encoded.size ()), host, port});
     } else { // Fragmented
-        size_t full_fragment_len = 508 - 5 - id_set_len;
+        size_t full_fragment_len = max_datagram_size - 5 - id_set_len;
         size_t full_size_fragment_count = message.size () / full_fragment_len;
         size_t last_fragment_len = message.size () % full_fragment_len;
         size_t fragment_count = full_size_fragment_count + !!last_fragment_len;
@@ -165,27 +167,39 @@ std::vector<QNetworkDatagram> Message::encode () const
     return datagrams;
 }
 
+void Message::recycle ()
+{
+    // Host is overwritten by the next use, resetting it would allocate
+    session_id.reset ();
+    request_id = 0;
+    HCCN::recycle (message);
+    max_datagram_size = kDefaultMaxDatagramSize;
+    reliable = false;
+}
+
 std::shared_ptr<MessageFragment> MessageFragment::parse (const QNetworkDatagram& datagram)
 {
-    // TODO: Optimize after refactoring
-    std::vector<char> data = {datagram.data ().constData (), datagram.data ().constData () + datagram.data ().size ()};
+    // Parsed in place, the datagram buffer is shared with QNetworkDatagram
+    QByteArray bytes = datagram.data ();
+    const char* data = bytes.constData ();
+    size_t size = bytes.size ();
     size_t off;
     bool is_tail;
     bool session_id_present;
     uint64_t fragment_number;
-    if (!parse_meta (data, off, is_tail, session_id_present, fragment_number)) {
+    if (!parse_meta (data, size, off, is_tail, session_id_present, fragment_number)) {
         return nullptr;
     }
-    if (data.size () < 1) {
+    if (size < 1) {
         qDebug () << "Empty message";
         return nullptr;
     }
-    std::shared_ptr<MessageFragment> transport_message (new MessageFragment);
+    std::shared_ptr<MessageFragment> transport_message = makePooled<MessageFragment> ();
     transport_message->host = datagram.senderAddress ();
     transport_message->port = datagram.senderPort ();
     if (session_id_present) {
         uint64_t session_id;
-        if (!HCCN::Internal::ParseUint64Id (data, off, session_id)) {
+        if (!HCCN::Internal::ParseUint64Id (data, size, off, session_id)) {
             qDebug () << "Failed to parse session id";
             return nullptr;
         }
@@ -193,18 +207,27 @@ std::shared_ptr<MessageFragment> MessageFragment::parse (const QNetworkDatagram&
     }
     {
         uint64_t request_id;
-        if (!HCCN::Internal::ParseUint64Id (data, off, request_id)) {
+        if (!HCCN::Internal::ParseUint64Id (data, size, off, request_id)) {
             qDebug () << "Failed to parse request id";
             return nullptr;
         }
         transport_message->request_id = request_id;
     }
-    transport_message->fragment = std::vector<char> (data.data () + off, data.data () + data.size ());
+    transport_message->fragment.assign (data + off, data + size);
     transport_message->is_tail = is_tail;
     transport_message->fragment_number = fragment_number;
     return transport_message;
 }
 
+void MessageFragment::recycle ()
+{
+    session_id.reset ();
+    request_id = 0;
+    HCCN::recycle (fragment);
+    is_tail = false;
+    fragment_number = 0;
+}
+
 void MessageFragmentCollector::insert (const std::shared_ptr<MessageFragment>& fragment)
 {
     if (fragment->is_tail) {
@@ -228,12 +251,23 @@ std::shared_ptr<Message> MessageFragmentCollector::build ()
     if (!complete ())
         return nullptr;
 
-    std::vector<char> data = head->fragment;
-    for (std::map<uint64_t, std::shared_ptr<MessageFragment>>::const_iterator it = tail.cbegin (); it != tail.cend (); ++it) {
+    std::shared_ptr<Message> message = makePooled<Message> ();
+    message->host = head->host;
+    message->port = head->port;
+    message->session_id = head->session_id;
+    message->request_id = head->request_id;
+    message->message.assign (head->fragment.begin (), head->fragment.end ());
+    for (FragmentMap::const_iterator it = tail.cbegin (); it != tail.cend (); ++it) {
         const std::vector<char>& fragment = it->second->fragment;
-        data.insert (data.end (), fragment.begin (), fragment.end ());
+        message->message.insert (message->message.end (), fragment.begin (), fragment.end ());
     }
-    return std::shared_ptr<Message> (new Message (head->host, head->port, head->session_id, head->request_id, data));
+    return message;
+}
+void MessageFragmentCollector::recycle ()
+{
+    tail.clear ();
+    max_fragment_index = 0;
+    head.reset ();
 }
 
 } // namespace HCCN::ClientToServer
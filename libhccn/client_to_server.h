@@ -1,7 +1,9 @@
 #pragma once
 
 #include "common.h"
+#include "pool.h"
 
+#include <map>
 #include <optional>
 #include <vector>
 #include <QHostAddress>
@@ -11,18 +13,23 @@ namespace HCCN::ClientToServer {
 
 struct Message {
     Message () = default;
-    Message (const QHostAddress& host, uint16_t port, const std::optional<uint64_t>& session_id, uint64_t request_id, const std::vector<char>& message);
-    std::vector<QNetworkDatagram> encode () const;
+    Message (const QHostAddress& host, uint16_t port, const std::optional<uint64_t>& session_id, uint64_t request_id, const std::vector<char>& message, bool reliable = false);
+    std::vector<QNetworkDatagram> encode (size_t max_datagram_size) const;
+    void recycle ();
 
     QHostAddress host;
     uint16_t port;
     std::optional<uint64_t> session_id;
     uint64_t request_id;
     std::vector<char> message;
+    size_t max_datagram_size = kDefaultMaxDatagramSize;
+    bool reliable = false;
 };
 
 struct MessageFragment {
+    // Pooled, see makePooled ()
     static std::shared_ptr<MessageFragment> parse (const QNetworkDatagram& datagram);
+    void recycle ();
 
     QHostAddress host;
     uint16_t port;
@@ -39,9 +46,13 @@ public:
     bool complete ();
     bool valid ();
     std::shared_ptr<Message> build ();
+    void recycle ();
 
 private:
-    std::map<uint64_t, std::shared_ptr<MessageFragment>> tail;
+    // Map nodes come from a Pool, so collecting a fragmented message does not allocate once it is warm
+    typedef std::map<uint64_t, std::shared_ptr<MessageFragment>, std::less<uint64_t>, PoolAllocator<std::pair<const uint64_t, std::shared_ptr<MessageFragment>>>> FragmentMap;
+
+    FragmentMap tail;
     uint64_t max_fragment_index = 0;
     std::shared_ptr<MessageFragment> head;
 };
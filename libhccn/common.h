@@ -6,6 +6,20 @@
 
 namespace HCCN {
 
+// Largest datagram guaranteed to pass without IP fragmentation (576 - IP and UDP headers)
+constexpr size_t kDefaultMaxDatagramSize = 508;
+// Largest UDP payload over IPv4
+constexpr size_t kMaxDatagramSize = 65507;
+
+inline size_t clampDatagramSize (size_t size);
+
+struct TransportPeerIdentifier {
+    inline TransportPeerIdentifier (const QHostAddress& host, quint16 port);
+    inline bool operator== (const TransportPeerIdentifier& b) const;
+
+    quint8 serialized[sizeof (Q_IPV6ADDR) + sizeof (quint16)];
+};
+
 struct TransportMessageIdentifier {
     inline TransportMessageIdentifier (const QHostAddress& host, quint16 port, quint64 message_id);
     inline bool operator== (const TransportMessageIdentifier& b) const;
@@ -13,12 +27,28 @@ struct TransportMessageIdentifier {
     quint8 serialized[sizeof (Q_IPV6ADDR) + sizeof (quint16) + sizeof (quint64)];
 };
 
+inline uint qHash (const TransportPeerIdentifier& key, uint seed);
 inline uint qHash (const TransportMessageIdentifier& key, uint seed);
 
 } // namespace HCCN
 
 // Implementation
 
+inline size_t HCCN::clampDatagramSize (size_t size)
+{
+    return qBound (kDefaultMaxDatagramSize, size, kMaxDatagramSize);
+}
+inline HCCN::TransportPeerIdentifier::TransportPeerIdentifier (const QHostAddress& host, quint16 port)
+{
+    Q_IPV6ADDR addr = host.toIPv6Address ();
+    std::memcpy (serialized, &addr, sizeof (Q_IPV6ADDR));
+    std::memcpy (serialized + sizeof (Q_IPV6ADDR), &port, sizeof (quint16));
+}
+inline bool HCCN::TransportPeerIdentifier::operator== (const HCCN::TransportPeerIdentifier& b) const
+{
+    return !std::memcmp (serialized, b.serialized, sizeof (serialized));
+}
+
 inline HCCN::TransportMessageIdentifier::TransportMessageIdentifier (const QHostAddress& host, quint16 port, quint64 message_id)
 {
     Q_IPV6ADDR addr = host.toIPv6Address ();
@@ -30,6 +60,10 @@ inline bool HCCN::TransportMessageIdentifier::operator== (const HCCN::TransportM
 {
     return !std::memcmp (serialized, b.serialized, sizeof (serialized));
 }
+uint HCCN::qHash (const HCCN::TransportPeerIdentifier& key, uint seed)
+{
+    return qHashBits (key.serialized, sizeof (key.serialized), seed);
+}
 uint HCCN::qHash (const HCCN::TransportMessageIdentifier& key, uint seed)
 {
     return qHashBits (key.serialized, sizeof (key.serialized), seed);
@@ -0,0 +1,121 @@
+#include "control.h"
+
+#include "internal.h"
+
+#include <cstring>
+
+
+static QNetworkDatagram encode_path_mtu_probe (HCCN::Control::Type type, const QHostAddress& host, uint16_t port, uint64_t probe_id, size_t size, size_t padded_size)
+{
+    char header[1 + 9 + 9];
+    header[0] = char (0x80 | uint8_t (type));
+    size_t off = 1;
+    off += HCCN::Internal::EncodeUint64Id (header + off, probe_id);
+    off += HCCN::Internal::EncodeUint64Id (header + off, size);
+    QByteArray encoded (qMax (off, padded_size), '\0');
+    std::memcpy (encoded.data (), header, off);
+    return {encoded, host, port};
+}
+
+namespace HCCN::Control {
+
+bool isControl (const QNetworkDatagram& datagram)
+{
+    QByteArray data = datagram.data ();
+    return data.size () >= 1 && (uint8_t (data[0]) & 0x80);
+}
+std::optional<Type> parseType (const QNetworkDatagram& datagram)
+{
+    if (!isControl (datagram))
+        return {};
+    uint8_t type = uint8_t (datagram.data ()[0]) & 0x7f;
+    switch (type) {
+    case uint8_t (Type::PathMtuProbe):
+    case uint8_t (Type::PathMtuProbeAck):
+    case uint8_t (Type::Reliable):
+    case uint8_t (Type::SelectiveAck):
+    case uint8_t (Type::Parity):
+        return Type (type);
+    default:
+        qDebug () << "Unknown control message type" << type;
+        return {};
+    }
+}
+QNetworkDatagram encodePathMtuProbe (const QHostAddress& host, uint16_t port, uint64_t probe_id, size_t size)
+{
+    return encode_path_mtu_probe (Type::PathMtuProbe, host, port, probe_id, size, size);
+}
+QNetworkDatagram encodePathMtuProbeAck (const QHostAddress& host, uint16_t port, uint64_t probe_id, size_t size)
+{
+    return encode_path_mtu_probe (Type::PathMtuProbeAck, host, port, probe_id, size, 0);
+}
+bool parsePathMtuProbe (const QNetworkDatagram& datagram, uint64_t& probe_id, size_t& size)
+{
+    // Parsed in place, the datagram buffer is shared with QNetworkDatagram
+    QByteArray raw = datagram.data ();
+    size_t raw_size = raw.size ();
+    size_t off = 1;
+    uint64_t probed_size;
+    if (!HCCN::Internal::ParseUint64Id (raw.constData (), raw_size, off, probe_id) || !HCCN::Internal::ParseUint64Id (raw.constData (), raw_size, off, probed_size)) {
+        qDebug () << "Failed to parse path MTU probe";
+        return false;
+    }
+    if (parseType (datagram) == Type::PathMtuProbe && probed_size != raw_size) {
+        qDebug () << "Path MTU probe size mismatch" << probed_size << raw_size;
+        return false;
+    }
+    size = probed_size;
+    return true;
+}
+QNetworkDatagram encodeReliable (const QHostAddress& host, uint16_t port, uint64_t sequence, const QByteArray& datagram)
+{
+    // Encoded straight into the buffer the datagram keeps
+    QByteArray encoded (kReliableOverhead + datagram.size (), Qt::Uninitialized);
+    encoded.data ()[0] = char (0x80 | uint8_t (Type::Reliable));
+    size_t off = 1;
+    off += HCCN::Internal::EncodeUint64Id (encoded.data () + off, sequence);
+    std::memcpy (encoded.data () + off, datagram.constData (), datagram.size ());
+    encoded.resize (off + datagram.size ());
+    return {encoded, host, port};
+}
+bool parseReliable (const QNetworkDatagram& datagram, uint64_t& sequence, QNetworkDatagram& inner)
+{
+    // Header is parsed in place, only the payload is copied since the inner datagram outlives this one
+    QByteArray raw = datagram.data ();
+    const char* data = raw.constData ();
+    size_t size = raw.size ();
+    size_t off = 1;
+    if (!HCCN::Internal::ParseUint64Id (data, size, off, sequence)) {
+        qDebug () << "Failed to parse reliable datagram sequence";
+        return false;
+    }
+    if (off >= size || (uint8_t (data[off]) & 0x80)) {
+        qDebug () << "Invalid reliable datagram payload";
+        return false;
+    }
+    inner = QNetworkDatagram (QByteArray (data + off, size - off));
+    inner.setSender (datagram.senderAddress (), datagram.senderPort ());
+    return true;
+}
+QNetworkDatagram encodeSelectiveAck (const QHostAddress& host, uint16_t port, uint64_t base, uint64_t mask)
+{
+    char encoded[1 + 9 + 9];
+    encoded[0] = char (0x80 | uint8_t (Type::SelectiveAck));
+    size_t off = 1;
+    off += HCCN::Internal::EncodeUint64Id (encoded + off, base);
+    off += HCCN::Internal::EncodeUint64Id (encoded + off, mask);
+    return {QByteArray (encoded, off), host, port};
+}
+bool parseSelectiveAck (const QNetworkDatagram& datagram, uint64_t& base, uint64_t& mask)
+{
+    QByteArray raw = datagram.data ();
+    size_t size = raw.size ();
+    size_t off = 1;
+    if (!HCCN::Internal::ParseUint64Id (raw.constData (), size, off, base) || !HCCN::Internal::ParseUint64Id (raw.constData (), size, off, mask)) {
+        qDebug () << "Failed to parse selective acknowledge";
+        return false;
+    }
+    return true;
+}
+
+} // namespace HCCN::Control
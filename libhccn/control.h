@@ -0,0 +1,41 @@
+#pragma once
+
+#include "common.h"
+
+#include <optional>
+#include <QHostAddress>
+#include <QNetworkDatagram>
+
+
+namespace HCCN::Control {
+
+enum class Type: uint8_t {
+    PathMtuProbe = 0x01,
+    PathMtuProbeAck = 0x02,
+    Reliable = 0x03,
+    SelectiveAck = 0x04,
+    Parity = 0x05,
+};
+
+// Control meta byte + sequence number
+constexpr size_t kReliableOverhead = 1 + 9;
+// Selective acknowledge covers this many sequence numbers above the cumulative base
+constexpr uint64_t kSelectiveAckWindow = 64;
+
+bool isControl (const QNetworkDatagram& datagram);
+std::optional<Type> parseType (const QNetworkDatagram& datagram);
+
+// Probe is padded with zeroes up to the probed size, acknowledge carries only probe id and size
+QNetworkDatagram encodePathMtuProbe (const QHostAddress& host, uint16_t port, uint64_t probe_id, size_t size);
+QNetworkDatagram encodePathMtuProbeAck (const QHostAddress& host, uint16_t port, uint64_t probe_id, size_t size);
+bool parsePathMtuProbe (const QNetworkDatagram& datagram, uint64_t& probe_id, size_t& size);
+
+// Reliable datagram wraps a regular HCCN datagram, the inner datagram keeps the outer sender
+QNetworkDatagram encodeReliable (const QHostAddress& host, uint16_t port, uint64_t sequence, const QByteArray& datagram);
+bool parseReliable (const QNetworkDatagram& datagram, uint64_t& sequence, QNetworkDatagram& inner);
+
+// Everything below base is received, bit i of mask stands for base + 1 + i
+QNetworkDatagram encodeSelectiveAck (const QHostAddress& host, uint16_t port, uint64_t base, uint64_t mask);
+bool parseSelectiveAck (const QNetworkDatagram& datagram, uint64_t& base, uint64_t& mask);
+
+} // namespace HCCN::Control
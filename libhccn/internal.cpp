@@ -2,10 +2,10 @@
 
 namespace HCCN::Internal {
 
-bool ParseUint64Id (const std::vector<char>& data, size_t& off, uint64_t& value)
+bool ParseUint64Id (const char* data, size_t size, size_t& off, uint64_t& value)
 {
-    const uint8_t* rest = (const uint8_t*) data.data () + off;
-    size_t rest_size = data.size () - off;
+    const uint8_t* rest = (const uint8_t*) data + off;
+    size_t rest_size = size - off;
     if (rest_size < 1)
         return false;
     uint8_t session_id_head = rest[0];
@@ -69,6 +69,10 @@ bool ParseUint64Id (const std::vector<char>& data, size_t& off, uint64_t& value)
     }
     return true;
 }
+bool ParseUint64Id (const std::vector<char>& data, size_t& off, uint64_t& value)
+{
+    return ParseUint64Id (data.data (), data.size (), off, value);
+}
 size_t EncodeUint64Id (char* encoded, uint64_t id)
 {
     uint8_t* uencoded = (uint8_t*) encoded;
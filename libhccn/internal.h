@@ -7,6 +7,7 @@
 
 namespace HCCN::Internal {
 
+bool ParseUint64Id (const char* data, size_t size, size_t& off, uint64_t& value);
 bool ParseUint64Id (const std::vector<char>& data, size_t& off, uint64_t& value);
 size_t EncodeUint64Id (char* encoded, uint64_t id);
 
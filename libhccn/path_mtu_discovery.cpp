@@ -0,0 +1,87 @@
+#include "path_mtu_discovery.h"
+
+#include <cerrno>
+#include <cstring>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+
+namespace HCCN {
+
+PathMtuDiscovery::PathMtuDiscovery (size_t ceiling)
+    : ceiling (clampDatagramSize (ceiling))
+    , search_high (this->ceiling)
+{
+}
+bool PathMtuDiscovery::configureSocket (qintptr socket_descriptor)
+{
+    // Set DF on outgoing datagrams without letting the kernel cap them to its cached path MTU,
+    // otherwise oversized probes get fragmented by IP and always succeed
+    int value = IP_PMTUDISC_PROBE;
+    bool ipv4_ok = !setsockopt (socket_descriptor, IPPROTO_IP, IP_MTU_DISCOVER, &value, sizeof (value));
+    value = IPV6_PMTUDISC_PROBE;
+    bool ipv6_ok = !setsockopt (socket_descriptor, IPPROTO_IPV6, IPV6_MTU_DISCOVER, &value, sizeof (value));
+    if (!ipv4_ok && !ipv6_ok) {
+        qDebug () << "Failed to configure path MTU discovery:" << strerror (errno);
+        return false;
+    }
+    return true;
+}
+void PathMtuDiscovery::setCeiling (size_t ceiling)
+{
+    ceiling = clampDatagramSize (ceiling);
+    if (ceiling == this->ceiling)
+        return;
+    this->ceiling = ceiling;
+    confirmed = qMin (confirmed, ceiling);
+    search_high = ceiling;
+    probe_size = 0;
+    probe_attempts = 0;
+    search_restart_at.reset ();
+}
+size_t PathMtuDiscovery::datagramSize () const
+{
+    return confirmed;
+}
+std::optional<size_t> PathMtuDiscovery::nextProbe (qint64 now_ms, uint64_t& probe_id)
+{
+    if (probe_size) {
+        if (now_ms - probe_sent_at < kProbeTimeoutMs)
+            return {};
+        if (probe_attempts >= kMaxProbeAttempts) {
+            search_high = probe_size - 1;
+            probe_size = 0;
+            probe_attempts = 0;
+        }
+    }
+    if (!probe_size) {
+        if (search_high < confirmed + kSearchGranularity) {
+            if (!search_restart_at.has_value ()) {
+                search_restart_at = now_ms + kSearchRestartMs;
+                return {};
+            }
+            if (now_ms < *search_restart_at)
+                return {};
+            search_restart_at.reset ();
+            search_high = ceiling;
+            if (search_high < confirmed + kSearchGranularity)
+                return {};
+        }
+        probe_size = search_high == ceiling ? ceiling : (confirmed + search_high + 1) / 2;
+        first_probe_id = next_probe_id;
+    }
+    ++probe_attempts;
+    probe_sent_at = now_ms;
+    probe_id = next_probe_id++;
+    return probe_size;
+}
+void PathMtuDiscovery::acknowledge (uint64_t probe_id, size_t size)
+{
+    if (!probe_size || size != probe_size || probe_id < first_probe_id || probe_id >= next_probe_id)
+        return;
+    confirmed = size;
+    probe_size = 0;
+    probe_attempts = 0;
+}
+
+} // namespace HCCN
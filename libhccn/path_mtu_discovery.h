@@ -0,0 +1,42 @@
+#pragma once
+
+#include "common.h"
+
+#include <optional>
+
+
+namespace HCCN {
+
+// Packetization layer path MTU discovery (RFC 8899) over HCCN control datagrams.
+// Starts from kDefaultMaxDatagramSize, probes the configured ceiling first and
+// falls back to binary search; a probe size is confirmed once acknowledged and
+// considered failed after kMaxProbeAttempts unanswered transmissions.
+class PathMtuDiscovery
+{
+public:
+    PathMtuDiscovery (size_t ceiling = kDefaultMaxDatagramSize);
+    static bool configureSocket (qintptr socket_descriptor);
+
+    void setCeiling (size_t ceiling);
+    size_t datagramSize () const;
+    std::optional<size_t> nextProbe (qint64 now_ms, uint64_t& probe_id);
+    void acknowledge (uint64_t probe_id, size_t size);
+
+private:
+    static constexpr int kMaxProbeAttempts = 3;
+    static constexpr qint64 kProbeTimeoutMs = 500;
+    static constexpr qint64 kSearchRestartMs = 600000;
+    static constexpr size_t kSearchGranularity = 16;
+
+    size_t ceiling;
+    size_t confirmed = kDefaultMaxDatagramSize;
+    size_t search_high;
+    size_t probe_size = 0;
+    uint64_t first_probe_id = 0;
+    uint64_t next_probe_id = 0;
+    int probe_attempts = 0;
+    qint64 probe_sent_at = 0;
+    std::optional<qint64> search_restart_at;
+};
+
+} // namespace HCCN
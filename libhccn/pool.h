@@ -0,0 +1,205 @@
+#pragma once
+
+#include <QMutex>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+
+
+namespace HCCN {
+
+// Free list of heap objects of one type shared by all threads. Every thread keeps a small cache and trades
+// whole batches with the shared list, so objects released on another thread than the one that took them
+// (network thread and main thread, rooms and main thread) cost one lock per batch
+template <typename T>
+class Pool
+{
+public:
+    // Recycled object when there is one, otherwise a new default-constructed one
+    static T* take ();
+    static void give (T* item);
+
+private:
+    static constexpr size_t kBatchSize = 64;
+    // Shared list keeps at most this many batches, anything above goes back to the heap
+    static constexpr size_t kMaxSharedBatches = 64;
+
+    struct Shared {
+        ~Shared ();
+
+        QMutex mutex;
+        std::vector<std::vector<T*>> batches;
+    };
+    struct Local {
+        ~Local ();
+
+        std::vector<T*> items;
+    };
+
+    static Shared& shared ();
+    static Local& local ();
+};
+
+// Raw storage for one object of the given size, lets std::shared_ptr control blocks come from a Pool
+template <size_t kSize, size_t kAlign>
+struct PoolBlock {
+    alignas (kAlign) unsigned char storage[kSize];
+};
+
+// Single object allocations come from the Pool of their size, arrays from the heap
+template <typename T>
+struct PoolAllocator {
+    typedef T value_type;
+
+    PoolAllocator () = default;
+    template <typename U>
+    PoolAllocator (const PoolAllocator<U>&)
+    {
+    }
+    T* allocate (size_t n);
+    void deallocate (T* p, size_t n);
+    template <typename U>
+    bool operator== (const PoolAllocator<U>&) const
+    {
+        return true;
+    }
+    template <typename U>
+    bool operator!= (const PoolAllocator<U>&) const
+    {
+        return false;
+    }
+};
+
+// Buffers keep their capacity across uses unless they grew past this
+constexpr size_t kMaxRetainedBufferSize = 65536;
+
+void recycle (std::vector<char>& buffer);
+template <typename T>
+void recycle (T& item);
+
+template <typename T>
+struct PoolRecycler {
+    void operator() (T* item) const;
+};
+
+// Pooled object in a std::shared_ptr whose control block is pooled as well. Releasing the last reference
+// resets the object through recycle () and returns both to their pools, so steady traffic does not allocate
+template <typename T>
+std::shared_ptr<T> makePooled ();
+
+} // namespace HCCN
+
+// Implementation
+
+template <typename T>
+T* HCCN::Pool<T>::take ()
+{
+    Local& cache = local ();
+    if (cache.items.empty ()) {
+        Shared& pool = shared ();
+        QMutexLocker locker (&pool.mutex);
+        if (!pool.batches.empty ()) {
+            cache.items.swap (pool.batches.back ());
+            pool.batches.pop_back ();
+        }
+    }
+    if (cache.items.empty ())
+        return new T;
+    T* item = cache.items.back ();
+    cache.items.pop_back ();
+    return item;
+}
+template <typename T>
+void HCCN::Pool<T>::give (T* item)
+{
+    Local& cache = local ();
+    cache.items.push_back (item);
+    if (cache.items.size () < 2*kBatchSize)
+        return;
+
+    std::vector<T*> batch (cache.items.end () - kBatchSize, cache.items.end ());
+    cache.items.resize (cache.items.size () - kBatchSize);
+    Shared& pool = shared ();
+    QMutexLocker locker (&pool.mutex);
+    if (pool.batches.size () < kMaxSharedBatches) {
+        pool.batches.push_back (std::move (batch));
+        return;
+    }
+    locker.unlock ();
+    for (T* excess: batch)
+        delete excess;
+}
+template <typename T>
+HCCN::Pool<T>::Shared::~Shared ()
+{
+    for (const std::vector<T*>& batch: batches) {
+        for (T* item: batch)
+            delete item;
+    }
+}
+template <typename T>
+HCCN::Pool<T>::Local::~Local ()
+{
+    // Thread exits, its cache goes to the shared list so that other threads can still use it
+    if (items.empty ())
+        return;
+    Shared& pool = shared ();
+    QMutexLocker locker (&pool.mutex);
+    pool.batches.push_back (std::move (items));
+}
+template <typename T>
+typename HCCN::Pool<T>::Shared& HCCN::Pool<T>::shared ()
+{
+    static Shared pool;
+    return pool;
+}
+template <typename T>
+typename HCCN::Pool<T>::Local& HCCN::Pool<T>::local ()
+{
+    static thread_local Local cache;
+    return cache;
+}
+
+template <typename T>
+T* HCCN::PoolAllocator<T>::allocate (size_t n)
+{
+    if (n != 1)
+        return std::allocator<T> ().allocate (n);
+    return reinterpret_cast<T*> (Pool<PoolBlock<sizeof (T), alignof (T)>>::take ());
+}
+template <typename T>
+void HCCN::PoolAllocator<T>::deallocate (T* p, size_t n)
+{
+    if (n != 1) {
+        std::allocator<T> ().deallocate (p, n);
+        return;
+    }
+    Pool<PoolBlock<sizeof (T), alignof (T)>>::give (reinterpret_cast<PoolBlock<sizeof (T), alignof (T)>*> (p));
+}
+
+inline void HCCN::recycle (std::vector<char>& buffer)
+{
+    if (buffer.capacity () > kMaxRetainedBufferSize)
+        std::vector<char> ().swap (buffer);
+    else
+        buffer.clear ();
+}
+template <typename T>
+void HCCN::recycle (T& item)
+{
+    item.recycle ();
+}
+
+template <typename T>
+void HCCN::PoolRecycler<T>::operator() (T* item) const
+{
+    recycle (*item);
+    Pool<T>::give (item);
+}
+
+template <typename T>
+std::shared_ptr<T> HCCN::makePooled ()
+{
+    return std::shared_ptr<T> (Pool<T>::take (), PoolRecycler<T> (), PoolAllocator<T> ());
+}
@@ -0,0 +1,219 @@
+#include "reliable_channel.h"
+
+#include "control.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace HCCN {
+
+ReliableChannel::ReliableChannel (const QHostAddress& host, uint16_t port)
+    : host (host)
+    , port (port)
+{
+}
+std::optional<QNetworkDatagram> ReliableChannel::wrap (const QByteArray& datagram, qint64 now_ms)
+{
+    uint64_t sequence = next_sequence++;
+    QNetworkDatagram wrapped = Control::encodeReliable (host, port, sequence, datagram);
+    if (!inWindow (sequence)) {
+        unacked[sequence] = {wrapped.data (), 0, 0, 0};
+        return {};
+    }
+    unacked[sequence] = {wrapped.data (), now_ms, now_ms + qint64 (rto_ms), 1};
+    return wrapped;
+}
+void ReliableChannel::acknowledge (uint64_t base, uint64_t mask, qint64 now_ms)
+{
+    std::map<uint64_t, PendingDatagram>::iterator it = unacked.begin ();
+    while (it != unacked.end ()) {
+        uint64_t sequence = it->first;
+        if (sequence > base + Control::kSelectiveAckWindow || !it->second.transmissions)
+            break;
+        if (sequence < base || (sequence > base && (mask >> (sequence - base - 1)) & 1)) {
+            if (it->second.transmissions == 1)
+                sampleRtt (now_ms - it->second.sent_at);
+            sampleLoss (false);
+            it = unacked.erase (it);
+        } else {
+            ++it;
+        }
+    }
+}
+void ReliableChannel::retransmissions (qint64 now_ms, std::vector<QNetworkDatagram>& datagrams)
+{
+    std::map<uint64_t, PendingDatagram>::iterator it = unacked.begin ();
+    while (it != unacked.end ()) {
+        PendingDatagram& pending = it->second;
+        if (!pending.transmissions) {
+            if (!inWindow (it->first))
+                break;
+            pending.sent_at = now_ms;
+            pending.retransmit_at = now_ms + qint64 (rto_ms);
+            pending.transmissions = 1;
+            datagrams.push_back ({pending.datagram, host, port});
+            ++it;
+            continue;
+        }
+        if (now_ms < pending.retransmit_at) {
+            ++it;
+            continue;
+        }
+        sampleLoss (true);
+        if (pending.transmissions >= kMaxTransmissions) {
+            ++dropped_count;
+            it = unacked.erase (it);
+            continue;
+        }
+        // Exponential backoff per datagram, RTO itself is only updated from samples
+        pending.retransmit_at = now_ms + qint64 (qMin (rto_ms * double (1 << pending.transmissions), kMaxRtoMs));
+        ++pending.transmissions;
+        ++retransmission_count;
+        datagrams.push_back ({pending.datagram, host, port});
+        ++it;
+    }
+}
+bool ReliableChannel::receive (uint64_t sequence)
+{
+    if (sequence < receive_base || !received_above_base.insert (sequence).second)
+        return false;
+
+    // Sender never runs more than a window ahead of its oldest unacknowledged sequence, so a sequence
+    // this far past a hole means the sender gave up on it: don't let it pin the window forever
+    uint64_t highest = *received_above_base.rbegin ();
+    if (highest > receive_base + Control::kSelectiveAckWindow) {
+        receive_base = highest - Control::kSelectiveAckWindow;
+        received_above_base.erase (received_above_base.begin (), received_above_base.lower_bound (receive_base));
+    }
+    while (!received_above_base.empty () && *received_above_base.begin () == receive_base) {
+        received_above_base.erase (received_above_base.begin ());
+        ++receive_base;
+    }
+    return true;
+}
+QNetworkDatagram ReliableChannel::encodeAck () const
+{
+    uint64_t mask = 0;
+    for (std::set<uint64_t>::const_iterator it = received_above_base.begin (); it != received_above_base.end (); ++it) {
+        uint64_t bit = *it - receive_base - 1;
+        if (bit >= Control::kSelectiveAckWindow)
+            break;
+        mask |= uint64_t (1) << bit;
+    }
+    return Control::encodeSelectiveAck (host, port, receive_base, mask);
+}
+TransportStats ReliableChannel::stats () const
+{
+    TransportStats stats;
+    stats.host = host;
+    stats.port = port;
+    stats.rtt_ms = srtt_ms.value_or (0.0);
+    stats.rtt_variance_ms = rttvar_ms;
+    stats.rto_ms = rto_ms;
+    stats.loss_rate = loss_rate;
+    stats.retransmissions = retransmission_count;
+    stats.dropped = dropped_count;
+    return stats;
+}
+void ReliableChannel::sampleRtt (double rtt_ms)
+{
+    if (!srtt_ms.has_value ()) {
+        srtt_ms = rtt_ms;
+        rttvar_ms = rtt_ms / 2.0;
+    } else {
+        rttvar_ms = 0.75 * rttvar_ms + 0.25 * std::fabs (*srtt_ms - rtt_ms);
+        srtt_ms = 0.875 * *srtt_ms + 0.125 * rtt_ms;
+    }
+    rto_ms = qBound (kMinRtoMs, *srtt_ms + qMax (kClockGranularityMs, 4.0 * rttvar_ms), kMaxRtoMs);
+}
+void ReliableChannel::sampleLoss (bool lost)
+{
+    loss_rate += kLossGain * ((lost ? 1.0 : 0.0) - loss_rate);
+}
+bool ReliableChannel::inWindow (uint64_t sequence) const
+{
+    return unacked.empty () || sequence < unacked.begin ()->first + Control::kSelectiveAckWindow;
+}
+
+std::optional<QNetworkDatagram> ReliableTransport::wrap (const QHostAddress& host, uint16_t port, const QByteArray& datagram, qint64 now_ms)
+{
+    return channel (host, port)->wrap (datagram, now_ms);
+}
+std::optional<QNetworkDatagram> ReliableTransport::receive (const QNetworkDatagram& datagram, qint64 now_ms)
+{
+    std::optional<Control::Type> type = Control::parseType (datagram);
+    if (!type.has_value ())
+        return {};
+
+    switch (*type) {
+    case Control::Type::Reliable: {
+        uint64_t sequence;
+        QNetworkDatagram inner;
+        if (!Control::parseReliable (datagram, sequence, inner))
+            return {};
+        std::shared_ptr<ReliableChannel> peer_channel = channel (datagram.senderAddress (), datagram.senderPort ());
+        bool is_new = peer_channel->receive (sequence);
+        // Duplicates are acknowledged too, previous acknowledge might have been lost
+        if (std::find (pending_acks.begin (), pending_acks.end (), peer_channel) == pending_acks.end ())
+            pending_acks.push_back (peer_channel);
+        if (!is_new)
+            return {};
+        return inner;
+    }
+    case Control::Type::SelectiveAck: {
+        uint64_t base;
+        uint64_t mask;
+        if (!Control::parseSelectiveAck (datagram, base, mask))
+            return {};
+        QHash<TransportPeerIdentifier, std::shared_ptr<ReliableChannel>>::iterator it = channels.find (TransportPeerIdentifier (datagram.senderAddress (), datagram.senderPort ()));
+        if (it != channels.end ())
+            (*it)->acknowledge (base, mask, now_ms);
+        return {};
+    }
+    default:
+        return {};
+    }
+}
+std::vector<QNetworkDatagram> ReliableTransport::takeAcks ()
+{
+    std::vector<QNetworkDatagram> acks;
+    acks.reserve (pending_acks.size ());
+    for (const std::shared_ptr<ReliableChannel>& peer_channel: pending_acks)
+        acks.push_back (peer_channel->encodeAck ());
+    pending_acks.clear ();
+    return acks;
+}
+std::vector<QNetworkDatagram> ReliableTransport::retransmissions (qint64 now_ms)
+{
+    std::vector<QNetworkDatagram> datagrams;
+    for (QHash<TransportPeerIdentifier, std::shared_ptr<ReliableChannel>>::iterator it = channels.begin (); it != channels.end (); ++it)
+        (*it)->retransmissions (now_ms, datagrams);
+    return datagrams;
+}
+std::vector<TransportStats> ReliableTransport::stats () const
+{
+    std::vector<TransportStats> stats;
+    stats.reserve (channels.size ());
+    for (QHash<TransportPeerIdentifier, std::shared_ptr<ReliableChannel>>::const_iterator it = channels.begin (); it != channels.end (); ++it)
+        stats.push_back ((*it)->stats ());
+    return stats;
+}
+void ReliableTransport::close (const QHostAddress& host, uint16_t port)
+{
+    QHash<TransportPeerIdentifier, std::shared_ptr<ReliableChannel>>::iterator it = channels.find (TransportPeerIdentifier (host, port));
+    if (it == channels.end ())
+        return;
+    pending_acks.erase (std::remove (pending_acks.begin (), pending_acks.end (), *it), pending_acks.end ());
+    channels.erase (it);
+}
+std::shared_ptr<ReliableChannel> ReliableTransport::channel (const QHostAddress& host, uint16_t port)
+{
+    TransportPeerIdentifier peer (host, port);
+    QHash<TransportPeerIdentifier, std::shared_ptr<ReliableChannel>>::iterator it = channels.find (peer);
+    if (it == channels.end ())
+        it = channels.insert (peer, std::shared_ptr<ReliableChannel> (new ReliableChannel (host, port)));
+    return *it;
+}
+
+} // namespace HCCN
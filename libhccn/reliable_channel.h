@@ -0,0 +1,105 @@
+#pragma once
+
+#include "common.h"
+
+#include <map>
+#include <memory>
+#include <optional>
+#include <set>
+#include <vector>
+#include <QByteArray>
+#include <QHash>
+#include <QHostAddress>
+#include <QNetworkDatagram>
+
+
+namespace HCCN {
+
+struct TransportStats {
+    QHostAddress host;
+    uint16_t port;
+    double rtt_ms = 0.0;
+    double rtt_variance_ms = 0.0;
+    double rto_ms = 0.0;
+    double loss_rate = 0.0;
+    uint64_t retransmissions = 0;
+    uint64_t dropped = 0;
+};
+
+// Selective acknowledge reliability for a single peer: sender side keeps wrapped datagrams
+// until acknowledged and retransmits them on RTO (RFC 6298, Karn's algorithm for samples),
+// receiver side deduplicates by sequence and reports cumulative base plus bitmask.
+// Sender keeps at most kSelectiveAckWindow sequences in flight past the oldest unacknowledged one,
+// so receiver only slides its base over holes the sender already gave up on.
+class ReliableChannel
+{
+public:
+    ReliableChannel (const QHostAddress& host, uint16_t port);
+
+    // Empty when the window is full, the datagram then goes out from retransmissions () once it opens
+    std::optional<QNetworkDatagram> wrap (const QByteArray& datagram, qint64 now_ms);
+    void acknowledge (uint64_t base, uint64_t mask, qint64 now_ms);
+    void retransmissions (qint64 now_ms, std::vector<QNetworkDatagram>& datagrams);
+
+    bool receive (uint64_t sequence);
+    QNetworkDatagram encodeAck () const;
+
+    TransportStats stats () const;
+
+private:
+    static constexpr double kInitialRtoMs = 1000.0;
+    static constexpr double kMinRtoMs = 100.0;
+    static constexpr double kMaxRtoMs = 4000.0;
+    static constexpr double kClockGranularityMs = 1.0;
+    static constexpr double kLossGain = 1.0 / 16.0;
+    static constexpr int kMaxTransmissions = 8;
+
+    struct PendingDatagram {
+        QByteArray datagram;
+        qint64 sent_at;
+        qint64 retransmit_at;
+        int transmissions; // Zero while held back by the window
+    };
+
+    void sampleRtt (double rtt_ms);
+    void sampleLoss (bool lost);
+    bool inWindow (uint64_t sequence) const;
+
+    const QHostAddress host;
+    const uint16_t port;
+
+    uint64_t next_sequence = 0;
+    std::map<uint64_t, PendingDatagram> unacked;
+    std::optional<double> srtt_ms;
+    double rttvar_ms = 0.0;
+    double rto_ms = kInitialRtoMs;
+    double loss_rate = 0.0;
+    uint64_t retransmission_count = 0;
+    uint64_t dropped_count = 0;
+
+    uint64_t receive_base = 0;
+    std::set<uint64_t> received_above_base;
+};
+
+// Reliable channels of all peers served by a single socket
+class ReliableTransport
+{
+public:
+    std::optional<QNetworkDatagram> wrap (const QHostAddress& host, uint16_t port, const QByteArray& datagram, qint64 now_ms);
+    // Handles reliable and selective acknowledge control datagrams, returns inner datagram if it is new
+    std::optional<QNetworkDatagram> receive (const QNetworkDatagram& datagram, qint64 now_ms);
+    std::vector<QNetworkDatagram> takeAcks ();
+    // Retransmissions due and datagrams the window let through since the last call
+    std::vector<QNetworkDatagram> retransmissions (qint64 now_ms);
+    std::vector<TransportStats> stats () const;
+    // Peer's session ended, whatever is still unacknowledged is dropped
+    void close (const QHostAddress& host, uint16_t port);
+
+private:
+    std::shared_ptr<ReliableChannel> channel (const QHostAddress& host, uint16_t port);
+
+    QHash<TransportPeerIdentifier, std::shared_ptr<ReliableChannel>> channels;
+    std::vector<std::shared_ptr<ReliableChannel>> pending_acks;
+};
+
+} // namespace HCCN
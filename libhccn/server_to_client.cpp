@@ -1,7 +1,13 @@
 #include "server_to_client.h"
 
+#include "control.h"
 #include "internal.h"
 
+#include <cerrno>
+#include <cstring>
+#include <netinet/in.h>
+#include <poll.h>
+
 
 static char encode_single_message_meta (bool have_session_id, bool have_request_id)
 {
@@ -52,15 +58,15 @@ static size_t encode_ids (char* encoded, const std::optional<uint64_t>& session_
     off += HCCN::Internal::EncodeUint64Id (encoded + off, response_id);
     return off;
 }
-static bool parse_meta (const std::vector<char>& data, size_t& off, bool& is_tail, bool& session_id_present, bool& request_id_present, uint64_t& fragment_number)
+static bool parse_meta (const char* data, size_t size, size_t& off, bool& is_tail, bool& session_id_present, bool& request_id_present, uint64_t& fragment_number)
 {
-    if (data.size () < 1) {
+    if (size < 1) {
         qDebug () << "Empty message";
         return false;
     }
-    uint8_t meta = data.at (0);
+    uint8_t meta = data[0];
     if (meta & 0x80) {
-        qDebug () << "Acknowledge mode not implemented";
+        qDebug () << "Unexpected control message";
         return false;
     }
     is_tail = meta & 0x40;
@@ -70,32 +76,32 @@ static bool parse_meta (const std::vector<char>& data, size_t& off, bool& is_tai
         fragment_number = meta & 0x7;
         off = 1;
     } else if (!(meta & 0x04)) {
-        if (data.size () < 2) {
+        if (size < 2) {
             qDebug () << "Unexpected end of message";
             return false;
         }
-        fragment_number = ((uint64_t (meta & 0x3) << 8) | uint8_t (data.at (1))) + 0x08;
+        fragment_number = ((uint64_t (meta & 0x3) << 8) | uint8_t (data[1])) + 0x08;
         off = 2;
     } else if (!(meta & 0x02)) {
-        if (data.size () < 3) {
+        if (size < 3) {
             qDebug () << "Unexpected end of message";
             return false;
         }
-        fragment_number = ((uint64_t (meta & 0x1) << 16) | (uint64_t (uint8_t (data.at (1))) << 8) | uint8_t (data.at (2))) + 0x0408;
+        fragment_number = ((uint64_t (meta & 0x1) << 16) | (uint64_t (uint8_t (data[1])) << 8) | uint8_t (data[2])) + 0x0408;
         off = 3;
     } else if (!(meta & 0x01)) {
-        if (data.size () < 4) {
+        if (size < 4) {
             qDebug () << "Unexpected end of message";
             return false;
         }
-        fragment_number = ((uint64_t (uint8_t (data.at (1))) << 16) | (uint64_t (uint8_t (data.at (2))) << 8) | uint8_t (data.at (3))) + 0x020408;
+        fragment_number = ((uint64_t (uint8_t (data[1])) << 16) | (uint64_t (uint8_t (data[2])) << 8) | uint8_t (data[3])) + 0x020408;
         off = 4;
     } else {
-        if (data.size () < 5) {
+        if (size < 5) {
             qDebug () << "Unexpected end of message";
             return false;
         }
-        fragment_number = ((uint64_t (uint8_t (data.at (1))) << 24) | (uint64_t (uint8_t (data.at (2))) << 16) | (uint64_t (uint8_t (data.at (3))) << 8) | uint8_t (data.at (4))) + 0x01020408;
+        fragment_number = ((uint64_t (uint8_t (data[1])) << 24) | (uint64_t (uint8_t (data[2])) << 16) | (uint64_t (uint8_t (data[3])) << 8) | uint8_t (data[4])) + 0x01020408;
         off = 5;
     }
 
@@ -124,13 +130,46 @@ Message::Message (
     , message (message)
 {
 }
-std::vector<QNetworkDatagram> Message::encode () const
+Message::Message (
+    const QHostAddress& host,
+    uint16_t port,
+    const std::optional<uint64_t>& session_id,
+    const std::optional<uint64_t>& request_id,
+    uint64_t response_id,
+    const SharedPayload& shared_message)
+    : host (host)
+    , port (port)
+    , session_id (session_id)
+    , request_id (request_id)
+    , response_id (response_id)
+    , shared_message (shared_message)
 {
-    char id_set[24];
+}
+const std::vector<char>& Message::payload () const
+{
+    return shared_message ? *shared_message : message;
+}
+void Message::recycle ()
+{
+    // Host is overwritten by the next use, resetting it would allocate
+    session_id.reset ();
+    request_id.reset ();
+    response_id = 0;
+    HCCN::recycle (message);
+    shared_message.reset ();
+    max_datagram_size = kDefaultMaxDatagramSize;
+    discover_path_mtu = false;
+    reliable = false;
+    fec_group_size = 0;
+}
+std::vector<QNetworkDatagram> Message::encode (size_t max_datagram_size) const
+{
+    const std::vector<char>& message = payload ();
+    char id_set[kMaxIdSetSize];
     size_t id_set_len = encode_ids (id_set, session_id, request_id, response_id);
     size_t single_message_len = 1 + id_set_len + message.size ();
     std::vector<QNetworkDatagram> datagrams;
-    if (single_message_len <= 508) { // Single message
+    if (single_message_len <= max_datagram_size) { // Single message
         std::vector<char> encoded;
         encoded.reserve (single_message_len);
         encoded.push_back (encode_single_message_meta (session_id.has_value (), request_id.has_value ()));
@@ -138,7 +177,7 @@ std::vector<QNetworkDatagram> Message::encode () const
         encoded.insert (encoded.end (), message.begin (), message.end ());
         datagrams.push_back ({QByteArray (encoded.data (), encoded.size ()), host, port});
     } else { // Fragmented
-        size_t full_fragment_len = 508 - 5 - id_set_len;
+        size_t full_fragment_len = max_datagram_size - 5 - id_set_len;
         size_t full_size_fragment_count = message.size () / full_fragment_len;
         size_t last_fragment_len = message.size () % full_fragment_len;
         size_t fragment_count = full_size_fragment_count + !!last_fragment_len;
@@ -171,25 +210,27 @@ std::vector<QNetworkDatagram> Message::encode () const
 
 std::shared_ptr<MessageFragment> MessageFragment::parse (const QNetworkDatagram& datagram)
 {
-    std::vector<char> data = {datagram.data ().constData (), datagram.data ().constData () + datagram.data ().size ()};
+    QByteArray bytes = datagram.data ();
+    const char* data = bytes.constData ();
+    size_t size = bytes.size ();
     size_t off;
     bool is_tail;
     bool session_id_present;
     bool request_id_present;
     uint64_t fragment_number;
-    if (data.size () < 1) {
+    if (size < 1) {
         qDebug () << "Empty message";
         return nullptr;
     }
-    if (!parse_meta (data, off, is_tail, session_id_present, request_id_present, fragment_number)) {
+    if (!parse_meta (data, size, off, is_tail, session_id_present, request_id_present, fragment_number)) {
         return nullptr;
     }
-    std::shared_ptr<MessageFragment> transport_message (new MessageFragment);
+    std::shared_ptr<MessageFragment> transport_message = makePooled<MessageFragment> ();
     transport_message->host = datagram.senderAddress ();
     transport_message->port = datagram.senderPort ();
     if (session_id_present) {
         uint64_t session_id;
-        if (!HCCN::Internal::ParseUint64Id (data, off, session_id)) {
+        if (!HCCN::Internal::ParseUint64Id (data, size, off, session_id)) {
             qDebug () << "Failed to parse session id";
             return nullptr;
         }
@@ -197,7 +238,7 @@ std::shared_ptr<MessageFragment> MessageFragment::parse (const QNetworkDatagram&
     }
     if (request_id_present) {
         uint64_t request_id;
-        if (!HCCN::Internal::ParseUint64Id (data, off, request_id)) {
+        if (!HCCN::Internal::ParseUint64Id (data, size, off, request_id)) {
             qDebug () << "Failed to parse request id";
             return nullptr;
         }
@@ -205,19 +246,96 @@ std::shared_ptr<MessageFragment> MessageFragment::parse (const QNetworkDatagram&
     }
     {
         uint64_t response_id;
-        if (!HCCN::Internal::ParseUint64Id (data, off, response_id)) {
+        if (!HCCN::Internal::ParseUint64Id (data, size, off, response_id)) {
             qDebug () << "Failed to parse response id";
             return nullptr;
         }
         transport_message->response_id = response_id;
     }
-    transport_message->fragment = {data.data () + off, data.data () + data.size ()};
+    transport_message->fragment.assign (data + off, data + size);
     transport_message->is_tail = is_tail;
     transport_message->fragment_number = fragment_number;
     return transport_message;
 }
+void MessageFragment::recycle ()
+{
+    session_id.reset ();
+    request_id.reset ();
+    response_id = 0;
+    HCCN::recycle (fragment);
+    is_tail = false;
+    fragment_number = 0;
+}
+std::shared_ptr<ParityFragment> ParityFragment::parse (const QNetworkDatagram& datagram)
+{
+    QByteArray bytes = datagram.data ();
+    const char* data = bytes.constData ();
+    size_t size = bytes.size ();
+    if (size < 2) {
+        qDebug () << "Unexpected end of parity fragment";
+        return nullptr;
+    }
+    uint8_t presence = data[1];
+    size_t off = 2;
+    std::shared_ptr<ParityFragment> parity_fragment = makePooled<ParityFragment> ();
+    parity_fragment->host = datagram.senderAddress ();
+    parity_fragment->port = datagram.senderPort ();
+    if (presence & 0x20) {
+        uint64_t session_id;
+        if (!HCCN::Internal::ParseUint64Id (data, size, off, session_id)) {
+            qDebug () << "Failed to parse session id";
+            return nullptr;
+        }
+        parity_fragment->session_id = session_id;
+    }
+    if (presence & 0x10) {
+        uint64_t request_id;
+        if (!HCCN::Internal::ParseUint64Id (data, size, off, request_id)) {
+            qDebug () << "Failed to parse request id";
+            return nullptr;
+        }
+        parity_fragment->request_id = request_id;
+    }
+    if (!HCCN::Internal::ParseUint64Id (data, size, off, parity_fragment->response_id) ||
+        !HCCN::Internal::ParseUint64Id (data, size, off, parity_fragment->first_fragment_index) ||
+        !HCCN::Internal::ParseUint64Id (data, size, off, parity_fragment->group_fragment_count) ||
+        !HCCN::Internal::ParseUint64Id (data, size, off, parity_fragment->fragment_count) ||
+        !HCCN::Internal::ParseUint64Id (data, size, off, parity_fragment->length_xor)) {
+        qDebug () << "Failed to parse parity fragment group";
+        return nullptr;
+    }
+    if (parity_fragment->fragment_count > 2097152 || !parity_fragment->group_fragment_count ||
+        parity_fragment->first_fragment_index + parity_fragment->group_fragment_count > parity_fragment->fragment_count) {
+        qDebug () << "Invalid parity fragment group";
+        return nullptr;
+    }
+    parity_fragment->parity.assign (data + off, data + size);
+    return parity_fragment;
+}
+
+void ParityFragment::recycle ()
+{
+    session_id.reset ();
+    request_id.reset ();
+    response_id = 0;
+    first_fragment_index = 0;
+    group_fragment_count = 0;
+    fragment_count = 0;
+    length_xor = 0;
+    HCCN::recycle (parity);
+}
 
 void MessageFragmentCollector::insert (const std::shared_ptr<MessageFragment>& fragment)
+{
+    insertFragment (fragment);
+    recover ();
+}
+void MessageFragmentCollector::insertParity (const std::shared_ptr<ParityFragment>& parity_fragment)
+{
+    parity.push_back (parity_fragment);
+    recover ();
+}
+void MessageFragmentCollector::insertFragment (const std::shared_ptr<MessageFragment>& fragment)
 {
     if (fragment->is_tail) {
         uint64_t fragment_index = fragment->fragment_number + 1;
@@ -240,12 +358,261 @@ std::shared_ptr<Message> MessageFragmentCollector::build ()
     if (!complete ())
         return nullptr;
 
-    std::vector<char> data = head->fragment;
-    for (std::map<uint64_t, std::shared_ptr<MessageFragment>>::const_iterator it = tail.begin (); it != tail.end (); ++it) {
+    std::shared_ptr<Message> message = makePooled<Message> ();
+    message->host = head->host;
+    message->port = head->port;
+    message->session_id = head->session_id;
+    message->request_id = head->request_id;
+    message->response_id = head->response_id;
+    message->message.assign (head->fragment.begin (), head->fragment.end ());
+    for (FragmentMap::const_iterator it = tail.begin (); it != tail.end (); ++it) {
         const std::vector<char>& fragment = it->second->fragment;
-        data.insert (data.end (), fragment.begin (), fragment.end ());
+        message->message.insert (message->message.end (), fragment.begin (), fragment.end ());
+    }
+    return message;
+}
+void MessageFragmentCollector::recycle ()
+{
+    tail.clear ();
+    max_fragment_index = 0;
+    head.reset ();
+    parity.clear ();
+}
+std::shared_ptr<MessageFragment> MessageFragmentCollector::fragment (uint64_t fragment_index) const
+{
+    if (!fragment_index)
+        return head;
+    FragmentMap::const_iterator it = tail.find (fragment_index);
+    return it != tail.end () ? it->second : nullptr;
+}
+void MessageFragmentCollector::recover ()
+{
+    std::vector<std::shared_ptr<ParityFragment>>::iterator it = parity.begin ();
+    while (it != parity.end ()) {
+        const ParityFragment& parity_fragment = **it;
+        uint64_t group_end = parity_fragment.first_fragment_index + parity_fragment.group_fragment_count;
+        uint64_t missing_index = 0;
+        size_t missing_count = 0;
+        for (uint64_t i = parity_fragment.first_fragment_index; i < group_end; ++i) {
+            if (!fragment (i)) {
+                missing_index = i;
+                ++missing_count;
+            }
+        }
+        if (missing_count > 1) {
+            ++it;
+            continue;
+        }
+        if (missing_count == 1) {
+            uint64_t length = parity_fragment.length_xor;
+            std::shared_ptr<MessageFragment> recovered = makePooled<MessageFragment> ();
+            std::vector<char>& data = recovered->fragment;
+            data.assign (parity_fragment.parity.begin (), parity_fragment.parity.end ());
+            for (uint64_t i = parity_fragment.first_fragment_index; i < group_end; ++i) {
+                if (i == missing_index)
+                    continue;
+                const std::vector<char>& present = fragment (i)->fragment;
+                length ^= present.size ();
+                for (size_t b = 0; b < qMin (present.size (), data.size ()); ++b)
+                    data[b] ^= present[b];
+            }
+            if (length <= data.size ()) {
+                data.resize (length);
+                recovered->host = parity_fragment.host;
+                recovered->port = parity_fragment.port;
+                recovered->session_id = parity_fragment.session_id;
+                recovered->request_id = parity_fragment.request_id;
+                recovered->response_id = parity_fragment.response_id;
+                recovered->is_tail = missing_index > 0;
+                recovered->fragment_number = missing_index ? missing_index - 1 : parity_fragment.fragment_count - 1;
+                insertFragment (recovered);
+            } else {
+                qDebug () << "Inconsistent parity fragment";
+            }
+        }
+        it = parity.erase (it);
+    }
+}
+
+ScatterGatherEncoder::ScatterGatherEncoder (size_t slot_count)
+    : slot_count (slot_count)
+    , header_ring (slot_count * kMaxMetaSize)
+    , parity_ring (slot_count)
+    , iovecs (slot_count * 3)
+    , headers (slot_count)
+{
+    std::memset (&address, 0, sizeof (address));
+    for (size_t i = 0; i < slot_count; ++i) {
+        struct msghdr& header = headers[i].msg_hdr;
+        std::memset (&header, 0, sizeof (header));
+        header.msg_name = &address;
+        header.msg_iov = &iovecs[i * 3];
+        header.msg_iovlen = 3;
+        iovecs[i * 3].iov_base = &header_ring[i * kMaxMetaSize];
+        iovecs[i * 3 + 1].iov_base = id_set;
+    }
+}
+bool ScatterGatherEncoder::send (qintptr socket_descriptor, const Message& message, size_t max_datagram_size)
+{
+    if (!setAddress (socket_descriptor, message.host, message.port))
+        return false;
+
+    size_t id_set_len = encode_ids (id_set, message.session_id, message.request_id, message.response_id);
+    const char* payload = message.payload ().data ();
+    size_t payload_size = message.payload ().size ();
+    if (1 + id_set_len + payload_size <= max_datagram_size) { // Single message
+        header_ring[0] = encode_single_message_meta (message.session_id.has_value (), message.request_id.has_value ());
+        iovecs[0].iov_len = 1;
+        iovecs[1].iov_len = id_set_len;
+        iovecs[2].iov_base = const_cast<char*> (payload);
+        iovecs[2].iov_len = payload_size;
+        return flush (socket_descriptor, 1);
+    }
+
+    // Fragmented
+    size_t fec_group_size = message.fec_group_size;
+    size_t full_fragment_len = max_datagram_size - (fec_group_size ? kMaxParityMetaSize : kMaxMetaSize) - id_set_len;
+    size_t fragment_count = payload_size / full_fragment_len + !!(payload_size % full_fragment_len);
+    if (fragment_count > 2097152)
+        return false;
+    size_t slot = 0;
+    for (size_t i = 0; i < fragment_count; ++i) {
+        size_t fragment_offset = i * full_fragment_len;
+        size_t fragment_len = qMin (full_fragment_len, payload_size - fragment_offset);
+        iovecs[slot * 3].iov_len = encode_fragmented_message_meta (&header_ring[slot * kMaxMetaSize], i > 0,
+                                                                   message.session_id.has_value (), message.request_id.has_value (), fragment_count, i);
+        iovecs[slot * 3 + 1].iov_len = id_set_len;
+        iovecs[slot * 3 + 2].iov_base = const_cast<char*> (payload + fragment_offset);
+        iovecs[slot * 3 + 2].iov_len = fragment_len;
+        if (++slot == slot_count) {
+            if (!flush (socket_descriptor, slot))
+                return false;
+            slot = 0;
+        }
+        if (fec_group_size && ((i + 1) % fec_group_size == 0 || i + 1 == fragment_count)) {
+            size_t group_fragment_count = i % fec_group_size + 1;
+            setParitySlot (slot, message, id_set_len, full_fragment_len, fragment_count, i + 1 - group_fragment_count, group_fragment_count);
+            if (++slot == slot_count) {
+                if (!flush (socket_descriptor, slot))
+                    return false;
+                slot = 0;
+            }
+        }
+    }
+    return !slot || flush (socket_descriptor, slot);
+}
+void ScatterGatherEncoder::setParitySlot (size_t slot, const Message& message, size_t id_set_len, size_t full_fragment_len,
+                                          size_t fragment_count, size_t first_fragment_index, size_t group_fragment_count)
+{
+    const char* payload = message.payload ().data ();
+    size_t payload_size = message.payload ().size ();
+    char* meta = &header_ring[slot * kMaxMetaSize];
+    meta[0] = char (0x80 | uint8_t (HCCN::Control::Type::Parity));
+    meta[1] = encode_single_message_meta (message.session_id.has_value (), message.request_id.has_value ());
+
+    uint64_t length_xor = 0;
+    for (size_t i = first_fragment_index; i < first_fragment_index + group_fragment_count; ++i)
+        length_xor ^= qMin (full_fragment_len, payload_size - i * full_fragment_len);
+    char group[4 * 9];
+    size_t group_len = 0;
+    group_len += HCCN::Internal::EncodeUint64Id (group + group_len, first_fragment_index);
+    group_len += HCCN::Internal::EncodeUint64Id (group + group_len, group_fragment_count);
+    group_len += HCCN::Internal::EncodeUint64Id (group + group_len, fragment_count);
+    group_len += HCCN::Internal::EncodeUint64Id (group + group_len, length_xor);
+
+    // Only the last fragment of the message is short, so the first one of the group is the longest
+    size_t parity_len = qMin (full_fragment_len, payload_size - first_fragment_index * full_fragment_len);
+    std::vector<char>& parity = parity_ring[slot];
+    parity.assign (group, group + group_len);
+    parity.resize (group_len + parity_len, 0);
+    for (size_t i = first_fragment_index; i < first_fragment_index + group_fragment_count; ++i) {
+        const char* fragment = payload + i * full_fragment_len;
+        size_t fragment_len = qMin (full_fragment_len, payload_size - i * full_fragment_len);
+        for (size_t b = 0; b < fragment_len; ++b)
+            parity[group_len + b] ^= fragment[b];
     }
-    return std::shared_ptr<Message> (new Message (head->host, head->port, head->session_id, head->request_id, head->response_id, data));
+
+    iovecs[slot * 3].iov_len = 2;
+    iovecs[slot * 3 + 1].iov_len = id_set_len;
+    iovecs[slot * 3 + 2].iov_base = parity.data ();
+    iovecs[slot * 3 + 2].iov_len = parity.size ();
+}
+bool ScatterGatherEncoder::setAddress (qintptr socket_descriptor, const QHostAddress& host, uint16_t port)
+{
+    if (socket_descriptor != family_socket_descriptor) {
+        struct sockaddr_storage local_address;
+        socklen_t local_address_len = sizeof (local_address);
+        if (getsockname (socket_descriptor, (struct sockaddr*) &local_address, &local_address_len) < 0) {
+            qDebug () << "Failed to query socket address:" << strerror (errno);
+            return false;
+        }
+        family_socket_descriptor = socket_descriptor;
+        socket_family = local_address.ss_family;
+    }
+
+    std::memset (&address, 0, sizeof (address));
+    bool is_ipv4 = false;
+    quint32 ipv4_address = host.toIPv4Address (&is_ipv4); // Also true for v4-mapped IPv6 addresses
+    if (socket_family == AF_INET) {
+        if (!is_ipv4) {
+            qDebug () << "IPv6 destination on IPv4 socket" << host;
+            return false;
+        }
+        struct sockaddr_in* address_in = (struct sockaddr_in*) &address;
+        address_in->sin_family = AF_INET;
+        address_in->sin_port = htons (port);
+        address_in->sin_addr.s_addr = htonl (ipv4_address);
+        address_len = sizeof (struct sockaddr_in);
+        return true;
+    }
+    if (socket_family != AF_INET6) {
+        qDebug () << "Unsupported socket family" << socket_family;
+        return false;
+    }
+    struct sockaddr_in6* address_in6 = (struct sockaddr_in6*) &address;
+    address_in6->sin6_family = AF_INET6;
+    address_in6->sin6_port = htons (port);
+    if (host.protocol () == QHostAddress::IPv4Protocol) {
+        // ::ffff:a.b.c.d
+        address_in6->sin6_addr.s6_addr[10] = 0xff;
+        address_in6->sin6_addr.s6_addr[11] = 0xff;
+        uint32_t ipv4_address_be = htonl (ipv4_address);
+        std::memcpy (&address_in6->sin6_addr.s6_addr[12], &ipv4_address_be, sizeof (ipv4_address_be));
+    } else if (host.protocol () == QHostAddress::IPv6Protocol) {
+        Q_IPV6ADDR ipv6_address = host.toIPv6Address ();
+        std::memcpy (&address_in6->sin6_addr, &ipv6_address, sizeof (ipv6_address));
+    } else {
+        qDebug () << "Unsupported destination address" << host;
+        return false;
+    }
+    address_len = sizeof (struct sockaddr_in6);
+    return true;
+}
+bool ScatterGatherEncoder::flush (qintptr socket_descriptor, size_t count)
+{
+    // sendmmsg returns how many datagrams left, the rest is resubmitted from there
+    size_t sent = 0;
+    while (sent < count) {
+        for (size_t i = sent; i < count; ++i)
+            headers[i].msg_hdr.msg_namelen = address_len;
+        int ret = sendmmsg (socket_descriptor, &headers[sent], count - sent, 0);
+        if (ret > 0) {
+            sent += ret;
+            continue;
+        }
+        if (ret < 0 && errno == EINTR)
+            continue;
+        if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)) {
+            struct pollfd poll_fd = {int (socket_descriptor), POLLOUT, 0};
+            if (poll (&poll_fd, 1, kSendBufferWaitMs) > 0)
+                continue;
+            qDebug () << "Send buffer stayed full," << count - sent << "of" << count << "datagrams not sent";
+            return false;
+        }
+        qDebug () << "Failed to send datagrams:" << (ret < 0 ? strerror (errno) : "nothing sent") << "," << count - sent << "of" << count << "not sent";
+        return false;
+    }
+    return true;
 }
 
 } // namespace HCCN::ServerToClient
@@ -1,19 +1,31 @@
 #pragma once
 
 #include "common.h"
+#include "pool.h"
 
+#include <map>
 #include <optional>
 #include <vector>
+#include <sys/socket.h>
+#include <sys/uio.h>
 #include <QHostAddress>
 #include <QNetworkDatagram>
 
 
 namespace HCCN::ServerToClient {
 
+// Immutable serialized payload shared by all recipients of a broadcast
+typedef std::shared_ptr<const std::vector<char>> SharedPayload;
+// Encoded session, request and response ids, up to 9 bytes each
+constexpr size_t kMaxIdSetSize = 27;
+
 struct Message {
     Message () = default;
     Message (const QHostAddress& host, uint16_t port, const std::optional<uint64_t>& session_id, const std::optional<uint64_t>& request_id, uint64_t response_id, const std::vector<char>& message);
-    std::vector<QNetworkDatagram> encode () const;
+    Message (const QHostAddress& host, uint16_t port, const std::optional<uint64_t>& session_id, const std::optional<uint64_t>& request_id, uint64_t response_id, const SharedPayload& shared_message);
+    std::vector<QNetworkDatagram> encode (size_t max_datagram_size) const;
+    const std::vector<char>& payload () const;
+    void recycle ();
 
     QHostAddress host;
     uint16_t port;
@@ -21,10 +33,17 @@ struct Message {
     std::optional<uint64_t> request_id;
     uint64_t response_id;
     std::vector<char> message;
+    SharedPayload shared_message; // Takes precedence over message when set
+    size_t max_datagram_size = kDefaultMaxDatagramSize;
+    bool discover_path_mtu = false;
+    bool reliable = false;
+    size_t fec_group_size = 0;
 };
 
 struct MessageFragment {
+    // Pooled, see makePooled ()
     static std::shared_ptr<MessageFragment> parse (const QNetworkDatagram& datagram);
+    void recycle ();
 
     QHostAddress host;
     uint16_t port;
@@ -36,17 +55,82 @@ struct MessageFragment {
     uint64_t fragment_number;
 };
 
+// XOR of payloads of group_fragment_count consecutive fragments starting from first_fragment_index
+// (0 for head), shorter payloads are zero-padded; recovers a single lost fragment of the group
+struct ParityFragment {
+    // Pooled, see makePooled ()
+    static std::shared_ptr<ParityFragment> parse (const QNetworkDatagram& datagram);
+    void recycle ();
+
+    QHostAddress host;
+    uint16_t port;
+    std::optional<uint64_t> session_id;
+    std::optional<uint64_t> request_id;
+    uint64_t response_id;
+    uint64_t first_fragment_index;
+    uint64_t group_fragment_count;
+    uint64_t fragment_count;
+    uint64_t length_xor;
+    std::vector<char> parity;
+};
+
 struct MessageFragmentCollector {
 public:
     void insert (const std::shared_ptr<MessageFragment>& fragment);
+    void insertParity (const std::shared_ptr<ParityFragment>& parity_fragment);
     bool complete ();
     bool valid ();
     std::shared_ptr<Message> build ();
+    void recycle ();
 
 private:
-    std::map<uint64_t, std::shared_ptr<MessageFragment>> tail;
+    void insertFragment (const std::shared_ptr<MessageFragment>& fragment);
+    std::shared_ptr<MessageFragment> fragment (uint64_t fragment_index) const;
+    void recover ();
+
+    // Map nodes come from a Pool, so collecting a fragmented message does not allocate once it is warm
+    typedef std::map<uint64_t, std::shared_ptr<MessageFragment>, std::less<uint64_t>, PoolAllocator<std::pair<const uint64_t, std::shared_ptr<MessageFragment>>>> FragmentMap;
+
+    FragmentMap tail;
     uint64_t max_fragment_index = 0;
     std::shared_ptr<MessageFragment> head;
+    std::vector<std::shared_ptr<ParityFragment>> parity;
+};
+
+// Sends messages with sendmmsg (2) without building intermediate datagrams:
+// fragment meta is written into preallocated header slots, ids are encoded once
+// per message and the payload is referenced in place via iovecs.
+// With message.fec_group_size set, every group of that many fragments is followed
+// by a parity control datagram.
+class ScatterGatherEncoder {
+public:
+    ScatterGatherEncoder (size_t slot_count = 256);
+    bool send (qintptr socket_descriptor, const Message& message, size_t max_datagram_size);
+
+private:
+    static constexpr size_t kMaxMetaSize = 5;
+    // Control meta, id presence and group description (fragment indices and lengths fit into 3 bytes each)
+    static constexpr size_t kMaxParityMetaSize = 2 + 4 * 3;
+
+    // Socket send buffer full: wait this long for room before giving up on the rest of a batch
+    static constexpr int kSendBufferWaitMs = 5;
+
+    // IPv4 peers of a dual-stack IPv6 socket are addressed as v4-mapped, v4-mapped peers of an IPv4 socket as plain IPv4
+    bool setAddress (qintptr socket_descriptor, const QHostAddress& host, uint16_t port);
+    void setParitySlot (size_t slot, const Message& message, size_t id_set_len, size_t full_fragment_len,
+                        size_t fragment_count, size_t first_fragment_index, size_t group_fragment_count);
+    bool flush (qintptr socket_descriptor, size_t count);
+
+    const size_t slot_count;
+    std::vector<char> header_ring;
+    std::vector<std::vector<char>> parity_ring;
+    std::vector<struct iovec> iovecs;
+    std::vector<struct mmsghdr> headers;
+    char id_set[kMaxIdSetSize];
+    struct sockaddr_storage address;
+    socklen_t address_len = 0;
+    qintptr family_socket_descriptor = -1;
+    int socket_family = AF_UNSPEC;
 };
 
 } // namespace HCCN::ServerToClient
@@ -0,0 +1,72 @@
+#include "spsc_channel.h"
+
+#include <QDebug>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+
+namespace HCCN {
+
+int64_t monotonicNs ()
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return int64_t (ts.tv_sec)*1000000000 + ts.tv_nsec;
+}
+
+EventNotifier::EventNotifier ()
+    : fd_ (eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC))
+{
+    if (fd_ < 0)
+        qDebug () << "Failed to create eventfd:" << strerror (errno);
+}
+EventNotifier::~EventNotifier ()
+{
+    if (fd_ >= 0)
+        close (fd_);
+}
+int EventNotifier::fd () const
+{
+    return fd_;
+}
+void EventNotifier::notify ()
+{
+    // Counter saturating is impossible in practice, EAGAIN would still leave the consumer woken up
+    uint64_t value = 1;
+    while (write (fd_, &value, sizeof (value)) < 0 && errno == EINTR)
+        ;
+}
+void EventNotifier::clear ()
+{
+    uint64_t value;
+    while (read (fd_, &value, sizeof (value)) < 0 && errno == EINTR)
+        ;
+}
+
+QueueLatency::QueueLatency (const char* hop)
+    : hop (hop)
+{
+    samples.reserve (kReportSamples);
+}
+void QueueLatency::record (int64_t latency_ns)
+{
+    samples.push_back (latency_ns);
+    if (samples.size () < kReportSamples)
+        return;
+
+    std::vector<int64_t>::iterator p50_it = samples.begin () + samples.size ()/2;
+    std::nth_element (samples.begin (), p50_it, samples.end ());
+    int64_t p50_ns = *p50_it;
+    std::vector<int64_t>::iterator p99_it = samples.begin () + samples.size ()*99/100;
+    std::nth_element (p50_it, p99_it, samples.end ());
+    int64_t p99_ns = *p99_it;
+    int64_t max_ns = *std::max_element (p99_it, samples.end ());
+    qDebug () << "metric queue_latency hop=" << hop << "p50_us=" << p50_ns/1000.0 << "p99_us=" << p99_ns/1000.0 << "max_us=" << max_ns/1000.0;
+    samples.clear ();
+}
+
+} // namespace HCCN
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+
+namespace HCCN {
+
+int64_t monotonicNs ();
+
+// Wakes up the consumer of a channel through an eventfd, watched by a QSocketNotifier on the consumer's event loop.
+// Notifications coalesce, so a consumer that was woken up has to drain everything queued
+class EventNotifier
+{
+public:
+    EventNotifier ();
+    ~EventNotifier ();
+    EventNotifier (const EventNotifier&) = delete;
+    EventNotifier& operator= (const EventNotifier&) = delete;
+
+    int fd () const;
+    void notify ();
+    void clear ();
+
+private:
+    int fd_;
+};
+
+// Time items spent queued, logged as a metric line every kReportSamples items
+class QueueLatency
+{
+public:
+    QueueLatency (const char* hop);
+    void record (int64_t latency_ns);
+
+private:
+    static constexpr size_t kReportSamples = 10000;
+
+    const char* hop;
+    std::vector<int64_t> samples;
+};
+
+// Unbounded lock-free queue between exactly one producer and one consumer thread. Items live in fixed size
+// segments, the producer links a new segment once the current one is full and the consumer hands drained
+// segments back, so steady traffic allocates nothing
+template <typename T, size_t kSegmentSize = 256>
+class SpscQueue
+{
+public:
+    SpscQueue ();
+    ~SpscQueue ();
+    SpscQueue (const SpscQueue&) = delete;
+    SpscQueue& operator= (const SpscQueue&) = delete;
+
+    // Producer thread only
+    void push (T item);
+    // Consumer thread only
+    bool pop (T& item);
+
+private:
+    struct Segment {
+        T items[kSegmentSize];
+        std::atomic<size_t> committed {0};
+        std::atomic<Segment*> next {nullptr};
+    };
+
+    alignas (64) Segment* head;
+    size_t head_index = 0;
+    alignas (64) Segment* tail;
+    size_t tail_index = 0;
+    alignas (64) std::atomic<Segment*> spare {nullptr};
+};
+
+// Queue and wakeup of one data path hop. Producer pushes any number of items and then notifies once,
+// consumer clears the notification and pops until empty. Queue latency of every item is recorded
+template <typename T>
+class SpscChannel
+{
+public:
+    SpscChannel (const char* hop);
+    int fd () const;
+
+    // Producer thread only
+    void push (T item);
+    void notify ();
+    // Consumer thread only
+    void clear ();
+    bool pop (T& item);
+
+private:
+    struct Stamped {
+        T item;
+        int64_t queued_ns = 0;
+    };
+
+    SpscQueue<Stamped> queue;
+    EventNotifier event;
+    QueueLatency latency;
+};
+
+} // namespace HCCN
+
+// Implementation
+
+template <typename T, size_t kSegmentSize>
+HCCN::SpscQueue<T, kSegmentSize>::SpscQueue ()
+    : head (new Segment)
+    , tail (head)
+{
+}
+template <typename T, size_t kSegmentSize>
+HCCN::SpscQueue<T, kSegmentSize>::~SpscQueue ()
+{
+    while (head) {
+        Segment* next = head->next.load (std::memory_order_relaxed);
+        delete head;
+        head = next;
+    }
+    delete spare.load (std::memory_order_relaxed);
+}
+template <typename T, size_t kSegmentSize>
+void HCCN::SpscQueue<T, kSegmentSize>::push (T item)
+{
+    if (tail_index == kSegmentSize) {
+        Segment* segment = spare.exchange (nullptr, std::memory_order_acquire);
+        if (segment) {
+            segment->committed.store (0, std::memory_order_relaxed);
+            segment->next.store (nullptr, std::memory_order_relaxed);
+        } else {
+            segment = new Segment;
+        }
+        // Consumer moves on only after draining the full segment, so it sees the reset above
+        tail->next.store (segment, std::memory_order_release);
+        tail = segment;
+        tail_index = 0;
+    }
+    tail->items[tail_index] = std::move (item);
+    tail->committed.store (++tail_index, std::memory_order_release);
+}
+template <typename T, size_t kSegmentSize>
+bool HCCN::SpscQueue<T, kSegmentSize>::pop (T& item)
+{
+    if (head_index == kSegmentSize) {
+        Segment* next = head->next.load (std::memory_order_acquire);
+        if (!next)
+            return false;
+        Segment* drained = head;
+        head = next;
+        head_index = 0;
+        // Only one segment is kept around, a spare the producer did not need yet is freed instead
+        delete spare.exchange (drained, std::memory_order_acq_rel);
+    }
+    if (head_index == head->committed.load (std::memory_order_acquire))
+        return false;
+    item = std::move (head->items[head_index]);
+    // Moved-from items may still hold resources, drop them now rather than on segment reuse
+    head->items[head_index++] = T ();
+    return true;
+}
+
+template <typename T>
+HCCN::SpscChannel<T>::SpscChannel (const char* hop)
+    : latency (hop)
+{
+}
+template <typename T>
+int HCCN::SpscChannel<T>::fd () const
+{
+    return event.fd ();
+}
+template <typename T>
+void HCCN::SpscChannel<T>::push (T item)
+{
+    queue.push ({std::move (item), monotonicNs ()});
+}
+template <typename T>
+void HCCN::SpscChannel<T>::notify ()
+{
+    event.notify ();
+}
+template <typename T>
+void HCCN::SpscChannel<T>::clear ()
+{
+    event.clear ();
+}
+template <typename T>
+bool HCCN::SpscChannel<T>::pop (T& item)
+{
+    Stamped stamped;
+    if (!queue.pop (stamped))
+        return false;
+    latency.record (monotonicNs () - stamped.queued_ns);
+    item = std::move (stamped.item);
+    return true;
+}
@@ -0,0 +1,160 @@
+// Stress test and latency comparison of SpscChannel against the mutex-guarded queue it replaced.
+// Usage: spsc_stress [items]. Build with -fsanitize=thread to check the memory ordering of the queue
+#include "spsc_channel.h"
+
+#include <QCoreApplication>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <poll.h>
+#include <thread>
+#include <time.h>
+
+
+// Producer pushes bursts like a network thread draining a socket, then pauses
+static constexpr size_t kBurstSize = 8;
+static constexpr int64_t kBurstIntervalNs = 50000;
+static constexpr size_t kDefaultItems = 3000000;
+
+
+struct Item {
+    uint64_t sequence = 0;
+    int64_t sent_ns = 0;
+    std::shared_ptr<uint64_t> payload; // Freed on the consumer side like every real data path item
+};
+
+// Queue of the previous data path: every push and pop takes a lock, wakeups through the same eventfd
+class MutexChannel
+{
+public:
+    int fd () const
+    {
+        return event.fd ();
+    }
+    void push (Item item)
+    {
+        std::lock_guard<std::mutex> locker (mutex);
+        items.push_back (std::move (item));
+    }
+    void notify ()
+    {
+        event.notify ();
+    }
+    void clear ()
+    {
+        event.clear ();
+    }
+    bool pop (Item& item)
+    {
+        std::lock_guard<std::mutex> locker (mutex);
+        if (items.empty ())
+            return false;
+        item = std::move (items.front ());
+        items.pop_front ();
+        return true;
+    }
+
+private:
+    std::mutex mutex;
+    std::deque<Item> items;
+    HCCN::EventNotifier event;
+};
+
+static void sleep_until_ns (int64_t deadline_ns)
+{
+    struct timespec ts;
+    ts.tv_sec = deadline_ns/1000000000;
+    ts.tv_nsec = deadline_ns%1000000000;
+    clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr);
+}
+template <typename Channel>
+static void produce (Channel* channel, size_t item_count, bool paced)
+{
+    int64_t next_burst_ns = HCCN::monotonicNs ();
+    for (size_t i = 0; i < item_count; ++i) {
+        channel->push ({i, HCCN::monotonicNs (), std::make_shared<uint64_t> (i)});
+        if ((i + 1)%kBurstSize)
+            continue;
+        channel->notify ();
+        if (paced) {
+            next_burst_ns += kBurstIntervalNs;
+            sleep_until_ns (next_burst_ns);
+        }
+    }
+    channel->notify ();
+}
+// Pops everything in order, returns false on a lost, duplicated or corrupted item
+template <typename Channel>
+static bool consume (Channel& channel, size_t item_count, std::vector<int64_t>& latencies_ns)
+{
+    latencies_ns.clear ();
+    latencies_ns.reserve (item_count);
+    uint64_t expected = 0;
+    while (expected < item_count) {
+        struct pollfd pfd = {channel.fd (), POLLIN, 0};
+        if (poll (&pfd, 1, 1000) == 0) {
+            std::fprintf (stderr, "No wakeup within 1 s, %llu of %zu items received\n", (unsigned long long) expected, item_count);
+            return false;
+        }
+        channel.clear ();
+        Item item;
+        while (channel.pop (item)) {
+            int64_t now_ns = HCCN::monotonicNs ();
+            if (item.sequence != expected || !item.payload || *item.payload != expected) {
+                std::fprintf (stderr, "Expected item %llu, got %llu\n", (unsigned long long) expected, (unsigned long long) item.sequence);
+                return false;
+            }
+            latencies_ns.push_back (now_ns - item.sent_ns);
+            ++expected;
+        }
+    }
+    return true;
+}
+static void report (const char* name, bool paced, int64_t elapsed_ns, std::vector<int64_t>& latencies_ns)
+{
+    std::vector<int64_t>::iterator p50_it = latencies_ns.begin () + latencies_ns.size ()/2;
+    std::nth_element (latencies_ns.begin (), p50_it, latencies_ns.end ());
+    int64_t p50_ns = *p50_it;
+    std::vector<int64_t>::iterator p99_it = latencies_ns.begin () + latencies_ns.size ()*99/100;
+    std::nth_element (p50_it, p99_it, latencies_ns.end ());
+    int64_t p99_ns = *p99_it;
+    int64_t max_ns = *std::max_element (p99_it, latencies_ns.end ());
+    std::printf ("%-6s %-9s items_per_s=%.0f p50_us=%.2f p99_us=%.2f max_us=%.2f\n", name, paced ? "paced" : "saturated",
+                 latencies_ns.size ()*1e9/elapsed_ns, p50_ns/1000.0, p99_ns/1000.0, max_ns/1000.0);
+}
+template <typename Channel>
+static bool run (const char* name, size_t item_count, bool paced)
+{
+    Channel channel;
+    int64_t start_ns = HCCN::monotonicNs ();
+    std::thread producer (produce<Channel>, &channel, item_count, paced);
+    std::vector<int64_t> latencies_ns;
+    bool ok = consume (channel, item_count, latencies_ns);
+    producer.join ();
+    if (ok)
+        report (name, paced, HCCN::monotonicNs () - start_ns, latencies_ns);
+    return ok;
+}
+
+struct SpscStressChannel: HCCN::SpscChannel<Item> {
+    SpscStressChannel ()
+        : HCCN::SpscChannel<Item> ("spsc_stress")
+    {
+    }
+};
+
+int main (int argc, char** argv)
+{
+    QCoreApplication app (argc, argv);
+    size_t item_count = argc > 1 ? std::strtoull (argv[1], nullptr, 10) : kDefaultItems;
+    // Paced runs measure queueing latency, saturated runs stress segment reuse and wakeup coalescing
+    size_t paced_count = std::min<size_t> (item_count, 200000);
+    bool ok = run<SpscStressChannel> ("spsc", item_count, false) &&
+        run<MutexChannel> ("mutex", item_count, false) &&
+        run<SpscStressChannel> ("spsc", paced_count, true) &&
+        run<MutexChannel> ("mutex", paced_count, true);
+    return ok ? 0 : 1;
+}
@@ -19,7 +19,7 @@ struct AttackDescription {
     double trigger_range = 0.0;
     double missile_velocity = 0.0;
     int64_t damage = 0;
-    int64_t duration_ticks = 0;
+    int64_t duration_ms = 0;
     bool friendly_fire = true;
-    int64_t cooldown_ticks = 0;
+    int64_t cooldown_ms = 0;
 };
@@ -5,14 +5,14 @@
 class Corpse
 {
 public:
-    Corpse (const Unit& unit, int64_t decay_remaining_ticks = DECAY_DURATION_TICKS)
+    Corpse (const Unit& unit, int64_t decay_remaining_ticks)
         : unit (unit)
         , decay_remaining_ticks (decay_remaining_ticks)
     {
     }
 
 public:
-    static const int64_t DECAY_DURATION_TICKS = 150;
+    static const int64_t DECAY_DURATION_MS = 3000;
 
     Unit unit;
     int64_t decay_remaining_ticks = 0;
@@ -0,0 +1,130 @@
+#include "match_memory.h"
+
+#include <algorithm>
+#include <new>
+
+
+static constexpr size_t kInitialScratchSize = 16384;
+
+
+MatchMemory::MatchMemory ()
+    : pool (&heap)
+    , scratch_buffer (&heap)
+{
+}
+std::pmr::memory_resource* MatchMemory::resource ()
+{
+    return &pool;
+}
+std::pmr::memory_resource* MatchMemory::scratch ()
+{
+    return &scratch_buffer;
+}
+void MatchMemory::resetScratch ()
+{
+    scratch_buffer.reset ();
+}
+void MatchMemory::release ()
+{
+    pool.release ();
+    scratch_buffer.release ();
+    heap.peak_bytes = heap.bytes;
+    heap.allocations = 0;
+    scratch_buffer.peak_bytes = 0;
+}
+MatchMemory::Stats MatchMemory::stats () const
+{
+    Stats stats;
+    stats.bytes = heap.bytes;
+    stats.peak_bytes = heap.peak_bytes;
+    stats.heap_allocations = heap.allocations;
+    stats.scratch_peak_bytes = scratch_buffer.peak_bytes;
+    return stats;
+}
+
+void* MatchMemory::CountingResource::do_allocate (size_t bytes, size_t alignment)
+{
+    void* p = std::pmr::new_delete_resource ()->allocate (bytes, alignment);
+    this->bytes += bytes;
+    peak_bytes = std::max (peak_bytes, this->bytes);
+    ++allocations;
+    return p;
+}
+void MatchMemory::CountingResource::do_deallocate (void* p, size_t bytes, size_t alignment)
+{
+    std::pmr::new_delete_resource ()->deallocate (p, bytes, alignment);
+    this->bytes -= bytes;
+}
+bool MatchMemory::CountingResource::do_is_equal (const std::pmr::memory_resource& other) const noexcept
+{
+    return this == &other;
+}
+
+MatchMemory::ScratchResource::ScratchResource (std::pmr::memory_resource* upstream)
+    : overflow (upstream)
+{
+}
+MatchMemory::ScratchResource::~ScratchResource ()
+{
+    release ();
+}
+void MatchMemory::ScratchResource::reset ()
+{
+    // Last tick overflowed the block: one block large enough for it replaces the overflow chunks
+    if (!block || overflow.bytes) {
+        size_t required_size = block_size + overflow.bytes;
+        size_t size = std::max (kInitialScratchSize, block_size);
+        while (size < required_size)
+            size *= 2;
+        release ();
+        block = overflow.upstream->allocate (size, alignof (std::max_align_t));
+        block_size = size;
+    }
+    buffer.emplace (block, block_size, &overflow);
+    used_bytes = 0;
+}
+void MatchMemory::ScratchResource::release ()
+{
+    buffer.reset ();
+    if (block)
+        overflow.upstream->deallocate (block, block_size, alignof (std::max_align_t));
+    block = nullptr;
+    block_size = 0;
+    used_bytes = 0;
+    overflow.bytes = 0;
+}
+void* MatchMemory::ScratchResource::do_allocate (size_t bytes, size_t alignment)
+{
+    if (!buffer)
+        reset ();
+    used_bytes += bytes;
+    peak_bytes = std::max (peak_bytes, used_bytes);
+    return buffer->allocate (bytes, alignment);
+}
+void MatchMemory::ScratchResource::do_deallocate (void* /* p */, size_t /* bytes */, size_t /* alignment */)
+{
+    // Freed all at once by reset ()
+}
+bool MatchMemory::ScratchResource::do_is_equal (const std::pmr::memory_resource& other) const noexcept
+{
+    return this == &other;
+}
+
+MatchMemory::ScratchResource::OverflowResource::OverflowResource (std::pmr::memory_resource* upstream)
+    : upstream (upstream)
+{
+}
+void* MatchMemory::ScratchResource::OverflowResource::do_allocate (size_t bytes, size_t alignment)
+{
+    this->bytes += bytes;
+    return upstream->allocate (bytes, alignment);
+}
+void MatchMemory::ScratchResource::OverflowResource::do_deallocate (void* p, size_t bytes, size_t alignment)
+{
+    // Chunks go back when the buffer is rewound, they still count towards the block of the next tick
+    upstream->deallocate (p, bytes, alignment);
+}
+bool MatchMemory::ScratchResource::OverflowResource::do_is_equal (const std::pmr::memory_resource& other) const noexcept
+{
+    return this == &other;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <optional>
+
+
+// Heap of one match. Containers living across ticks allocate from a pool, data that only lives
+// within one tick from a scratch buffer rewound at the start of every tick. Both draw from the
+// heap through a counting resource, so the owner can report what its match holds. Not thread-safe:
+// everything allocated here belongs to the thread ticking the match at the time
+class MatchMemory
+{
+public:
+    // Peaks and counts since the last release ()
+    struct Stats {
+        size_t bytes = 0; // Held from the heap by the pool and the scratch buffer
+        size_t peak_bytes = 0;
+        uint64_t heap_allocations = 0;
+        size_t scratch_peak_bytes = 0; // Most scratch one tick used
+    };
+
+    MatchMemory ();
+    std::pmr::memory_resource* resource ();
+    std::pmr::memory_resource* scratch ();
+    // Whatever the previous tick left in the scratch buffer is dropped
+    void resetScratch ();
+    // Returns all memory to the heap at once, nothing allocated from this memory may be in use anymore
+    void release ();
+    Stats stats () const;
+
+private:
+    class CountingResource: public std::pmr::memory_resource
+    {
+    public:
+        size_t bytes = 0;
+        size_t peak_bytes = 0;
+        uint64_t allocations = 0;
+
+    private:
+        void* do_allocate (size_t bytes, size_t alignment) override;
+        void do_deallocate (void* p, size_t bytes, size_t alignment) override;
+        bool do_is_equal (const std::pmr::memory_resource& other) const noexcept override;
+    };
+    // Monotonic buffer rewound by reset (). Chunks the buffer takes once its block is exhausted are
+    // counted, and the next reset () grows the block by that much, so in steady state a tick's scratch
+    // costs no heap allocation
+    class ScratchResource: public std::pmr::memory_resource
+    {
+    public:
+        ScratchResource (std::pmr::memory_resource* upstream);
+        ~ScratchResource ();
+        void reset ();
+        void release ();
+
+        size_t used_bytes = 0; // Requested since the last reset (), alignment padding not included
+        size_t peak_bytes = 0;
+
+    private:
+        // Upstream of the buffer, sees nothing while a tick fits into the block
+        class OverflowResource: public std::pmr::memory_resource
+        {
+        public:
+            OverflowResource (std::pmr::memory_resource* upstream);
+
+            std::pmr::memory_resource* const upstream;
+            size_t bytes = 0; // Taken since the last reset ()
+
+        private:
+            void* do_allocate (size_t bytes, size_t alignment) override;
+            void do_deallocate (void* p, size_t bytes, size_t alignment) override;
+            bool do_is_equal (const std::pmr::memory_resource& other) const noexcept override;
+        };
+
+        void* do_allocate (size_t bytes, size_t alignment) override;
+        void do_deallocate (void* p, size_t bytes, size_t alignment) override;
+        bool do_is_equal (const std::pmr::memory_resource& other) const noexcept override;
+
+        OverflowResource overflow;
+        void* block = nullptr;
+        size_t block_size = 0;
+        std::optional<std::pmr::monotonic_buffer_resource> buffer;
+    };
+
+    CountingResource heap;
+    std::pmr::unsynchronized_pool_resource pool;
+    ScratchResource scratch_buffer;
+};
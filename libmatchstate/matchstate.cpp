@@ -3,35 +3,91 @@
 #include "positionaverage.h"
 
 
-MatchState::MatchState ()
+static std::pmr::memory_resource* match_resource (MatchMemory* memory)
+{
+    return memory ? memory->resource () : std::pmr::get_default_resource ();
+}
+
+MatchState::MatchState (uint32_t tick_rate, MatchMemory* memory)
+    : tick_rate (tick_rate)
+    , memory (memory)
+    , visibility (area, match_resource (memory))
+    , units (match_resource (memory))
+    , corpses (match_resource (memory))
+    , missiles (match_resource (memory))
+    , explosions (match_resource (memory))
+    , blue_team_user_data {std::pmr::set<uint32_t> (match_resource (memory))}
+    , position_corrections (match_resource (memory))
+    , scheduled_actions (match_resource (memory))
 {
     initNodeTrees ();
 }
 MatchState::~MatchState ()
 {
 }
+void MatchState::copyView (MatchState& view) const
+{
+    view.tick_rate = tick_rate;
+    view.tick_no = tick_no;
+    view.clock_ns = clock_ns;
+    view.area = area;
+    view.fog_of_war = fog_of_war;
+    if (fog_of_war)
+        view.visibility = visibility;
+    view.units = units;
+    view.corpses = corpses;
+    view.missiles = missiles;
+    view.explosions = explosions;
+}
 
 uint64_t MatchState::clockNS () const
 {
     return clock_ns;
 }
+uint32_t MatchState::tickRate () const
+{
+    return tick_rate;
+}
+void MatchState::setTickRate (uint32_t tick_rate)
+{
+    this->tick_rate = tick_rate;
+}
+int64_t MatchState::ticks (int64_t duration_ms, uint32_t tick_rate)
+{
+    // Rounded to the nearest tick, anything that lasts at all lasts at least one tick
+    if (duration_ms <= 0)
+        return 0;
+    return qMax<int64_t> (1, (duration_ms*tick_rate + 500)/1000);
+}
+int64_t MatchState::ticks (int64_t duration_ms) const
+{
+    return ticks (duration_ms, tick_rate);
+}
 const Rectangle& MatchState::areaRef () const
 {
     return area;
 }
-const std::map<uint32_t, Unit>& MatchState::unitsRef () const
+void MatchState::setFogOfWar (bool enabled)
+{
+    fog_of_war = enabled;
+}
+bool MatchState::visibleTo (Unit::Team team, const Position& position) const
+{
+    return !fog_of_war || visibility.visible (team, position);
+}
+const std::pmr::map<uint32_t, Unit>& MatchState::unitsRef () const
 {
     return units;
 }
-const std::map<uint32_t, Corpse>& MatchState::corpsesRef () const
+const std::pmr::map<uint32_t, Corpse>& MatchState::corpsesRef () const
 {
     return corpses;
 }
-const std::map<uint32_t, Missile>& MatchState::missilesRef () const
+const std::pmr::map<uint32_t, Missile>& MatchState::missilesRef () const
 {
     return missiles;
 }
-const std::map<uint32_t, Explosion>& MatchState::explosionsRef () const
+const std::pmr::map<uint32_t, Explosion>& MatchState::explosionsRef () const
 {
     return explosions;
 }
@@ -39,7 +95,7 @@ const std::map<uint32_t, Explosion>& MatchState::explosionsRef () const
 std::optional<Position> MatchState::selectionCenter () const
 {
     PositionAverage average;
-    for (std::map<uint32_t, Unit>::const_iterator it = units.cbegin (); it != units.cend (); ++it) {
+    for (std::pmr::map<uint32_t, Unit>::const_iterator it = units.cbegin (); it != units.cend (); ++it) {
         const Unit& unit = it->second;
         if (unit.selected)
             average.add (unit.position);
@@ -110,6 +166,23 @@ double MatchState::unitMaxVelocity (Unit::Type type)
         return 0.0;
     }
 }
+double MatchState::unitSightRadius (Unit::Type type)
+{
+    switch (type) {
+    case Unit::Type::Seal:
+        return 10.0;
+    case Unit::Type::Crusader:
+        return 10.0;
+    case Unit::Type::Goon:
+        return 12.0;
+    case Unit::Type::Beetle:
+        return 7.0;
+    case Unit::Type::Contaminator:
+        return 11.0;
+    default:
+        return 0.0;
+    }
+}
 double MatchState::unitMaxAngularVelocity (Unit::Type type)
 {
     switch (type) {
@@ -161,17 +234,17 @@ int MatchState::unitMaxHP (Unit::Type type)
         return 0;
     }
 }
-int64_t MatchState::beetleTTLTicks ()
+int64_t MatchState::beetleTTLTicks () const
 {
-    return 700;
+    return ticks (14000);
 }
-int64_t MatchState::pestilenceDiseaseDurationTicks ()
+int64_t MatchState::pestilenceDiseaseDurationTicks () const
 {
-    return 250;
+    return ticks (5000);
 }
-int64_t MatchState::pestilenceDamagePeriodTicks ()
+int64_t MatchState::pestilenceDamagePeriodTicks () const
 {
-    return 20;
+    return ticks (400);
 }
 int64_t MatchState::pestilenceDamagePerPeriod ()
 {
@@ -189,8 +262,8 @@ const AttackDescription& MatchState::unitPrimaryAttackDescription (Unit::Type ty
         ret.range = 5.0;
         ret.trigger_range = 7.0;
         ret.damage = 10;
-        ret.duration_ticks = 10;
-        ret.cooldown_ticks = 40;
+        ret.duration_ms = 200;
+        ret.cooldown_ms = 800;
         ret;
     });
     static const AttackDescription crusader = ({
@@ -199,8 +272,8 @@ const AttackDescription& MatchState::unitPrimaryAttackDescription (Unit::Type ty
         ret.range = 0.1;
         ret.trigger_range = 4.0;
         ret.damage = 16;
-        ret.duration_ticks = 10;
-        ret.cooldown_ticks = 70;
+        ret.duration_ms = 200;
+        ret.cooldown_ms = 1400;
         ret;
     });
     static const AttackDescription goon = ({
@@ -210,8 +283,8 @@ const AttackDescription& MatchState::unitPrimaryAttackDescription (Unit::Type ty
         ret.trigger_range = 9.0;
         ret.damage = 12;
         ret.missile_velocity = 16.0;
-        ret.duration_ticks = 10;
-        ret.cooldown_ticks = 80;
+        ret.duration_ms = 200;
+        ret.cooldown_ms = 1600;
         ret;
     });
     static const AttackDescription beetle = ({
@@ -220,8 +293,8 @@ const AttackDescription& MatchState::unitPrimaryAttackDescription (Unit::Type ty
         ret.range = 0.1;
         ret.trigger_range = 3.0;
         ret.damage = 8;
-        ret.duration_ticks = 10;
-        ret.cooldown_ticks = 60;
+        ret.duration_ms = 200;
+        ret.cooldown_ms = 1200;
         ret;
     });
     static const AttackDescription unkown = {};
@@ -246,7 +319,7 @@ const AttackDescription& MatchState::effectAttackDescription (AttackDescription:
         ret.type = type;
         ret.range = 1.4;
         ret.damage = 8;
-        ret.duration_ticks = 20;
+        ret.duration_ms = 400;
         ret;
     });
     static const AttackDescription pestilence_missile = ({
@@ -255,8 +328,8 @@ const AttackDescription& MatchState::effectAttackDescription (AttackDescription:
         ret.range = 7.0;
         ret.damage = 0;
         ret.missile_velocity = 16.0;
-        ret.duration_ticks = 10;
-        ret.cooldown_ticks = 40;
+        ret.duration_ms = 200;
+        ret.cooldown_ms = 800;
         ret;
     });
     static const AttackDescription pestilence_splash = ({
@@ -264,7 +337,7 @@ const AttackDescription& MatchState::effectAttackDescription (AttackDescription:
         ret.type = type;
         ret.range = 1.8;
         ret.damage = 6;
-        ret.duration_ticks = 20;
+        ret.duration_ms = 400;
         ret.friendly_fire = false;
         ret;
     });
@@ -272,8 +345,8 @@ const AttackDescription& MatchState::effectAttackDescription (AttackDescription:
         AttackDescription ret;
         ret.type = type;
         ret.range = 4;
-        ret.duration_ticks = 20;
-        ret.cooldown_ticks = 20;
+        ret.duration_ms = 400;
+        ret.cooldown_ms = 400;
         ret;
     });
     static const AttackDescription unkown = {};
@@ -312,7 +385,7 @@ std::vector<std::pair<uint32_t, const Unit*>> MatchState::buildOrderedSelection
 
     // TODO: Use radix algorithm
     for (const Unit::Type unit_type: unit_order)
-        for (std::map<uint32_t, Unit>::const_iterator it = units.cbegin (); it != units.cend (); ++it) {
+        for (std::pmr::map<uint32_t, Unit>::const_iterator it = units.cbegin (); it != units.cend (); ++it) {
             const Unit& unit = it->second;
             if (unit.selected && unit.type == unit_type)
                 selection.push_back ({it->first, &unit});
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <map>
+#include <memory>
+#include <memory_resource>
 #include <set>
 #include <vector>
 #include <QObject>
@@ -16,6 +18,8 @@
 #include "position.h"
 #include "offset.h"
 #include "rectangle.h"
+#include "visibility_grid.h"
+#include "match_memory.h"
 
 
 enum class SoundEvent {
@@ -58,31 +62,45 @@ public:
     static double explosionDiameter (Explosion::Type type);
     static double unitMaxVelocity (Unit::Type type);
     static double unitMaxAngularVelocity (Unit::Type type);
+    static double unitSightRadius (Unit::Type type);
     static int unitHitBarCount (Unit::Type type);
     static int unitMaxHP (Unit::Type type);
-    static int64_t beetleTTLTicks ();
-    static int64_t pestilenceDiseaseDurationTicks ();
-    static int64_t pestilenceDamagePeriodTicks ();
+    int64_t beetleTTLTicks () const;
+    int64_t pestilenceDiseaseDurationTicks () const;
+    int64_t pestilenceDamagePeriodTicks () const;
     static int64_t pestilenceDamagePerPeriod ();
     static double pestilenceDiseaseSlowdownFactor ();
     static const AttackDescription& unitPrimaryAttackDescription (Unit::Type type);
     static const AttackDescription& effectAttackDescription (AttackDescription::Type type);
+    // Durations are given in real time and counted down in ticks of the match
+    static int64_t ticks (int64_t duration_ms, uint32_t tick_rate);
+    int64_t ticks (int64_t duration_ms) const;
 
 private:
     struct RedTeamUserData {
     };
     struct BlueTeamUserData {
-        std::set<uint32_t> old_missiles;
+        std::pmr::set<uint32_t> old_missiles;
+    };
+    struct PositionCorrection {
+        Offset step;
+        uint32_t remaining_ticks;
     };
 
 // Update on client: input from server
 public:
     void loadState (const std::vector<std::pair<uint32_t, Unit>>& units, const std::vector<std::pair<uint32_t, Corpse>>& corpses, const std::vector<std::pair<uint32_t, Missile>>& missiles);
+    // Entities with ids in [first_id, last_id] missing from the lists are removed, others are kept
+    void loadStateRange (uint32_t first_id, uint32_t last_id,
+                         const std::vector<std::pair<uint32_t, Unit>>& units, const std::vector<std::pair<uint32_t, Corpse>>& corpses, const std::vector<std::pair<uint32_t, Missile>>& missiles);
+    // Snapshots arriving every ticks ticks: small position divergence is spread over the gap instead of snapping
+    void setCorrectionTicks (uint32_t ticks);
 
 private:
-    void loadUnits (const std::vector<std::pair<uint32_t, Unit>>& units);
-    void loadCorpses (const std::vector<std::pair<uint32_t, Corpse>>& corpses);
-    void loadMissiles (const std::vector<std::pair<uint32_t, Missile>>& missiles);
+    void applyPositionCorrections ();
+    void loadUnits (const std::vector<std::pair<uint32_t, Unit>>& units, uint32_t first_id, uint32_t last_id);
+    void loadCorpses (const std::vector<std::pair<uint32_t, Corpse>>& corpses, uint32_t first_id, uint32_t last_id);
+    void loadMissiles (const std::vector<std::pair<uint32_t, Missile>>& missiles, uint32_t first_id, uint32_t last_id);
     Unit& addUnit (uint32_t id, Unit::Type type, Unit::Team team, const Position& position, double direction);
     Corpse& addCorpse (uint32_t id, Unit::Type type, Unit::Team team, const Position& position, double direction, int64_t decay_remaining_ticks);
     Missile& addMissile (uint32_t id, Missile::Type type, Unit::Team team, const Position& position, double direction);
@@ -119,10 +137,28 @@ private:
 
 // Update on server: input from client
 public:
-    std::map<uint32_t, Unit>::iterator createUnit (Unit::Type type, Unit::Team team, const Position& position, double direction);
+    std::pmr::map<uint32_t, Unit>::iterator createUnit (Unit::Type type, Unit::Team team, const Position& position, double direction);
     void setUnitAction (uint32_t unit_id, const UnitActionVariant& action);
+    // Orders of different sources are unrelated: request ids for plain requests, command sequences for bundles
+    enum class CommandSource {
+        Request,
+        Bundle,
+    };
+    // Applied at the start of the tick, or of the next one if it already passed, in unit id order.
+    // Action for a unit that is missing or not of team is dropped, so only the owner schedules for a unit;
+    // of several actions for one unit and tick the one with the highest order wins within a source,
+    // the one scheduled last across sources. Units gone by then are skipped
+    void scheduleUnitAction (uint32_t tick, CommandSource source, uint64_t order, Unit::Team team, uint32_t unit_id, const UnitActionVariant& action);
 
 private:
+    struct ScheduledAction {
+        CommandSource source;
+        uint64_t order;
+        Unit::Team team;
+        UnitActionVariant action;
+    };
+    void assignUnitAction (Unit& unit, const UnitActionVariant& action);
+    void applyScheduledActions ();
     uint32_t getRandomNumber ();
 
 // Update on both: at timer
@@ -154,17 +190,35 @@ private:
     void redTeamUserTick (RedTeamUserData& user_data);
     void blueTeamUserTick (BlueTeamUserData& user_data);
     double unitVelocity (const Unit& unit) const;
+    // Valid until the next tick starts
+    std::pmr::memory_resource* scratch () const;
 
 public:
-    MatchState ();
+    static constexpr uint32_t kDefaultTickRate = 50;
+
+    // Containers live in memory when given, its scratch is rewound at the start of every tick;
+    // memory has to outlive the state. Without memory everything comes from the default resource
+    MatchState (uint32_t tick_rate = kDefaultTickRate, MatchMemory* memory = nullptr);
     ~MatchState ();
+    // Copies what snapshots are built from into view, which stays readable on another thread while this state
+    // keeps ticking. Copying over the previous tick's view reuses its nodes and capacity, so a steady match
+    // copies without allocating; view needs a memory of its own since it is touched by the reading thread
+    void copyView (MatchState& view) const;
     uint64_t clockNS () const;
+    uint32_t tickRate () const;
+    // Client learns the room rate only when the match starts
+    void setTickRate (uint32_t tick_rate);
     uint32_t getTickNo () const;
     const Rectangle& areaRef () const;
-    const std::map<uint32_t, Unit>& unitsRef () const;
-    const std::map<uint32_t, Corpse>& corpsesRef () const;
-    const std::map<uint32_t, Missile>& missilesRef () const;
-    const std::map<uint32_t, Explosion>& explosionsRef () const;
+    // Off by default: only the server filters snapshots by what each team sees, the client
+    // would update the visibility grid every tick without drawing anything from it
+    void setFogOfWar (bool enabled);
+    // Everything is visible while fog of war is off
+    bool visibleTo (Unit::Team team, const Position& position) const;
+    const std::pmr::map<uint32_t, Unit>& unitsRef () const;
+    const std::pmr::map<uint32_t, Corpse>& corpsesRef () const;
+    const std::pmr::map<uint32_t, Missile>& missilesRef () const;
+    const std::pmr::map<uint32_t, Explosion>& explosionsRef () const;
     std::optional<Position> selectionCenter () const;
     bool fuzzyMatchPoints (const Position& p1, const Position& p2) const; // TODO: Points -> Positions
     std::vector<std::pair<uint32_t, const Unit*>> buildOrderedSelection () const;
@@ -172,19 +226,27 @@ public:
 signals:
     void soundEventEmitted (SoundEvent event);
     void unitActionRequested (uint32_t id, const UnitActionVariant& action);
+    void groupActionRequested (const std::vector<uint32_t>& unit_ids, const UnitActionVariant& action);
     void unitCreateRequested (Unit::Team team, Unit::Type type, const Position& position);
 
 private:
+    uint32_t tick_rate;
+    MatchMemory* const memory;
     uint32_t tick_no = 0;
     uint64_t clock_ns = 0;
     Rectangle area = Rectangle (-64, 64, -48, 48);
-    std::map<uint32_t, Unit> units;
-    std::map<uint32_t, Corpse> corpses;
-    std::map<uint32_t, Missile> missiles;
-    std::map<uint32_t, Explosion> explosions;
+    bool fog_of_war = false;
+    VisibilityGrid visibility;
+    std::pmr::map<uint32_t, Unit> units;
+    std::pmr::map<uint32_t, Corpse> corpses;
+    std::pmr::map<uint32_t, Missile> missiles;
+    std::pmr::map<uint32_t, Explosion> explosions;
     RedTeamUserData red_team_user_data;
     BlueTeamUserData blue_team_user_data;
     Node blue_team_node_tree;
     uint32_t next_id = 0;
     std::mt19937 random_generator;
+    uint32_t correction_ticks = 1;
+    std::pmr::map<uint32_t, PositionCorrection> position_corrections;
+    std::pmr::map<std::pair<uint32_t, uint32_t>, ScheduledAction> scheduled_actions; // By tick and unit id
 };
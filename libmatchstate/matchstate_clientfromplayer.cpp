@@ -38,7 +38,7 @@ static bool intersectRectangleCircle (const Rectangle& rect, const Position& cen
 
 std::optional<std::pair<uint32_t, const Unit&>> MatchState::unitUnderCursor (const Position& point) const
 {
-    for (std::map<uint32_t, Unit>::const_iterator it = units.begin (); it != units.end (); ++it) {
+    for (std::pmr::map<uint32_t, Unit>::const_iterator it = units.begin (); it != units.end (); ++it) {
         const Unit& unit = it->second;
         if (checkUnitInsideSelection (unit, point))
             return std::pair<uint32_t, const Unit&> (it->first, unit);
@@ -48,13 +48,13 @@ std::optional<std::pair<uint32_t, const Unit&>> MatchState::unitUnderCursor (con
 void MatchState::trySelect (Unit::Team team, const Position& point, bool add)
 {
     if (add) {
-        for (std::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
+        for (std::pmr::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
             Unit& unit = it->second;
             if (unit.team == team && checkUnitInsideSelection (unit, point))
                 unit.selected = !unit.selected;
         }
     } else {
-        for (std::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
+        for (std::pmr::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
             Unit& unit = it->second;
             if (unit.team == team && checkUnitInsideSelection (unit, point)) {
                 clearSelection ();
@@ -67,14 +67,14 @@ void MatchState::trySelect (Unit::Team team, const Position& point, bool add)
 void MatchState::trySelect (Unit::Team team, const Rectangle& rect, bool add)
 {
     if (add) {
-        for (std::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
+        for (std::pmr::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
             Unit& unit = it->second;
             if (unit.team == team && checkUnitInsideSelection (unit, rect))
                 unit.selected = true;
         }
     } else {
         bool selection_found = false;
-        for (std::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
+        for (std::pmr::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
             Unit& unit = it->second;
             if (unit.team == team && checkUnitInsideSelection (unit, rect)) {
                 selection_found = true;
@@ -83,7 +83,7 @@ void MatchState::trySelect (Unit::Team team, const Rectangle& rect, bool add)
         }
         if (selection_found) {
             clearSelection ();
-            for (std::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
+            for (std::pmr::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
                 Unit& unit = it->second;
                 if (unit.team == team && checkUnitInsideSelection (unit, rect))
                     unit.selected = true;
@@ -99,7 +99,7 @@ void MatchState::trySelectByType (Unit::Team team, const Position& point, const
     Unit::Type type = unit->type;
     if (!add)
         clearSelection ();
-    for (std::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
+    for (std::pmr::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
         Unit& unit = it->second;
         if (unit.team == team && unit.type == type && checkUnitInsideViewport (unit, viewport))
             unit.selected = true;
@@ -107,7 +107,7 @@ void MatchState::trySelectByType (Unit::Team team, const Position& point, const
 }
 void MatchState::selectAll (Unit::Team team)
 {
-    for (std::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
+    for (std::pmr::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
         Unit& unit = it->second;
         if (unit.team == team)
             unit.selected = true;
@@ -117,7 +117,7 @@ void MatchState::select (uint32_t unit_id, bool add)
 {
     if (!add)
         clearSelection ();
-    std::map<uint32_t, Unit>::iterator it = units.find (unit_id);
+    std::pmr::map<uint32_t, Unit>::iterator it = units.find (unit_id);
     if (it != units.end ()) {
         Unit& unit = it->second;
         unit.selected = true;
@@ -125,7 +125,7 @@ void MatchState::select (uint32_t unit_id, bool add)
 }
 void MatchState::deselect (uint32_t unit_id)
 {
-    std::map<uint32_t, Unit>::iterator it = units.find (unit_id);
+    std::pmr::map<uint32_t, Unit>::iterator it = units.find (unit_id);
     if (it != units.end ()) {
         Unit& unit = it->second;
         unit.selected = false;
@@ -134,13 +134,13 @@ void MatchState::deselect (uint32_t unit_id)
 void MatchState::trimSelection (Unit::Type type, bool remove)
 {
     if (remove) {
-        for (std::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
+        for (std::pmr::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
             Unit& unit = it->second;
             if (unit.type == type)
                 unit.selected = false;
         }
     } else {
-        for (std::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
+        for (std::pmr::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
             Unit& unit = it->second;
             if (unit.type != type)
                 unit.selected = false;
@@ -150,7 +150,7 @@ void MatchState::trimSelection (Unit::Type type, bool remove)
 void MatchState::attackEnemy (Unit::Team attacker_team, const Position& point)
 {
     std::optional<uint32_t> target;
-    for (std::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
+    for (std::pmr::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
         Unit& unit = it->second;
         if (unit.team != attacker_team && checkUnitInsideSelection (unit, point)) {
             target = it->first;
@@ -166,7 +166,7 @@ void MatchState::cast (CastAction::Type cast_type, Unit::Team /* attacker_team *
 void MatchState::move (const Position& point)
 {
     std::optional<uint32_t> target;
-    for (std::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
+    for (std::pmr::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
         Unit& unit = it->second;
         if (checkUnitInsideSelection (unit, point)) {
             target = it->first;
@@ -177,19 +177,22 @@ void MatchState::move (const Position& point)
 }
 void MatchState::stop ()
 {
-    for (std::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
+    std::vector<uint32_t> unit_ids;
+    for (std::pmr::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
         Unit& unit = it->second;
         if (unit.selected) {
             unit.action = StopAction ();
-            emit unitActionRequested (it->first, StopAction ());
+            unit_ids.push_back (it->first);
         }
     }
+    if (!unit_ids.empty ())
+        emit groupActionRequested (unit_ids, StopAction ());
 }
 void MatchState::autoAction (Unit::Team attacker_team, const Position& point)
 {
     std::optional<uint32_t> target;
     bool target_is_enemy = false;
-    for (std::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
+    for (std::pmr::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
         Unit& unit = it->second;
         if (checkUnitInsideSelection (unit, point)) {
             target = it->first;
@@ -212,7 +215,7 @@ void MatchState::autoAction (Unit::Team attacker_team, const Position& point)
 void MatchState::selectGroup (uint64_t group)
 {
     uint64_t group_flag = 1 << group;
-    for (std::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
+    for (std::pmr::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
         Unit& unit = it->second;
         unit.selected = (unit.groups & group_flag) ? true : false;
     }
@@ -220,7 +223,7 @@ void MatchState::selectGroup (uint64_t group)
 void MatchState::bindSelectionToGroup (uint64_t group)
 {
     uint64_t group_flag = 1 << group;
-    for (std::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
+    for (std::pmr::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
         Unit& unit = it->second;
         if (unit.selected)
             unit.groups |= group_flag;
@@ -231,7 +234,7 @@ void MatchState::bindSelectionToGroup (uint64_t group)
 void MatchState::addSelectionToGroup (uint64_t group)
 {
     uint64_t group_flag = 1 << group;
-    for (std::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
+    for (std::pmr::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
         Unit& unit = it->second;
         if (unit.selected)
             unit.groups |= group_flag;
@@ -240,7 +243,7 @@ void MatchState::addSelectionToGroup (uint64_t group)
 void MatchState::moveSelectionToGroup (uint64_t group, bool add)
 {
     uint64_t group_flag = 1 << group;
-    for (std::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
+    for (std::pmr::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
         Unit& unit = it->second;
         if (unit.selected)
             unit.groups = group_flag;
@@ -251,7 +254,7 @@ void MatchState::moveSelectionToGroup (uint64_t group, bool add)
 
 void MatchState::clearSelection ()
 {
-    for (std::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it)
+    for (std::pmr::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it)
         it->second.selected = false;
 }
 bool MatchState::checkUnitInsideSelection (const Unit& unit, const Position& point) const
@@ -278,7 +281,7 @@ bool MatchState::checkUnitInsideViewport (const Unit& unit, const Rectangle& vie
 }
 Unit* MatchState::findUnitAt (Unit::Team team, const Position& point)
 {
-    for (std::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
+    for (std::pmr::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
         Unit& unit = it->second;
         if (unit.team == team && checkUnitInsideSelection (unit, point))
             return &unit;
@@ -288,7 +291,8 @@ Unit* MatchState::findUnitAt (Unit::Team team, const Position& point)
 void MatchState::startAction (const MoveAction& action)
 {
     // TODO: Check for team
-    for (std::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
+    std::vector<uint32_t> unit_ids;
+    for (std::pmr::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
         uint32_t unit_id = it->first;
         Unit& unit = it->second;
         if (unit.selected &&
@@ -299,14 +303,17 @@ void MatchState::startAction (const MoveAction& action)
                 std::get<PerformingCastAction> (unit.action).next_action = action;
             else
                 unit.action = action;
-            emit unitActionRequested (it->first, action);
+            unit_ids.push_back (unit_id);
         }
     }
+    if (!unit_ids.empty ())
+        emit groupActionRequested (unit_ids, action);
 }
 void MatchState::startAction (const AttackAction& action)
 {
     // TODO: Check for team
-    for (std::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
+    std::vector<uint32_t> unit_ids;
+    for (std::pmr::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
         Unit& unit = it->second;
         if (unit.selected) {
             if (std::holds_alternative<PerformingAttackAction> (unit.action))
@@ -315,9 +322,11 @@ void MatchState::startAction (const AttackAction& action)
                 std::get<PerformingCastAction> (unit.action).next_action = action;
             else
                 unit.action = action;
-            emit unitActionRequested (it->first, action);
+            unit_ids.push_back (it->first);
         }
     }
+    if (!unit_ids.empty ())
+        emit groupActionRequested (unit_ids, action);
 }
 void MatchState::startAction (const CastAction& action)
 {
@@ -326,7 +335,7 @@ void MatchState::startAction (const CastAction& action)
     uint32_t closest_unit_id = 0;
     double closest_distance = DBL_MAX;
     bool closest_busy = true;
-    for (std::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
+    for (std::pmr::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
         Unit& unit = it->second;
         if (unit.selected && unit.type == Unit::Type::Contaminator) {
             bool busy =
@@ -1,19 +1,48 @@
 #include "matchstate.h"
 
 
+// Longer corrections are teleports, e.g. after a unit left the area of interest
+static constexpr double kMaxSmoothedCorrection = 4.0;
+static constexpr int64_t kMaxCorrectionMs = 500;
+
+
 void MatchState::loadState (const std::vector<std::pair<uint32_t, Unit>>& units, const std::vector<std::pair<uint32_t, Corpse>>& corpses, const std::vector<std::pair<uint32_t, Missile>>& missiles)
 {
-    loadUnits (units);
-    loadCorpses (corpses);
-    loadMissiles (missiles);
+    loadStateRange (0, UINT32_MAX, units, corpses, missiles);
+}
+void MatchState::loadStateRange (uint32_t first_id, uint32_t last_id,
+                                 const std::vector<std::pair<uint32_t, Unit>>& units, const std::vector<std::pair<uint32_t, Corpse>>& corpses, const std::vector<std::pair<uint32_t, Missile>>& missiles)
+{
+    loadUnits (units, first_id, last_id);
+    loadCorpses (corpses, first_id, last_id);
+    loadMissiles (missiles, first_id, last_id);
+}
+void MatchState::setCorrectionTicks (uint32_t ticks)
+{
+    correction_ticks = qBound<uint32_t> (1, ticks, MatchState::ticks (kMaxCorrectionMs, tick_rate));
+}
+void MatchState::applyPositionCorrections ()
+{
+    for (std::pmr::map<uint32_t, PositionCorrection>::iterator it = position_corrections.begin (); it != position_corrections.end ();) {
+        std::pmr::map<uint32_t, Unit>::iterator unit_it = units.find (it->first);
+        if (unit_it == units.end ()) {
+            it = position_corrections.erase (it);
+            continue;
+        }
+        unit_it->second.position += it->second.step;
+        if (--it->second.remaining_ticks)
+            ++it;
+        else
+            it = position_corrections.erase (it);
+    }
 }
 
-void MatchState::loadUnits (const std::vector<std::pair<uint32_t, Unit>>& new_units)
+void MatchState::loadUnits (const std::vector<std::pair<uint32_t, Unit>>& new_units, uint32_t first_id, uint32_t last_id)
 {
     std::set<uint32_t> to_keep;
     for (const std::pair<uint32_t, Unit>& new_unit_entry: new_units)
         to_keep.insert (new_unit_entry.first);
-    for (std::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end ();) {
+    for (std::pmr::map<uint32_t, Unit>::iterator it = units.lower_bound (first_id); it != units.end () && it->first <= last_id;) {
         if (to_keep.find (it->first) == to_keep.end ())
             it = units.erase (it);
         else
@@ -22,10 +51,16 @@ void MatchState::loadUnits (const std::vector<std::pair<uint32_t, Unit>>& new_un
     for (const std::pair<uint32_t, Unit>& new_unit_entry: new_units) {
         uint32_t new_unit_id = new_unit_entry.first;
         const Unit& new_unit = new_unit_entry.second;
-        std::map<uint32_t, Unit>::iterator to_change = units.find (new_unit_id);
+        std::pmr::map<uint32_t, Unit>::iterator to_change = units.find (new_unit_id);
         if (to_change != units.end ()) {
             Unit& unit_to_change = to_change->second;
-            unit_to_change.position = new_unit.position;
+            Offset correction = new_unit.position - unit_to_change.position;
+            if (correction_ticks > 1 && correction.length () < kMaxSmoothedCorrection) {
+                position_corrections[new_unit_id] = {correction*(1.0/correction_ticks), correction_ticks};
+            } else {
+                unit_to_change.position = new_unit.position;
+                position_corrections.erase (new_unit_id);
+            }
             unit_to_change.orientation = new_unit.orientation;
             unit_to_change.hp = new_unit.hp;
             unit_to_change.action = new_unit.action;
@@ -37,12 +72,12 @@ void MatchState::loadUnits (const std::vector<std::pair<uint32_t, Unit>>& new_un
         }
     }
 }
-void MatchState::loadCorpses (const std::vector<std::pair<uint32_t, Corpse>>& new_corpses)
+void MatchState::loadCorpses (const std::vector<std::pair<uint32_t, Corpse>>& new_corpses, uint32_t first_id, uint32_t last_id)
 {
     std::set<uint32_t> to_keep;
     for (const std::pair<uint32_t, Corpse>& new_corpse_entry: new_corpses)
         to_keep.insert (new_corpse_entry.first);
-    for (std::map<uint32_t, Corpse>::iterator it = corpses.begin (); it != corpses.end ();) {
+    for (std::pmr::map<uint32_t, Corpse>::iterator it = corpses.lower_bound (first_id); it != corpses.end () && it->first <= last_id;) {
         if (to_keep.find (it->first) == to_keep.end ())
             it = corpses.erase (it);
         else
@@ -51,7 +86,7 @@ void MatchState::loadCorpses (const std::vector<std::pair<uint32_t, Corpse>>& ne
     for (const std::pair<uint32_t, Corpse>& new_corpse_entry: new_corpses) {
         uint32_t new_corpse_id = new_corpse_entry.first;
         const Corpse& new_corpse = new_corpse_entry.second;
-        std::map<uint32_t, Corpse>::iterator to_change = corpses.find (new_corpse_id);
+        std::pmr::map<uint32_t, Corpse>::iterator to_change = corpses.find (new_corpse_id);
         if (to_change != corpses.end ()) {
             Corpse& corpse_to_change = to_change->second;
             corpse_to_change.unit.position = new_corpse.unit.position;
@@ -66,14 +101,14 @@ void MatchState::loadCorpses (const std::vector<std::pair<uint32_t, Corpse>>& ne
         }
     }
 }
-void MatchState::loadMissiles (const std::vector<std::pair<uint32_t, Missile>>& new_missiles)
+void MatchState::loadMissiles (const std::vector<std::pair<uint32_t, Missile>>& new_missiles, uint32_t first_id, uint32_t last_id)
 {
     std::set<uint32_t> m_to_keep;
     for (uint32_t i = 0; i < new_missiles.size (); i++) {
         m_to_keep.insert (new_missiles.at (i).first);
     }
-    auto m_it = missiles.begin ();
-    while (m_it != missiles.end ()) {
+    auto m_it = missiles.lower_bound (first_id);
+    while (m_it != missiles.end () && m_it->first <= last_id) {
         if (m_to_keep.find (m_it->first) == m_to_keep.end ())
             m_it = missiles.erase (m_it);
         else
@@ -91,7 +126,7 @@ void MatchState::loadMissiles (const std::vector<std::pair<uint32_t, Missile>>&
             }
 
         } else {
-            std::map<uint32_t, Missile>::iterator to_change = missiles.find (new_missiles.at (i).first);
+            std::pmr::map<uint32_t, Missile>::iterator to_change = missiles.find (new_missiles.at (i).first);
             Missile& missile_to_change = to_change->second;
             missile_to_change.position = new_missiles.at (i).second.position;
             missile_to_change.orientation = new_missiles.at (i).second.orientation;
@@ -106,21 +141,21 @@ void MatchState::loadMissiles (const std::vector<std::pair<uint32_t, Missile>>&
 }
 Unit& MatchState::addUnit (uint32_t id, Unit::Type type, Unit::Team team, const Position& position, double direction)
 {
-    std::pair<std::map<uint32_t, Unit>::iterator, bool> it_status = units.insert ({id, {type, uint32_t (random_generator ()), team, position, direction}});
+    std::pair<std::pmr::map<uint32_t, Unit>::iterator, bool> it_status = units.insert ({id, {type, uint32_t (random_generator ()), team, position, direction}});
     Unit& unit = it_status.first->second;
     unit.hp = unitMaxHP (unit.type);
     return unit;
 }
 Corpse& MatchState::addCorpse (uint32_t id, Unit::Type type, Unit::Team team, const Position& position, double direction, int64_t decay_remaining_ticks)
 {
-    std::pair<std::map<uint32_t, Corpse>::iterator, bool> it_status = corpses.insert ({id, {{type, uint32_t (random_generator ()), team, position, direction}, decay_remaining_ticks}});
+    std::pair<std::pmr::map<uint32_t, Corpse>::iterator, bool> it_status = corpses.insert ({id, {{type, uint32_t (random_generator ()), team, position, direction}, decay_remaining_ticks}});
     Corpse& corpse = it_status.first->second;
     corpse.unit.hp = unitMaxHP (corpse.unit.type);
     return corpse;
 }
 Missile& MatchState::addMissile (uint32_t id, Missile::Type type, Unit::Team team, const Position& position, double /* direction */)
 {
-    std::pair<std::map<uint32_t, Missile>::iterator, bool> it_status = missiles.insert ({id, {type, team, position, 0, Position (0, 0)}});
+    std::pair<std::pmr::map<uint32_t, Missile>::iterator, bool> it_status = missiles.insert ({id, {type, team, position, 0, Position (0, 0)}});
     Missile& missile = it_status.first->second;
     return missile;
 }
@@ -1,23 +1,49 @@
 #include "matchstate.h"
 
 
-std::map<uint32_t, Unit>::iterator MatchState::createUnit (Unit::Type type, Unit::Team team, const Position& position, double direction)
+std::pmr::map<uint32_t, Unit>::iterator MatchState::createUnit (Unit::Type type, Unit::Team team, const Position& position, double direction)
 {
     uint32_t id = getRandomNumber (); // TODO: Fix it
 
-    std::pair<std::map<uint32_t, Unit>::iterator, bool> it_status = units.insert ({next_id++, {type, id, team, position, direction}});
+    std::pair<std::pmr::map<uint32_t, Unit>::iterator, bool> it_status = units.insert ({next_id++, {type, id, team, position, direction}});
     Unit& unit = it_status.first->second;
     unit.hp = unitMaxHP (unit.type);
     if (type == Unit::Type::Beetle)
-        unit.ttl_ticks = MatchState::beetleTTLTicks ();
+        unit.ttl_ticks = beetleTTLTicks ();
     return it_status.first;
 }
 void MatchState::setUnitAction (uint32_t unit_id, const UnitActionVariant& action)
 {
-    std::map<uint32_t, Unit>::iterator it = units.find (unit_id);
+    std::pmr::map<uint32_t, Unit>::iterator it = units.find (unit_id);
     if (it == units.end ())
         return;
-    Unit& unit = it->second;
+    assignUnitAction (it->second, action);
+}
+void MatchState::scheduleUnitAction (uint32_t tick, CommandSource source, uint64_t order, Unit::Team team, uint32_t unit_id, const UnitActionVariant& action)
+{
+    std::pmr::map<uint32_t, Unit>::const_iterator unit_it = units.find (unit_id);
+    if (unit_it == units.cend () || unit_it->second.team != team)
+        return;
+    std::pair<std::pmr::map<std::pair<uint32_t, uint32_t>, ScheduledAction>::iterator, bool> it_status =
+        scheduled_actions.insert ({{tick, unit_id}, {source, order, team, action}});
+    if (it_status.second)
+        return;
+    ScheduledAction& scheduled = it_status.first->second;
+    if (scheduled.source != source || scheduled.order <= order)
+        scheduled = {source, order, team, action};
+}
+void MatchState::applyScheduledActions ()
+{
+    std::pmr::map<std::pair<uint32_t, uint32_t>, ScheduledAction>::iterator it = scheduled_actions.begin ();
+    for (; it != scheduled_actions.end () && it->first.first <= tick_no; ++it) {
+        std::pmr::map<uint32_t, Unit>::iterator unit_it = units.find (it->first.second);
+        if (unit_it != units.end () && unit_it->second.team == it->second.team)
+            assignUnitAction (unit_it->second, it->second.action);
+    }
+    scheduled_actions.erase (scheduled_actions.begin (), it);
+}
+void MatchState::assignUnitAction (Unit& unit, const UnitActionVariant& action)
+{
     IntentiveActionVariant* next_action;
     if (std::holds_alternative<PerformingAttackAction> (unit.action))
         next_action = &std::get<PerformingAttackAction> (unit.action).next_action;
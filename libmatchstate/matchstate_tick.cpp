@@ -32,12 +32,15 @@ static std::vector<std::string> split (const std::string& s, char seperator)
 
 void MatchState::tick ()
 {
+    if (memory)
+        memory->resetScratch ();
     tick_no += 1;
+    applyScheduledActions ();
     redTeamUserTick (red_team_user_data);
     blueTeamUserTick (blue_team_user_data);
 
-    constexpr uint64_t dt_nsec = 20'000'000;
-    constexpr double dt = 0.020;
+    uint64_t dt_nsec = 1'000'000'000/tick_rate;
+    double dt = 1.0/tick_rate;
 
     clock_ns += dt_nsec;
 
@@ -49,6 +52,9 @@ void MatchState::tick ()
     applyUnitCollisions (dt); // TODO: Possibly optimize fron O (N^2) to O (N*log (N))
     applyDeath ();
     applyDecay ();
+    applyPositionCorrections ();
+    if (fog_of_war)
+        visibility.update (units);
 }
 
 void MatchState::initNodeTrees ()
@@ -84,14 +90,14 @@ void MatchState::call (Node& node_tree, const std::string& name, BlueTeamUserDat
 }
 void MatchState::applyAreaBoundaryCollisions (double dt)
 {
-    for (std::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
+    for (std::pmr::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
         Unit& unit = it->second;
         applyAreaBoundaryCollision (unit, dt);
     }
 }
 void MatchState::applyActions (double dt)
 {
-    for (std::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
+    for (std::pmr::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
         Unit& unit = it->second;
         if (unit.pestilence_disease_left_ticks > 0 && !(unit.pestilence_disease_left_ticks % pestilenceDamagePeriodTicks ()))
             dealDamage (unit, pestilenceDamagePerPeriod ());
@@ -109,11 +115,11 @@ void MatchState::applyActions (double dt)
             if (closest_target.has_value ()) {
                 stop_action.current_target = closest_target;
                 uint32_t target_unit_id = stop_action.current_target.value ();
-                std::map<uint32_t, Unit>::iterator target_unit_it = units.find (target_unit_id);
+                std::pmr::map<uint32_t, Unit>::iterator target_unit_it = units.find (target_unit_id);
                 if (target_unit_it != units.end ()) {
                     Unit& target_unit = target_unit_it->second;
                     if (applyAttack (unit, target_unit_id, target_unit, dt))
-                        unit.action = PerformingAttackAction (StopAction (std::get<StopAction> (unit.action)), unitPrimaryAttackDescription (unit.type).duration_ticks);
+                        unit.action = PerformingAttackAction (StopAction (std::get<StopAction> (unit.action)), ticks (unitPrimaryAttackDescription (unit.type).duration_ms));
                 } else {
                     stop_action.current_target.reset ();
                 }
@@ -125,7 +131,7 @@ void MatchState::applyActions (double dt)
                 applyMovement (unit, target_position, dt, true);
             } else if (std::holds_alternative<uint32_t> (target)) {
                 uint32_t target_unit_id = std::get<uint32_t> (target);
-                std::map<uint32_t, Unit>::iterator target_unit_it = units.find (target_unit_id);
+                std::pmr::map<uint32_t, Unit>::iterator target_unit_it = units.find (target_unit_id);
                 if (target_unit_it != units.end ()) {
                     Unit& target_unit = target_unit_it->second;
                     applyMovement (unit, target_unit.position, dt, false);
@@ -143,11 +149,11 @@ void MatchState::applyActions (double dt)
                 if (closest_target.has_value ()) {
                     attack_action.current_target = closest_target;
                     uint32_t target_unit_id = attack_action.current_target.value ();
-                    std::map<uint32_t, Unit>::iterator target_unit_it = units.find (target_unit_id);
+                    std::pmr::map<uint32_t, Unit>::iterator target_unit_it = units.find (target_unit_id);
                     if (target_unit_it != units.end ()) {
                         Unit& target_unit = target_unit_it->second;
                         if (applyAttack (unit, target_unit_id, target_unit, dt))
-                            unit.action = PerformingAttackAction (AttackAction (std::get<AttackAction> (unit.action)), unitPrimaryAttackDescription (unit.type).duration_ticks);
+                            unit.action = PerformingAttackAction (AttackAction (std::get<AttackAction> (unit.action)), ticks (unitPrimaryAttackDescription (unit.type).duration_ms));
                     } else {
                         attack_action.current_target.reset ();
                     }
@@ -156,11 +162,11 @@ void MatchState::applyActions (double dt)
                 }
             } else if (std::holds_alternative<uint32_t> (target)) {
                 uint32_t target_unit_id = std::get<uint32_t> (target);
-                std::map<uint32_t, Unit>::iterator target_unit_it = units.find (target_unit_id);
+                std::pmr::map<uint32_t, Unit>::iterator target_unit_it = units.find (target_unit_id);
                 if (target_unit_it != units.end ()) {
                     Unit& target_unit = target_unit_it->second;
                     if (applyAttack (unit, target_unit_id, target_unit, dt))
-                        unit.action = PerformingAttackAction (AttackAction (std::get<AttackAction> (unit.action)), unitPrimaryAttackDescription (unit.type).duration_ticks);
+                        unit.action = PerformingAttackAction (AttackAction (std::get<AttackAction> (unit.action)), ticks (unitPrimaryAttackDescription (unit.type).duration_ms));
                 } else {
                     unit.action = StopAction ();
                 }
@@ -171,10 +177,10 @@ void MatchState::applyActions (double dt)
                 int64_t duration_ticks;
                 switch (cast_action.type) {
                 case CastAction::Type::Pestilence:
-                    duration_ticks = MatchState::effectAttackDescription (AttackDescription::Type::PestilenceMissile).duration_ticks;
+                    duration_ticks = ticks (MatchState::effectAttackDescription (AttackDescription::Type::PestilenceMissile).duration_ms);
                     break;
                 case CastAction::Type::SpawnBeetle:
-                    duration_ticks = MatchState::effectAttackDescription (AttackDescription::Type::SpawnBeetle).duration_ticks;
+                    duration_ticks = ticks (MatchState::effectAttackDescription (AttackDescription::Type::SpawnBeetle).duration_ms);
                     break;
                 default:
                     duration_ticks = 0;
@@ -186,7 +192,7 @@ void MatchState::applyActions (double dt)
             --performing_attack_action.remaining_ticks;
             if (performing_attack_action.remaining_ticks <= 0) {
                 const AttackDescription& attack_description = unitPrimaryAttackDescription (Unit::Type::Goon);
-                unit.attack_cooldown_left_ticks = attack_description.cooldown_ticks;
+                unit.attack_cooldown_left_ticks = ticks (attack_description.cooldown_ms);
                 if (std::holds_alternative<StopAction> (performing_attack_action.next_action))
                     unit.action = StopAction (std::get<StopAction> (performing_attack_action.next_action));
                 else if (std::holds_alternative<AttackAction> (performing_attack_action.next_action))
@@ -204,10 +210,10 @@ void MatchState::applyActions (double dt)
             if (performing_cast_action.remaining_ticks <= 0) {
                 switch (performing_cast_action.cast_type) {
                 case CastAction::Type::Pestilence:
-                    unit.cast_cooldown_left_ticks = MatchState::effectAttackDescription (AttackDescription::Type::PestilenceMissile).cooldown_ticks;
+                    unit.cast_cooldown_left_ticks = ticks (MatchState::effectAttackDescription (AttackDescription::Type::PestilenceMissile).cooldown_ms);
                     break;
                 case CastAction::Type::SpawnBeetle:
-                    unit.cast_cooldown_left_ticks = MatchState::effectAttackDescription (AttackDescription::Type::SpawnBeetle).cooldown_ticks;
+                    unit.cast_cooldown_left_ticks = ticks (MatchState::effectAttackDescription (AttackDescription::Type::SpawnBeetle).cooldown_ms);
                     break;
                 default:
                     break;
@@ -233,11 +239,11 @@ void MatchState::applyEffects (double dt)
 }
 void MatchState::applyMissilesMovement (double dt)
 {
-    for (std::map<uint32_t, Missile>::iterator it = missiles.begin (); it != missiles.end ();) {
+    for (std::pmr::map<uint32_t, Missile>::iterator it = missiles.begin (); it != missiles.end ();) {
         Missile& missile = it->second;
         if (missile.target_unit.has_value ()) {
             uint32_t target_unit_id = *missile.target_unit;
-            std::map<uint32_t, Unit>::iterator target_unit_it = units.find (target_unit_id);
+            std::pmr::map<uint32_t, Unit>::iterator target_unit_it = units.find (target_unit_id);
             if (target_unit_it != units.end ()) {
                 missile.target_position = target_unit_it->second.position;
                 Offset direction = missile.target_position - missile.position;
@@ -265,7 +271,7 @@ void MatchState::applyMissilesMovement (double dt)
         if (displacement_length <= path_length) {
             if (missile.target_unit.has_value ()) {
                 uint32_t target_unit_id = *missile.target_unit;
-                std::map<uint32_t, Unit>::iterator target_unit_it = units.find (target_unit_id);
+                std::pmr::map<uint32_t, Unit>::iterator target_unit_it = units.find (target_unit_id);
                 if (target_unit_it != units.end ()) {
                     Unit& target_unit = target_unit_it->second;
                     switch (missile.type) {
@@ -297,7 +303,7 @@ void MatchState::applyMissilesMovement (double dt)
 }
 void MatchState::applyExplosionEffects (double /* dt */)
 {
-    for (std::map<uint32_t, Explosion>::iterator it = explosions.begin (); it != explosions.end ();) {
+    for (std::pmr::map<uint32_t, Explosion>::iterator it = explosions.begin (); it != explosions.end ();) {
         Explosion& explosion = it->second;
         if (--explosion.remaining_ticks > 0)
             ++it;
@@ -447,12 +453,13 @@ void MatchState::applyAreaBoundaryCollision (Unit& unit, double dt)
 void MatchState::applyUnitCollisions (double dt)
 {
     // Apply unit collisions: O (N^2)
-    std::vector<Offset> offsets;
-    for (std::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
+    std::pmr::vector<Offset> offsets (scratch ());
+    offsets.reserve (units.size ());
+    for (std::pmr::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
         Unit& unit = it->second;
         double unit_radius = unitRadius (unit.type);
         Offset off;
-        for (std::map<uint32_t, Unit>::iterator related_it = units.begin (); related_it != units.end (); ++related_it) {
+        for (std::pmr::map<uint32_t, Unit>::iterator related_it = units.begin (); related_it != units.end (); ++related_it) {
             if (related_it == it)
                 continue;
             Unit& related_unit = related_it->second;
@@ -477,7 +484,7 @@ void MatchState::applyUnitCollisions (double dt)
     }
     {
         size_t i = 0;
-        for (std::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
+        for (std::pmr::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
             Unit& unit = it->second;
             Position& position = unit.position;
             Offset off = offsets[i++];
@@ -490,14 +497,14 @@ void MatchState::applyUnitCollisions (double dt)
 }
 void MatchState::applyDeath ()
 {
-    for (std::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end ();) {
+    for (std::pmr::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end ();) {
         Unit& unit = it->second;
         if (unit.hp <= 0) {
-            corpses.emplace (it->first, unit);
+            corpses.emplace (it->first, Corpse (unit, ticks (Corpse::DECAY_DURATION_MS)));
             it = units.erase (it);
         } else if (unit.ttl_ticks.has_value ()) {
             if (unit.ttl_ticks.value () <= 1) {
-                corpses.emplace (it->first, unit);
+                corpses.emplace (it->first, Corpse (unit, ticks (Corpse::DECAY_DURATION_MS)));
                 it = units.erase (it);
             } else {
                 --unit.ttl_ticks.value ();
@@ -510,7 +517,7 @@ void MatchState::applyDeath ()
 }
 void MatchState::applyDecay ()
 {
-    for (std::map<uint32_t, Corpse>::iterator it = corpses.begin (); it != corpses.end ();) {
+    for (std::pmr::map<uint32_t, Corpse>::iterator it = corpses.begin (); it != corpses.end ();) {
         Corpse& corpse = it->second;
         if (corpse.decay_remaining_ticks <= 1) {
             it = corpses.erase (it);
@@ -558,9 +565,9 @@ void MatchState::emitExplosion (Explosion::Type explosion_type, Unit::Team sende
         *ret;
     });
 
-    explosions.insert ({next_id++, {explosion_type, position, attack_description.duration_ticks}});
+    explosions.insert ({next_id++, {explosion_type, position, ticks (attack_description.duration_ms)}});
 
-    for (std::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
+    for (std::pmr::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
         Unit& target_unit = it->second;
         if (attack_description.friendly_fire || target_unit.team != sender_team) {
             if ((target_unit.position - position).length () <= attack_description.range + unitRadius (target_unit.type)) {
@@ -596,7 +603,7 @@ std::optional<uint32_t> MatchState::findClosestTarget (const Unit& unit)
     double radius = unitRadius (unit.type);
     double trigger_range = unitPrimaryAttackDescription (unit.type).trigger_range;
     double minimal_range = 1000000000.0;
-    for (std::map<uint32_t, Unit>::iterator target_it = units.begin (); target_it != units.end (); ++target_it) {
+    for (std::pmr::map<uint32_t, Unit>::iterator target_it = units.begin (); target_it != units.end (); ++target_it) {
         Unit& target_unit = target_it->second;
         if (target_unit.team != unit.team &&
             unitDistance (unit, target_unit) <= qMin (radius + unitRadius (target_unit.type) + trigger_range, minimal_range)) {
@@ -613,6 +620,10 @@ double MatchState::unitVelocity (const Unit& unit) const
         velocity *= pestilenceDiseaseSlowdownFactor ();
     return velocity;
 }
+std::pmr::memory_resource* MatchState::scratch () const
+{
+    return memory ? memory->scratch () : std::pmr::get_default_resource ();
+}
 void MatchState::redTeamUserTick (RedTeamUserData& /* user_data */)
 {
 }
@@ -621,8 +632,8 @@ void MatchState::blueTeamUserTick (BlueTeamUserData& user_data)
     Node node_tree;
 
     // TODO: Define proper API
-    std::vector<const Missile*> new_missiles;
-    for (std::map<uint32_t, Missile>::iterator it = missiles.begin (); it != missiles.end (); ++it) {
+    std::pmr::vector<const Missile*> new_missiles (scratch ());
+    for (std::pmr::map<uint32_t, Missile>::iterator it = missiles.begin (); it != missiles.end (); ++it) {
         if (!user_data.old_missiles.count (it->first)) {
             if (it->second.sender_team == Unit::Team::Red)
                 new_missiles.push_back (&it->second);
@@ -630,7 +641,7 @@ void MatchState::blueTeamUserTick (BlueTeamUserData& user_data)
         }
     }
 
-    for (std::set<uint32_t>::iterator it = user_data.old_missiles.begin (); it != user_data.old_missiles.end ();) {
+    for (std::pmr::set<uint32_t>::iterator it = user_data.old_missiles.begin (); it != user_data.old_missiles.end ();) {
         if (!missiles.count (*it))
             it = user_data.old_missiles.erase (it);
         else
@@ -639,7 +650,7 @@ void MatchState::blueTeamUserTick (BlueTeamUserData& user_data)
 
     const AttackDescription& pestilence_splash_attack = MatchState::effectAttackDescription (AttackDescription::Type::PestilenceSplash);
     const AttackDescription& rocket_explosion_attack = MatchState::effectAttackDescription (AttackDescription::Type::GoonRocketExplosion);
-    for (std::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
+    for (std::pmr::map<uint32_t, Unit>::iterator it = units.begin (); it != units.end (); ++it) {
         Unit& unit = it->second;
         if (unit.team == Unit::Team::Blue) {
             for (const Missile* missile: new_missiles) {
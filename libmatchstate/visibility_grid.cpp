@@ -0,0 +1,119 @@
+#include "visibility_grid.h"
+
+#include "matchstate.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+VisibilityGrid::VisibilityGrid (const Rectangle& area, std::pmr::memory_resource* resource)
+    : area (area)
+    , width (std::max (int32_t (std::ceil (area.width () / kCellSize)), 1))
+    , height (std::max (int32_t (std::ceil (area.height () / kCellSize)), 1))
+    , red_cells {std::pmr::vector<uint16_t> (resource), std::pmr::vector<uint64_t> (resource)}
+    , blue_cells {std::pmr::vector<uint16_t> (resource), std::pmr::vector<uint64_t> (resource)}
+    , stamps (resource)
+{
+    for (TeamCells* cells: {&red_cells, &blue_cells}) {
+        cells->counts.assign (size_t (width) * height, 0);
+        cells->bits.assign ((size_t (width) * height + 63) / 64, 0);
+    }
+}
+void VisibilityGrid::update (const std::pmr::map<uint32_t, Unit>& units)
+{
+    std::pmr::map<uint32_t, Stamp>::iterator stamp_it = stamps.begin ();
+    for (std::pmr::map<uint32_t, Unit>::const_iterator it = units.cbegin (); it != units.cend (); ++it) {
+        while (stamp_it != stamps.end () && stamp_it->first < it->first) {
+            apply (stamp_it->second, false);
+            stamp_it = stamps.erase (stamp_it);
+        }
+        std::optional<Stamp> stamp = stampFor (it->second);
+        if (stamp_it != stamps.end () && stamp_it->first == it->first) {
+            if (stamp.has_value () && *stamp == stamp_it->second) {
+                ++stamp_it;
+                continue;
+            }
+            apply (stamp_it->second, false);
+            if (stamp.has_value ()) {
+                apply (*stamp, true);
+                stamp_it->second = *stamp;
+                ++stamp_it;
+            } else {
+                stamp_it = stamps.erase (stamp_it);
+            }
+        } else if (stamp.has_value ()) {
+            apply (*stamp, true);
+            stamps.emplace_hint (stamp_it, it->first, *stamp);
+        }
+    }
+    while (stamp_it != stamps.end ()) {
+        apply (stamp_it->second, false);
+        stamp_it = stamps.erase (stamp_it);
+    }
+}
+bool VisibilityGrid::visible (Unit::Team team, const Position& position) const
+{
+    const TeamCells* cells = teamCells (team);
+    if (!cells)
+        return false;
+    std::pair<int32_t, int32_t> cell = cellOf (position);
+    size_t index = size_t (cell.second) * width + cell.first;
+    return cells->bits[index / 64] & (uint64_t (1) << (index % 64));
+}
+std::pair<int32_t, int32_t> VisibilityGrid::cellOf (const Position& position) const
+{
+    int32_t x = int32_t (std::floor ((position.x () - area.left ()) / kCellSize));
+    int32_t y = int32_t (std::floor ((position.y () - area.top ()) / kCellSize));
+    return {std::clamp (x, 0, width - 1), std::clamp (y, 0, height - 1)};
+}
+std::optional<VisibilityGrid::Stamp> VisibilityGrid::stampFor (const Unit& unit) const
+{
+    if (!teamCells (unit.team))
+        return std::nullopt;
+    std::pair<int32_t, int32_t> cell = cellOf (unit.position);
+    return Stamp {unit.team, cell.first, cell.second, int32_t (std::ceil (MatchState::unitSightRadius (unit.type) / kCellSize))};
+}
+void VisibilityGrid::apply (const Stamp& stamp, bool add)
+{
+    TeamCells* cells = teamCells (stamp.team);
+    for (int32_t dy = -stamp.radius; dy <= stamp.radius; ++dy) {
+        int32_t y = stamp.y + dy;
+        if (y < 0 || y >= height)
+            continue;
+        int32_t half_width = int32_t (std::sqrt (double (stamp.radius * stamp.radius - dy * dy)));
+        int32_t x_begin = std::max (stamp.x - half_width, 0);
+        int32_t x_end = std::min (stamp.x + half_width, width - 1);
+        for (int32_t x = x_begin; x <= x_end; ++x) {
+            size_t index = size_t (y) * width + x;
+            if (add) {
+                if (cells->counts[index]++ == 0)
+                    cells->bits[index / 64] |= uint64_t (1) << (index % 64);
+            } else {
+                if (--cells->counts[index] == 0)
+                    cells->bits[index / 64] &= ~(uint64_t (1) << (index % 64));
+            }
+        }
+    }
+}
+VisibilityGrid::TeamCells* VisibilityGrid::teamCells (Unit::Team team)
+{
+    switch (team) {
+    case Unit::Team::Red:
+        return &red_cells;
+    case Unit::Team::Blue:
+        return &blue_cells;
+    default:
+        return nullptr;
+    }
+}
+const VisibilityGrid::TeamCells* VisibilityGrid::teamCells (Unit::Team team) const
+{
+    switch (team) {
+    case Unit::Team::Red:
+        return &red_cells;
+    case Unit::Team::Blue:
+        return &blue_cells;
+    default:
+        return nullptr;
+    }
+}
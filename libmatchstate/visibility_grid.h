@@ -0,0 +1,54 @@
+#pragma once
+
+#include <map>
+#include <memory_resource>
+#include <optional>
+#include <vector>
+
+#include "unit.h"
+#include "rectangle.h"
+
+
+// Per-team visibility over kCellSize cells of the area. Every unit keeps its sight disk
+// stamped into reference counted cells and is only restamped when it crosses into another
+// cell, so an update costs proportional to the number of units that changed cells.
+// Cells and stamps live in the given resource, the match memory on the server
+class VisibilityGrid
+{
+public:
+    static constexpr double kCellSize = 1.0;
+
+    VisibilityGrid (const Rectangle& area, std::pmr::memory_resource* resource);
+    void update (const std::pmr::map<uint32_t, Unit>& units);
+    bool visible (Unit::Team team, const Position& position) const;
+
+private:
+    struct Stamp {
+        Unit::Team team;
+        int32_t x;
+        int32_t y;
+        int32_t radius;
+
+        bool operator== (const Stamp& other) const
+        {
+            return team == other.team && x == other.x && y == other.y && radius == other.radius;
+        }
+    };
+    struct TeamCells {
+        std::pmr::vector<uint16_t> counts;
+        std::pmr::vector<uint64_t> bits;
+    };
+
+    std::pair<int32_t, int32_t> cellOf (const Position& position) const;
+    std::optional<Stamp> stampFor (const Unit& unit) const;
+    void apply (const Stamp& stamp, bool add);
+    TeamCells* teamCells (Unit::Team team);
+    const TeamCells* teamCells (Unit::Team team) const;
+
+    Rectangle area;
+    int32_t width;
+    int32_t height;
+    TeamCells red_cells;
+    TeamCells blue_cells;
+    std::pmr::map<uint32_t, Stamp> stamps;
+};
@@ -0,0 +1,158 @@
+#include "budget.h"
+
+#include <algorithm>
+
+
+static constexpr double kCommandedPriority = 8.0;
+static constexpr double kOwnPriority = 4.0;
+static constexpr double kViewportPriority = 4.0;
+static constexpr double kRecentlyChangedPriority = 2.0;
+static constexpr double kStalenessPriority = 1.0;
+// Field tag and length prefix of repeated message entries
+static constexpr size_t kEntryOverhead = 3;
+static constexpr double kBytesPerTickGain = 1.0 / 8.0;
+
+
+template <class Entity>
+static bool changed_since (const Entity& entity, const Entity* previous_entity)
+{
+    return !previous_entity || !RTSN::Delta::same (entity, *previous_entity);
+}
+template <class Entity>
+static const Entity* find_entity (const std::map<uint32_t, Entity>& entities, uint32_t id)
+{
+    typename std::map<uint32_t, Entity>::const_iterator it = entities.find (id);
+    return it != entities.cend () ? &it->second : nullptr;
+}
+static bool inside (const std::optional<Rectangle>& viewport, const RTS::Vector2D& position)
+{
+    return viewport.has_value () && position.x () >= viewport->left () && position.x () <= viewport->right () &&
+        position.y () >= viewport->top () && position.y () <= viewport->bottom ();
+}
+static bool higher_priority (const RTSN::Budget::Candidate& a, const RTSN::Budget::Candidate& b)
+{
+    return a.priority > b.priority;
+}
+static double unit_priority (const RTS::Unit& unit, const RTSN::Budget::Viewer& viewer)
+{
+    double priority = 0.0;
+    if (unit.team () == viewer.team)
+        priority += unit.current_action ().has_stop () ? kOwnPriority : kCommandedPriority;
+    if (inside (viewer.viewport, unit.position ()))
+        priority += kViewportPriority;
+    return priority;
+}
+
+namespace RTSN::Budget {
+
+bool Packer::pack (const Delta::Snapshot& baseline, const Delta::Snapshot& current, const Delta::Snapshot* previous,
+                   const Viewer& viewer, size_t budget_bytes, RTS::MatchStateDeltaResponse& delta, Delta::Snapshot& view,
+                   std::string& error_message)
+{
+    RTS::MatchStateDeltaResponse full_delta;
+    Delta::encode (baseline, current, full_delta);
+
+    std::vector<Candidate> candidates;
+    std::map<EntityKey, uint32_t> pending_staleness;
+    for (int i = 0; i < full_delta.units_size (); ++i) {
+        const RTS::Unit& unit = full_delta.units (i);
+        bool recently_changed = changed_since (unit, previous ? find_entity (previous->units, unit.id ()) : nullptr);
+        addCandidate (candidates, pending_staleness, {EntityKind::Unit, unit.id ()}, EntryType::Unit, i, unit.ByteSizeLong (),
+                      unit_priority (unit, viewer) + (recently_changed ? kRecentlyChangedPriority : 0.0));
+    }
+    for (int i = 0; i < full_delta.unit_deltas_size (); ++i) {
+        const RTS::UnitDelta& unit_delta = full_delta.unit_deltas (i);
+        const RTS::Unit& unit = current.units.at (unit_delta.id ());
+        bool recently_changed = changed_since (unit, previous ? find_entity (previous->units, unit.id ()) : nullptr);
+        addCandidate (candidates, pending_staleness, {EntityKind::Unit, unit.id ()}, EntryType::UnitDelta, i, unit_delta.ByteSizeLong (),
+                      unit_priority (unit, viewer) + (recently_changed ? kRecentlyChangedPriority : 0.0));
+    }
+    for (int i = 0; i < full_delta.corpses_size (); ++i) {
+        const RTS::Corpse& corpse = full_delta.corpses (i);
+        bool recently_changed = changed_since (corpse, previous ? find_entity (previous->corpses, corpse.unit ().id ()) : nullptr);
+        addCandidate (candidates, pending_staleness, {EntityKind::Corpse, corpse.unit ().id ()}, EntryType::Corpse, i, corpse.ByteSizeLong (),
+                      (inside (viewer.viewport, corpse.unit ().position ()) ? kViewportPriority : 0.0) + (recently_changed ? kRecentlyChangedPriority : 0.0));
+    }
+    // Missiles move every tick, so they are always recently changed
+    for (int i = 0; i < full_delta.missiles_size (); ++i) {
+        const RTS::Missile& missile = full_delta.missiles (i);
+        addCandidate (candidates, pending_staleness, {EntityKind::Missile, missile.id ()}, EntryType::Missile, i, missile.ByteSizeLong (),
+                      (inside (viewer.viewport, missile.position ()) ? kViewportPriority : 0.0) + kRecentlyChangedPriority);
+    }
+    for (int i = 0; i < full_delta.missile_deltas_size (); ++i) {
+        const RTS::MissileDelta& missile_delta = full_delta.missile_deltas (i);
+        addCandidate (candidates, pending_staleness, {EntityKind::Missile, missile_delta.id ()}, EntryType::MissileDelta, i, missile_delta.ByteSizeLong (),
+                      (inside (viewer.viewport, missile_delta.position ()) ? kViewportPriority : 0.0) + kRecentlyChangedPriority);
+    }
+    std::stable_sort (candidates.begin (), candidates.end (), higher_priority);
+
+    // Removals are tiny and leaving removed entities around would mislead the client more than anything else
+    delta.set_tick (full_delta.tick ());
+    delta.set_baseline_tick (full_delta.baseline_tick ());
+    *delta.mutable_removed_unit_ids () = full_delta.removed_unit_ids ();
+    *delta.mutable_removed_corpse_ids () = full_delta.removed_corpse_ids ();
+    *delta.mutable_removed_missile_ids () = full_delta.removed_missile_ids ();
+    size_t used_bytes = delta.ByteSizeLong ();
+    bool admitted = false;
+    for (const Candidate& candidate: candidates) {
+        // Top candidate goes out even when it exceeds the whole budget, otherwise it would never be sent
+        if (admitted && used_bytes + candidate.size > budget_bytes)
+            continue;
+        admitted = true;
+        used_bytes += candidate.size;
+        pending_staleness.erase (candidate.key);
+        switch (candidate.type) {
+        case EntryType::Unit:
+            *delta.add_units () = full_delta.units (candidate.index);
+            break;
+        case EntryType::UnitDelta:
+            *delta.add_unit_deltas () = full_delta.unit_deltas (candidate.index);
+            break;
+        case EntryType::Corpse:
+            *delta.add_corpses () = full_delta.corpses (candidate.index);
+            break;
+        case EntryType::Missile:
+            *delta.add_missiles () = full_delta.missiles (candidate.index);
+            break;
+        case EntryType::MissileDelta:
+            *delta.add_missile_deltas () = full_delta.missile_deltas (candidate.index);
+            break;
+        }
+    }
+
+    if (!Delta::apply (baseline, delta, view, error_message))
+        return false;
+
+    // Held back changes grow staler, sent and settled ones are forgotten
+    staleness.clear ();
+    uint64_t staleness_sum = 0;
+    stats_.max_staleness_ticks = 0;
+    for (std::map<EntityKey, uint32_t>::const_iterator it = pending_staleness.cbegin (); it != pending_staleness.cend (); ++it) {
+        uint32_t entity_staleness = it->second + 1;
+        staleness.emplace_hint (staleness.end (), it->first, entity_staleness);
+        staleness_sum += entity_staleness;
+        stats_.max_staleness_ticks = std::max (stats_.max_staleness_ticks, entity_staleness);
+    }
+    stats_.deferred_entities = staleness.size ();
+    stats_.mean_staleness_ticks = staleness.empty () ? 0.0 : double (staleness_sum) / staleness.size ();
+    stats_.bytes_per_tick += (double (delta.ByteSizeLong ()) - stats_.bytes_per_tick) * kBytesPerTickGain;
+    return true;
+}
+void Packer::addCandidate (std::vector<Candidate>& candidates, std::map<EntityKey, uint32_t>& pending_staleness,
+                           const EntityKey& key, EntryType type, int index, size_t size, double priority) const
+{
+    std::map<EntityKey, uint32_t>::const_iterator it = staleness.find (key);
+    uint32_t entity_staleness = it != staleness.cend () ? it->second : 0;
+    pending_staleness[key] = entity_staleness;
+    candidates.push_back ({key, type, index, size + kEntryOverhead, priority + entity_staleness * kStalenessPriority});
+}
+const Stats& Packer::stats () const
+{
+    return stats_;
+}
+const std::map<EntityKey, uint32_t>& Packer::stalenessRef () const
+{
+    return staleness;
+}
+
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "delta.h"
+#include "rectangle.h"
+
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+
+// Fits match state deltas into a per-tick byte budget. Pending changes are ranked by
+// priority (commanded own units, own units, units in viewport, changed on the last tick)
+// plus staleness accumulated while held back, changes that do not fit roll over to the
+// next tick since they stay in the difference against the acknowledged baseline
+namespace RTSN::Budget {
+
+enum class EntityKind: uint8_t {
+    Unit,
+    Corpse,
+    Missile,
+};
+typedef std::pair<EntityKind, uint32_t> EntityKey;
+
+// Pending entry of the full delta, index points into the repeated field of its type
+enum class EntryType {
+    Unit,
+    UnitDelta,
+    Corpse,
+    Missile,
+    MissileDelta,
+};
+struct Candidate {
+    EntityKey key;
+    EntryType type;
+    int index;
+    size_t size;
+    double priority;
+};
+
+struct Viewer {
+    RTS::Team team;
+    std::optional<Rectangle> viewport;
+};
+
+struct Stats {
+    double bytes_per_tick = 0.0; // Moving average of sent delta size
+    uint32_t deferred_entities = 0;
+    uint32_t max_staleness_ticks = 0;
+    double mean_staleness_ticks = 0.0;
+};
+
+class Packer
+{
+public:
+    // Delta of current against baseline within budget_bytes, view receives the state the client
+    // reconstructs from it and must be used as baseline once acknowledged.
+    // previous is the state one tick before current, if known. Fails when the packed delta
+    // does not apply to baseline, the caller should send a full snapshot instead
+    bool pack (const Delta::Snapshot& baseline, const Delta::Snapshot& current, const Delta::Snapshot* previous,
+               const Viewer& viewer, size_t budget_bytes, RTS::MatchStateDeltaResponse& delta, Delta::Snapshot& view,
+               std::string& error_message);
+    const Stats& stats () const;
+    const std::map<EntityKey, uint32_t>& stalenessRef () const;
+
+private:
+    void addCandidate (std::vector<Candidate>& candidates, std::map<EntityKey, uint32_t>& pending_staleness,
+                       const EntityKey& key, EntryType type, int index, size_t size, double priority) const;
+
+    std::map<EntityKey, uint32_t> staleness;
+    Stats stats_;
+};
+
+}
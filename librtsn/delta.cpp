@@ -0,0 +1,382 @@
+#include "delta.h"
+
+#include "matchstate.h"
+
+#include <algorithm>
+
+
+// Field by field: comparing serialized forms would allocate twice per entity and tick
+static bool same_message (const RTS::Vector2D& a, const RTS::Vector2D& b)
+{
+    return a.x () == b.x () && a.y () == b.y ();
+}
+static bool same_message (const RTS::TargetUnit& a, const RTS::TargetUnit& b)
+{
+    return a.id () == b.id ();
+}
+static bool same_message (const RTS::ActionTargetPosition& a, const RTS::ActionTargetPosition& b)
+{
+    return a.has_position () == b.has_position () && same_message (a.position (), b.position ());
+}
+template <typename Action>
+static bool same_target (const Action& a, const Action& b)
+{
+    if (a.target_case () != b.target_case ())
+        return false;
+    switch (a.target_case ()) {
+    case Action::kPosition:
+        return same_message (a.position (), b.position ());
+    case Action::kUnit:
+        return same_message (a.unit (), b.unit ());
+    default:
+        return true;
+    }
+}
+static bool same_message (const RTS::AttackAction& a, const RTS::AttackAction& b)
+{
+    return same_target (a, b);
+}
+static bool same_message (const RTS::MoveAction& a, const RTS::MoveAction& b)
+{
+    return same_target (a, b);
+}
+static bool same_message (const RTS::CastAction& a, const RTS::CastAction& b)
+{
+    return a.has_position () == b.has_position () && same_message (a.position (), b.position ()) && a.type () == b.type ();
+}
+static bool same_message (const RTS::StopAction& a, const RTS::StopAction& b)
+{
+    return a.has_target () == b.has_target () && same_message (a.target (), b.target ());
+}
+template <typename Action>
+static bool same_next_action (const Action& a, const Action& b)
+{
+    if (a.next_action_case () != b.next_action_case ())
+        return false;
+    switch (a.next_action_case ()) {
+    case Action::kAttack:
+        return same_message (a.attack (), b.attack ());
+    case Action::kMove:
+        return same_message (a.move (), b.move ());
+    case Action::kCast:
+        return same_message (a.cast (), b.cast ());
+    case Action::kStop:
+        return same_message (a.stop (), b.stop ());
+    default:
+        return true;
+    }
+}
+static bool same_message (const RTS::PerformingAttackAction& a, const RTS::PerformingAttackAction& b)
+{
+    return same_next_action (a, b) && a.remaining_ticks () == b.remaining_ticks ();
+}
+static bool same_message (const RTS::PerformingCastAction& a, const RTS::PerformingCastAction& b)
+{
+    return same_next_action (a, b) && a.cast_type () == b.cast_type () && a.remaining_ticks () == b.remaining_ticks ();
+}
+static bool same_message (const RTS::UnitAction& a, const RTS::UnitAction& b)
+{
+    if (a.action_case () != b.action_case ())
+        return false;
+    switch (a.action_case ()) {
+    case RTS::UnitAction::kAttack:
+        return same_message (a.attack (), b.attack ());
+    case RTS::UnitAction::kMove:
+        return same_message (a.move (), b.move ());
+    case RTS::UnitAction::kCast:
+        return same_message (a.cast (), b.cast ());
+    case RTS::UnitAction::kStop:
+        return same_message (a.stop (), b.stop ());
+    case RTS::UnitAction::kPerformingAttack:
+        return same_message (a.performing_attack (), b.performing_attack ());
+    case RTS::UnitAction::kPerformingCast:
+        return same_message (a.performing_cast (), b.performing_cast ());
+    default:
+        return true;
+    }
+}
+static bool same_message (const RTS::Unit& a, const RTS::Unit& b)
+{
+    return a.has_client_id () == b.has_client_id () && a.client_id ().id () == b.client_id ().id () &&
+        a.id () == b.id () && a.type () == b.type () && a.team () == b.team () &&
+        a.has_position () == b.has_position () && same_message (a.position (), b.position ()) &&
+        a.orientation () == b.orientation () && a.health () == b.health () &&
+        a.has_current_action () == b.has_current_action () && same_message (a.current_action (), b.current_action ()) &&
+        a.attack_remaining_ticks () == b.attack_remaining_ticks () && a.attack_cooldown_left_ticks () == b.attack_cooldown_left_ticks () &&
+        a.cast_cooldown_left_ticks () == b.cast_cooldown_left_ticks () &&
+        a.has_ttl () == b.has_ttl () && a.ttl ().ttl_ticks () == b.ttl ().ttl_ticks ();
+}
+static bool same_message (const RTS::Corpse& a, const RTS::Corpse& b)
+{
+    return a.has_unit () == b.has_unit () && same_message (a.unit (), b.unit ()) && a.decay_remaining_ticks () == b.decay_remaining_ticks ();
+}
+static bool same_message (const RTS::Missile& a, const RTS::Missile& b)
+{
+    return a.id () == b.id () && a.type () == b.type () && a.team () == b.team () &&
+        a.has_position () == b.has_position () && same_message (a.position (), b.position ()) &&
+        a.has_target_position () == b.has_target_position () && same_message (a.target_position (), b.target_position ()) &&
+        a.has_target_unit () == b.has_target_unit () && same_message (a.target_unit (), b.target_unit ());
+}
+static int64_t advance_countdown (int64_t value, uint32_t ticks)
+{
+    return std::max<int64_t> (value - int64_t (ticks), 0);
+}
+static void advance_unit (RTS::Unit& unit, uint32_t ticks)
+{
+    unit.set_attack_cooldown_left_ticks (advance_countdown (unit.attack_cooldown_left_ticks (), ticks));
+    unit.set_cast_cooldown_left_ticks (advance_countdown (unit.cast_cooldown_left_ticks (), ticks));
+    if (unit.has_ttl ())
+        unit.mutable_ttl ()->set_ttl_ticks (advance_countdown (unit.ttl ().ttl_ticks (), ticks));
+}
+static void advance_corpse (RTS::Corpse& corpse, uint32_t ticks)
+{
+    corpse.set_decay_remaining_ticks (advance_countdown (corpse.decay_remaining_ticks (), ticks));
+}
+static bool same_identity (const RTS::Unit& a, const RTS::Unit& b)
+{
+    return a.type () == b.type () && a.team () == b.team () && a.has_client_id () == b.has_client_id () && a.client_id ().id () == b.client_id ().id ();
+}
+static void encode_unit (uint32_t id, const RTS::Unit& predicted, const RTS::Unit& unit, RTS::MatchStateDeltaResponse& delta)
+{
+    if (!same_identity (predicted, unit)) {
+        *delta.add_units () = unit;
+        return;
+    }
+
+    RTS::UnitDelta m_unit_delta;
+    uint32_t changed_mask = 0;
+    if (predicted.position ().x () != unit.position ().x () || predicted.position ().y () != unit.position ().y ()) {
+        changed_mask |= RTS::UNIT_DELTA_FIELD_POSITION;
+        *m_unit_delta.mutable_position () = unit.position ();
+    }
+    if (predicted.orientation () != unit.orientation ()) {
+        changed_mask |= RTS::UNIT_DELTA_FIELD_ORIENTATION;
+        m_unit_delta.set_orientation (unit.orientation ());
+    }
+    if (predicted.health () != unit.health ()) {
+        changed_mask |= RTS::UNIT_DELTA_FIELD_HEALTH;
+        m_unit_delta.set_health (unit.health ());
+    }
+    if (!same_message (predicted.current_action (), unit.current_action ())) {
+        changed_mask |= RTS::UNIT_DELTA_FIELD_ACTION;
+        *m_unit_delta.mutable_current_action () = unit.current_action ();
+    }
+    if (predicted.attack_remaining_ticks () != unit.attack_remaining_ticks ()) {
+        changed_mask |= RTS::UNIT_DELTA_FIELD_ATTACK_REMAINING;
+        m_unit_delta.set_attack_remaining_ticks (unit.attack_remaining_ticks ());
+    }
+    if (predicted.attack_cooldown_left_ticks () != unit.attack_cooldown_left_ticks ()) {
+        changed_mask |= RTS::UNIT_DELTA_FIELD_ATTACK_COOLDOWN;
+        m_unit_delta.set_attack_cooldown_left_ticks (unit.attack_cooldown_left_ticks ());
+    }
+    if (predicted.cast_cooldown_left_ticks () != unit.cast_cooldown_left_ticks ()) {
+        changed_mask |= RTS::UNIT_DELTA_FIELD_CAST_COOLDOWN;
+        m_unit_delta.set_cast_cooldown_left_ticks (unit.cast_cooldown_left_ticks ());
+    }
+    if (predicted.has_ttl () != unit.has_ttl () || predicted.ttl ().ttl_ticks () != unit.ttl ().ttl_ticks ()) {
+        changed_mask |= RTS::UNIT_DELTA_FIELD_TTL;
+        if (unit.has_ttl ())
+            *m_unit_delta.mutable_ttl () = unit.ttl ();
+    }
+    if (!changed_mask)
+        return;
+    m_unit_delta.set_id (id);
+    m_unit_delta.set_changed_mask (changed_mask);
+    delta.add_unit_deltas ()->Swap (&m_unit_delta);
+}
+static void apply_unit_delta (const RTS::UnitDelta& m_unit_delta, RTS::Unit& unit)
+{
+    uint32_t changed_mask = m_unit_delta.changed_mask ();
+    if (changed_mask & RTS::UNIT_DELTA_FIELD_POSITION)
+        *unit.mutable_position () = m_unit_delta.position ();
+    if (changed_mask & RTS::UNIT_DELTA_FIELD_ORIENTATION)
+        unit.set_orientation (m_unit_delta.orientation ());
+    if (changed_mask & RTS::UNIT_DELTA_FIELD_HEALTH)
+        unit.set_health (m_unit_delta.health ());
+    if (changed_mask & RTS::UNIT_DELTA_FIELD_ACTION)
+        *unit.mutable_current_action () = m_unit_delta.current_action ();
+    if (changed_mask & RTS::UNIT_DELTA_FIELD_ATTACK_REMAINING)
+        unit.set_attack_remaining_ticks (m_unit_delta.attack_remaining_ticks ());
+    if (changed_mask & RTS::UNIT_DELTA_FIELD_ATTACK_COOLDOWN)
+        unit.set_attack_cooldown_left_ticks (m_unit_delta.attack_cooldown_left_ticks ());
+    if (changed_mask & RTS::UNIT_DELTA_FIELD_CAST_COOLDOWN)
+        unit.set_cast_cooldown_left_ticks (m_unit_delta.cast_cooldown_left_ticks ());
+    if (changed_mask & RTS::UNIT_DELTA_FIELD_TTL) {
+        if (m_unit_delta.has_ttl ())
+            *unit.mutable_ttl () = m_unit_delta.ttl ();
+        else
+            unit.clear_ttl ();
+    }
+}
+
+namespace RTSN::Delta {
+
+SnapshotHistory::SnapshotHistory (uint32_t span_ms)
+    : span_ms (span_ms)
+    , span_ticks (MatchState::ticks (span_ms, MatchState::kDefaultTickRate))
+{
+}
+void SnapshotHistory::setTickRate (uint32_t tick_rate)
+{
+    span_ticks = MatchState::ticks (span_ms, tick_rate);
+}
+const Snapshot& SnapshotHistory::push (Snapshot&& snapshot)
+{
+    while (!snapshots.empty () && snapshot.tick - snapshots.front ().tick >= span_ticks)
+        snapshots.pop_front ();
+    snapshots.push_back (std::move (snapshot));
+    return snapshots.back ();
+}
+const Snapshot* SnapshotHistory::find (uint32_t tick) const
+{
+    for (std::deque<Snapshot>::const_reverse_iterator it = snapshots.crbegin (); it != snapshots.crend (); ++it) {
+        if (it->tick == tick)
+            return &*it;
+    }
+    return nullptr;
+}
+void SnapshotHistory::clear ()
+{
+    snapshots.clear ();
+}
+
+bool same (const RTS::Unit& a, const RTS::Unit& b)
+{
+    return same_message (a, b);
+}
+bool same (const RTS::Corpse& a, const RTS::Corpse& b)
+{
+    return same_message (a, b);
+}
+bool same (const RTS::Missile& a, const RTS::Missile& b)
+{
+    return same_message (a, b);
+}
+
+void capture (const RTS::MatchStateResponse& response, Snapshot& snapshot)
+{
+    snapshot.tick = response.tick ();
+    for (const RTS::Unit& unit: response.units ())
+        snapshot.units[unit.id ()] = unit;
+    for (const RTS::Corpse& corpse: response.corpses ())
+        snapshot.corpses[corpse.unit ().id ()] = corpse;
+    for (const RTS::Missile& missile: response.missiles ())
+        snapshot.missiles[missile.id ()] = missile;
+}
+void restore (const Snapshot& snapshot, RTS::MatchStateResponse& response)
+{
+    response.set_tick (snapshot.tick);
+    for (std::map<uint32_t, RTS::Unit>::const_iterator it = snapshot.units.cbegin (); it != snapshot.units.cend (); ++it)
+        *response.add_units () = it->second;
+    for (std::map<uint32_t, RTS::Corpse>::const_iterator it = snapshot.corpses.cbegin (); it != snapshot.corpses.cend (); ++it)
+        *response.add_corpses () = it->second;
+    for (std::map<uint32_t, RTS::Missile>::const_iterator it = snapshot.missiles.cbegin (); it != snapshot.missiles.cend (); ++it)
+        *response.add_missiles () = it->second;
+}
+void encode (const Snapshot& baseline, const Snapshot& current, RTS::MatchStateDeltaResponse& delta)
+{
+    uint32_t ticks = current.tick - baseline.tick;
+    delta.set_tick (current.tick);
+    delta.set_baseline_tick (baseline.tick);
+
+    for (std::map<uint32_t, RTS::Unit>::const_iterator it = current.units.cbegin (); it != current.units.cend (); ++it) {
+        std::map<uint32_t, RTS::Unit>::const_iterator baseline_it = baseline.units.find (it->first);
+        if (baseline_it == baseline.units.cend ()) {
+            *delta.add_units () = it->second;
+            continue;
+        }
+        RTS::Unit predicted = baseline_it->second;
+        advance_unit (predicted, ticks);
+        encode_unit (it->first, predicted, it->second, delta);
+    }
+    for (std::map<uint32_t, RTS::Unit>::const_iterator it = baseline.units.cbegin (); it != baseline.units.cend (); ++it) {
+        if (current.units.find (it->first) == current.units.cend ())
+            delta.add_removed_unit_ids (it->first);
+    }
+
+    for (std::map<uint32_t, RTS::Corpse>::const_iterator it = current.corpses.cbegin (); it != current.corpses.cend (); ++it) {
+        std::map<uint32_t, RTS::Corpse>::const_iterator baseline_it = baseline.corpses.find (it->first);
+        if (baseline_it != baseline.corpses.cend ()) {
+            RTS::Corpse predicted = baseline_it->second;
+            advance_corpse (predicted, ticks);
+            if (same_message (predicted, it->second))
+                continue;
+        }
+        *delta.add_corpses () = it->second;
+    }
+    for (std::map<uint32_t, RTS::Corpse>::const_iterator it = baseline.corpses.cbegin (); it != baseline.corpses.cend (); ++it) {
+        if (current.corpses.find (it->first) == current.corpses.cend ())
+            delta.add_removed_corpse_ids (it->first);
+    }
+
+    for (std::map<uint32_t, RTS::Missile>::const_iterator it = current.missiles.cbegin (); it != current.missiles.cend (); ++it) {
+        std::map<uint32_t, RTS::Missile>::const_iterator baseline_it = baseline.missiles.find (it->first);
+        if (baseline_it != baseline.missiles.cend ()) {
+            if (same_message (baseline_it->second, it->second))
+                continue;
+            RTS::Missile moved = baseline_it->second;
+            *moved.mutable_position () = it->second.position ();
+            if (same_message (moved, it->second)) {
+                RTS::MissileDelta* m_missile_delta = delta.add_missile_deltas ();
+                m_missile_delta->set_id (it->first);
+                *m_missile_delta->mutable_position () = it->second.position ();
+                continue;
+            }
+        }
+        *delta.add_missiles () = it->second;
+    }
+    for (std::map<uint32_t, RTS::Missile>::const_iterator it = baseline.missiles.cbegin (); it != baseline.missiles.cend (); ++it) {
+        if (current.missiles.find (it->first) == current.missiles.cend ())
+            delta.add_removed_missile_ids (it->first);
+    }
+}
+bool apply (const Snapshot& baseline, const RTS::MatchStateDeltaResponse& delta, Snapshot& snapshot, std::string& error_message)
+{
+    if (delta.baseline_tick () != baseline.tick || delta.tick () <= baseline.tick) {
+        error_message = "Mismatched match state delta baseline";
+        return false;
+    }
+    uint32_t ticks = delta.tick () - baseline.tick;
+    snapshot.tick = delta.tick ();
+    snapshot.units = baseline.units;
+    snapshot.corpses = baseline.corpses;
+    snapshot.missiles = baseline.missiles;
+    for (std::map<uint32_t, RTS::Unit>::iterator it = snapshot.units.begin (); it != snapshot.units.end (); ++it)
+        advance_unit (it->second, ticks);
+    for (std::map<uint32_t, RTS::Corpse>::iterator it = snapshot.corpses.begin (); it != snapshot.corpses.end (); ++it)
+        advance_corpse (it->second, ticks);
+
+    for (uint32_t id: delta.removed_unit_ids ())
+        snapshot.units.erase (id);
+    for (const RTS::UnitDelta& m_unit_delta: delta.unit_deltas ()) {
+        std::map<uint32_t, RTS::Unit>::iterator it = snapshot.units.find (m_unit_delta.id ());
+        if (it == snapshot.units.end ()) {
+            error_message = "Match state delta references unknown unit";
+            return false;
+        }
+        apply_unit_delta (m_unit_delta, it->second);
+    }
+    for (const RTS::Unit& unit: delta.units ())
+        snapshot.units[unit.id ()] = unit;
+
+    for (uint32_t id: delta.removed_corpse_ids ())
+        snapshot.corpses.erase (id);
+    for (const RTS::Corpse& corpse: delta.corpses ())
+        snapshot.corpses[corpse.unit ().id ()] = corpse;
+
+    for (uint32_t id: delta.removed_missile_ids ())
+        snapshot.missiles.erase (id);
+    for (const RTS::MissileDelta& m_missile_delta: delta.missile_deltas ()) {
+        std::map<uint32_t, RTS::Missile>::iterator it = snapshot.missiles.find (m_missile_delta.id ());
+        if (it == snapshot.missiles.end ()) {
+            error_message = "Match state delta references unknown missile";
+            return false;
+        }
+        *it->second.mutable_position () = m_missile_delta.position ();
+    }
+    for (const RTS::Missile& missile: delta.missiles ())
+        snapshot.missiles[missile.id ()] = missile;
+    return true;
+}
+
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "responses.pb.h"
+
+#include <deque>
+#include <map>
+#include <string>
+
+
+namespace RTSN::Delta {
+
+struct Snapshot {
+    uint32_t tick = 0;
+    std::map<uint32_t, RTS::Unit> units;
+    std::map<uint32_t, RTS::Corpse> corpses;
+    std::map<uint32_t, RTS::Missile> missiles;
+};
+
+// Last snapshots by tick, kept on both sides so that server can encode against
+// whatever the client acknowledged and client can decode against it. Snapshots more than
+// span_ms older than the newest one are evicted, whatever rate they were sent at
+class SnapshotHistory
+{
+public:
+    static constexpr uint32_t kDefaultSpanMs = 1600;
+
+    SnapshotHistory (uint32_t span_ms = kDefaultSpanMs);
+    // Span is counted in ticks of the match the snapshots come from, the default tick rate until set
+    void setTickRate (uint32_t tick_rate);
+    const Snapshot& push (Snapshot&& snapshot);
+    const Snapshot* find (uint32_t tick) const;
+    void clear ();
+
+private:
+    const uint32_t span_ms;
+    uint32_t span_ticks;
+    std::deque<Snapshot> snapshots;
+};
+
+void capture (const RTS::MatchStateResponse& response, Snapshot& snapshot);
+void restore (const Snapshot& snapshot, RTS::MatchStateResponse& response);
+void encode (const Snapshot& baseline, const Snapshot& current, RTS::MatchStateDeltaResponse& delta);
+bool apply (const Snapshot& baseline, const RTS::MatchStateDeltaResponse& delta, Snapshot& snapshot, std::string& error_message);
+// Field by field comparison, cheaper than comparing serialized entities
+bool same (const RTS::Unit& a, const RTS::Unit& b);
+bool same (const RTS::Corpse& a, const RTS::Corpse& b);
+bool same (const RTS::Missile& a, const RTS::Missile& b);
+
+}
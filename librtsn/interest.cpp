@@ -0,0 +1,111 @@
+#include "interest.h"
+
+#include "matchstate.h"
+
+#include <cmath>
+#include <set>
+
+
+typedef std::pair<int64_t, int64_t> Cell;
+
+static Cell cell_of (const RTS::Vector2D& position)
+{
+    return {int64_t (std::floor (position.x () / RTSN::Interest::kFriendlyRadius)),
+            int64_t (std::floor (position.y () / RTSN::Interest::kFriendlyRadius))};
+}
+static bool inside (const Rectangle& rect, const RTS::Vector2D& position)
+{
+    return position.x () >= rect.left () && position.x () <= rect.right () &&
+        position.y () >= rect.top () && position.y () <= rect.bottom ();
+}
+
+namespace RTSN::Interest {
+
+class Relevance
+{
+public:
+    Relevance (const RTS::MatchStateResponse& response, const Viewer& viewer)
+    {
+        if (viewer.viewport.has_value ()) {
+            const Rectangle& viewport = *viewer.viewport;
+            double margin = viewer.reduced_detail ? 0.0 : kViewportMargin;
+            area = Rectangle (viewport.left () - margin, viewport.right () + margin,
+                              viewport.top () - margin, viewport.bottom () + margin);
+        }
+        for (const RTS::Unit& unit: response.units ()) {
+            if (unit.team () == viewer.team)
+                friendly_cells.insert (cell_of (unit.position ()));
+        }
+    }
+    bool near (const RTS::Vector2D& position) const
+    {
+        if (area.has_value () && inside (*area, position))
+            return true;
+        // Neighbour cells of cell size kFriendlyRadius cover the radius around every friendly unit
+        Cell cell = cell_of (position);
+        for (int64_t dx = -1; dx <= 1; ++dx) {
+            for (int64_t dy = -1; dy <= 1; ++dy) {
+                if (friendly_cells.count ({cell.first + dx, cell.second + dy}))
+                    return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    std::optional<Rectangle> area;
+    std::set<Cell> friendly_cells;
+};
+
+void filter (const RTS::MatchStateResponse& response, const Viewer& viewer, uint32_t tick_rate, RTS::MatchStateResponse& filtered, uint32_t interval_ticks)
+{
+    Relevance relevance (response, viewer);
+    uint32_t refresh_interval = MatchState::ticks (viewer.reduced_detail ? kFarRefreshIntervalMs*2 : kFarRefreshIntervalMs, tick_rate);
+    filtered.set_tick (response.tick ());
+    for (const RTS::Unit& unit: response.units ()) {
+        // Staggered by id so that far refreshes spread evenly over ticks
+        bool refresh = (response.tick () + unit.id ()) % refresh_interval < interval_ticks;
+        if (unit.team () == viewer.team || refresh || relevance.near (unit.position ())) {
+            *filtered.add_units () = unit;
+            continue;
+        }
+        RTS::MinimapUnit* m_minimap_unit = filtered.add_minimap_units ();
+        m_minimap_unit->set_id (unit.id ());
+        m_minimap_unit->set_type (unit.type ());
+        m_minimap_unit->set_team (unit.team ());
+        *m_minimap_unit->mutable_position () = unit.position ();
+        m_minimap_unit->set_health (unit.health ());
+    }
+    for (const RTS::Corpse& corpse: response.corpses ()) {
+        if (relevance.near (corpse.unit ().position ()))
+            *filtered.add_corpses () = corpse;
+    }
+    for (const RTS::Missile& missile: response.missiles ()) {
+        if (relevance.near (missile.position ()) || relevance.near (missile.target_position ()))
+            *filtered.add_missiles () = missile;
+    }
+}
+void expand (RTS::MatchStateResponse& response, std::map<uint32_t, RTS::Unit>& known_units)
+{
+    std::map<uint32_t, RTS::Unit> units;
+    for (const RTS::Unit& unit: response.units ())
+        units[unit.id ()] = unit;
+    for (const RTS::MinimapUnit& m_minimap_unit: response.minimap_units ()) {
+        RTS::Unit* unit = response.add_units ();
+        std::map<uint32_t, RTS::Unit>::const_iterator it = known_units.find (m_minimap_unit.id ());
+        if (it != known_units.cend ()) {
+            *unit = it->second;
+        } else {
+            unit->set_id (m_minimap_unit.id ());
+            unit->set_type (m_minimap_unit.type ());
+            unit->set_team (m_minimap_unit.team ());
+        }
+        *unit->mutable_position () = m_minimap_unit.position ();
+        unit->set_health (m_minimap_unit.health ());
+        units[unit->id ()] = *unit;
+    }
+    response.clear_minimap_units ();
+    known_units.swap (units);
+}
+
+}
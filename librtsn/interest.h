@@ -0,0 +1,34 @@
+#pragma once
+
+#include "responses.pb.h"
+#include "rectangle.h"
+
+#include <map>
+#include <optional>
+
+
+// Server-side area of interest: entities within kViewportMargin of the viewport or
+// roughly kFriendlyRadius of a friendly unit are sent every tick, far units are sent
+// as MinimapUnit records with a full refresh every kFarRefreshIntervalMs and far
+// corpses and missiles are not sent at all. Applies to full snapshots only, delta
+// snapshots must stay complete to serve as baselines and use the viewport to rank
+// changes within the snapshot budget instead (see budget.h)
+namespace RTSN::Interest {
+
+constexpr double kViewportMargin = 8.0;
+constexpr double kFriendlyRadius = 12.0;
+constexpr uint32_t kFarRefreshIntervalMs = 200;
+
+struct Viewer {
+    RTS::Team team;
+    std::optional<Rectangle> viewport;
+    bool reduced_detail = false; // Overloaded server: no viewport margin, far units refreshed half as often
+};
+
+// Snapshots sent every interval_ticks refresh all far units whose turn came since the previous one
+void filter (const RTS::MatchStateResponse& response, const Viewer& viewer, uint32_t tick_rate, RTS::MatchStateResponse& filtered, uint32_t interval_ticks = 1);
+// Turns minimap records back into units using last full state of each unit,
+// known_units is updated with units from the response
+void expand (RTS::MatchStateResponse& response, std::map<uint32_t, RTS::Unit>& known_units);
+
+}
@@ -0,0 +1,562 @@
+#include "packed.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace RTSN::Packed {
+
+enum class ActionTag: uint32_t {
+    None = 0,
+    Attack = 1,
+    Move = 2,
+    Cast = 3,
+    Stop = 4,
+    PerformingAttack = 5,
+    PerformingCast = 6,
+};
+static constexpr unsigned kActionTagBits = 3;
+enum class TargetTag: uint32_t {
+    None = 0,
+    Position = 1,
+    Unit = 2,
+};
+static constexpr unsigned kTargetTagBits = 2;
+static constexpr unsigned kUnitTypeBits = 3;
+static constexpr unsigned kTeamBits = 2;
+static constexpr unsigned kCastTypeBits = 2;
+static constexpr unsigned kMissileTypeBits = 1;
+static constexpr unsigned kMinimapPositionBits = 10;
+
+class BitWriter
+{
+public:
+    BitWriter (std::string& buffer)
+        : buffer (buffer)
+    {
+    }
+    void flush ()
+    {
+        if (used_bits)
+            buffer.push_back (char (pending));
+        pending = 0;
+        used_bits = 0;
+    }
+    // Fills the pending byte a run of bits at a time rather than bit by bit
+    void writeBits (uint64_t value, unsigned count)
+    {
+        while (count) {
+            unsigned chunk = std::min (count, 8 - used_bits);
+            pending |= uint8_t ((value & ((1u << chunk) - 1)) << used_bits);
+            used_bits += chunk;
+            value >>= chunk;
+            count -= chunk;
+            if (used_bits == 8) {
+                buffer.push_back (char (pending));
+                pending = 0;
+                used_bits = 0;
+            }
+        }
+    }
+    void writeBool (bool value)
+    {
+        writeBits (value, 1);
+    }
+    void writeVarint (uint64_t value)
+    {
+        do {
+            writeBits (value & 0x7f, 7);
+            value >>= 7;
+            writeBool (value);
+        } while (value);
+    }
+    void writeSignedVarint (int64_t value)
+    {
+        writeVarint ((uint64_t (value) << 1) ^ uint64_t (value >> 63));
+    }
+
+private:
+    std::string& buffer;
+    uint8_t pending = 0;
+    unsigned used_bits = 0;
+};
+
+class BitReader
+{
+public:
+    BitReader (const std::string& buffer)
+        : buffer (buffer)
+    {
+    }
+    bool readBits (unsigned count, uint64_t& value)
+    {
+        if (position + count > buffer.size () * 8)
+            return false;
+        value = 0;
+        for (unsigned shift = 0; shift < count;) {
+            unsigned offset = position % 8;
+            unsigned chunk = std::min (count - shift, 8 - offset);
+            value |= uint64_t ((uint8_t (buffer[position / 8]) >> offset) & ((1u << chunk) - 1)) << shift;
+            shift += chunk;
+            position += chunk;
+        }
+        return true;
+    }
+    bool readBool (bool& value)
+    {
+        uint64_t bit;
+        if (!readBits (1, bit))
+            return false;
+        value = bit;
+        return true;
+    }
+    bool readVarint (uint64_t& value)
+    {
+        value = 0;
+        for (unsigned shift = 0; shift < 64; shift += 7) {
+            uint64_t group;
+            bool more;
+            if (!readBits (7, group) || !readBool (more))
+                return false;
+            value |= group << shift;
+            if (!more)
+                return true;
+        }
+        return false;
+    }
+    bool readSignedVarint (int64_t& value)
+    {
+        uint64_t zigzag;
+        if (!readVarint (zigzag))
+            return false;
+        value = int64_t (zigzag >> 1) ^ -int64_t (zigzag & 1);
+        return true;
+    }
+
+private:
+    const std::string& buffer;
+    size_t position = 0;
+};
+
+class Quantizer
+{
+public:
+    Quantizer (double left, double right, double top, double bottom)
+        : left (left), top (top), width (right - left), height (bottom - top)
+    {
+    }
+    void write (BitWriter& writer, const RTS::Vector2D& position, unsigned bits = kPositionBits) const
+    {
+        writer.writeBits (quantize (position.x (), left, width, bits), bits);
+        writer.writeBits (quantize (position.y (), top, height, bits), bits);
+    }
+    bool read (BitReader& reader, RTS::Vector2D* position, unsigned bits = kPositionBits) const
+    {
+        uint64_t x, y;
+        if (!reader.readBits (bits, x) || !reader.readBits (bits, y))
+            return false;
+        double max_value = maxValue (bits);
+        position->set_x (left + double (x) / max_value * width);
+        position->set_y (top + double (y) / max_value * height);
+        return true;
+    }
+
+private:
+    static double maxValue (unsigned bits)
+    {
+        return double ((uint64_t (1) << bits) - 1);
+    }
+    static uint64_t quantize (double value, double origin, double extent, unsigned bits)
+    {
+        if (extent <= 0.0)
+            return 0;
+        double max_value = maxValue (bits);
+        double normalized = std::round ((value - origin) / extent * max_value);
+        return uint64_t (std::clamp (normalized, 0.0, max_value));
+    }
+
+    double left;
+    double top;
+    double width;
+    double height;
+};
+
+static void write_orientation (BitWriter& writer, double orientation)
+{
+    constexpr uint64_t steps = uint64_t (1) << kOrientationBits;
+    double turns = orientation / (2.0 * M_PI);
+    turns -= std::floor (turns);
+    writer.writeBits (uint64_t (std::llround (turns * steps)) % steps, kOrientationBits);
+}
+static bool read_orientation (BitReader& reader, double& orientation)
+{
+    constexpr uint64_t steps = uint64_t (1) << kOrientationBits;
+    uint64_t value;
+    if (!reader.readBits (kOrientationBits, value))
+        return false;
+    orientation = double (value) / steps * 2.0 * M_PI;
+    if (orientation > M_PI)
+        orientation -= 2.0 * M_PI;
+    return true;
+}
+template <class TargetedAction>
+static void write_targeted_action (BitWriter& writer, const Quantizer& quantizer, const TargetedAction& m_action)
+{
+    if (m_action.has_position ()) {
+        writer.writeBits (uint32_t (TargetTag::Position), kTargetTagBits);
+        quantizer.write (writer, m_action.position ().position ());
+    } else if (m_action.has_unit ()) {
+        writer.writeBits (uint32_t (TargetTag::Unit), kTargetTagBits);
+        writer.writeVarint (m_action.unit ().id ());
+    } else {
+        writer.writeBits (uint32_t (TargetTag::None), kTargetTagBits);
+    }
+}
+template <class TargetedAction>
+static bool read_targeted_action (BitReader& reader, const Quantizer& quantizer, TargetedAction* m_action)
+{
+    uint64_t tag;
+    if (!reader.readBits (kTargetTagBits, tag))
+        return false;
+    switch (TargetTag (tag)) {
+    case TargetTag::None:
+        return true;
+    case TargetTag::Position:
+        return quantizer.read (reader, m_action->mutable_position ()->mutable_position ());
+    case TargetTag::Unit: {
+        uint64_t id;
+        if (!reader.readVarint (id))
+            return false;
+        m_action->mutable_unit ()->set_id (id);
+    } return true;
+    default:
+        return false;
+    }
+}
+static void write_cast_action (BitWriter& writer, const Quantizer& quantizer, const RTS::CastAction& m_cast_action)
+{
+    quantizer.write (writer, m_cast_action.position ().position ());
+    writer.writeBits (m_cast_action.type (), kCastTypeBits);
+}
+static bool read_cast_action (BitReader& reader, const Quantizer& quantizer, RTS::CastAction* m_cast_action)
+{
+    uint64_t type;
+    if (!quantizer.read (reader, m_cast_action->mutable_position ()->mutable_position ()) || !reader.readBits (kCastTypeBits, type))
+        return false;
+    m_cast_action->set_type (RTS::CastType (type));
+    return true;
+}
+static void write_stop_action (BitWriter& writer, const RTS::StopAction& m_stop_action)
+{
+    writer.writeBool (m_stop_action.has_target ());
+    if (m_stop_action.has_target ())
+        writer.writeVarint (m_stop_action.target ().id ());
+}
+static bool read_stop_action (BitReader& reader, RTS::StopAction* m_stop_action)
+{
+    bool has_target;
+    if (!reader.readBool (has_target))
+        return false;
+    if (!has_target)
+        return true;
+    uint64_t id;
+    if (!reader.readVarint (id))
+        return false;
+    m_stop_action->mutable_target ()->set_id (id);
+    return true;
+}
+// Shared by unit action and next action of performing ones, the latter never nest further
+template <class ActionMessage>
+static void write_basic_action (BitWriter& writer, const Quantizer& quantizer, const ActionMessage& m_action)
+{
+    if (m_action.has_attack ()) {
+        writer.writeBits (uint32_t (ActionTag::Attack), kActionTagBits);
+        write_targeted_action (writer, quantizer, m_action.attack ());
+    } else if (m_action.has_move ()) {
+        writer.writeBits (uint32_t (ActionTag::Move), kActionTagBits);
+        write_targeted_action (writer, quantizer, m_action.move ());
+    } else if (m_action.has_cast ()) {
+        writer.writeBits (uint32_t (ActionTag::Cast), kActionTagBits);
+        write_cast_action (writer, quantizer, m_action.cast ());
+    } else if (m_action.has_stop ()) {
+        writer.writeBits (uint32_t (ActionTag::Stop), kActionTagBits);
+        write_stop_action (writer, m_action.stop ());
+    } else {
+        writer.writeBits (uint32_t (ActionTag::None), kActionTagBits);
+    }
+}
+template <class ActionMessage>
+static bool read_basic_action (BitReader& reader, const Quantizer& quantizer, ActionTag tag, ActionMessage* m_action)
+{
+    switch (tag) {
+    case ActionTag::None:
+        return true;
+    case ActionTag::Attack:
+        return read_targeted_action (reader, quantizer, m_action->mutable_attack ());
+    case ActionTag::Move:
+        return read_targeted_action (reader, quantizer, m_action->mutable_move ());
+    case ActionTag::Cast:
+        return read_cast_action (reader, quantizer, m_action->mutable_cast ());
+    case ActionTag::Stop:
+        return read_stop_action (reader, m_action->mutable_stop ());
+    default:
+        return false;
+    }
+}
+template <class ActionMessage>
+static bool read_next_action (BitReader& reader, const Quantizer& quantizer, ActionMessage* m_action)
+{
+    uint64_t tag;
+    if (!reader.readBits (kActionTagBits, tag))
+        return false;
+    return read_basic_action (reader, quantizer, ActionTag (tag), m_action);
+}
+static void write_unit_action (BitWriter& writer, const Quantizer& quantizer, const RTS::UnitAction& m_action)
+{
+    if (m_action.has_performing_attack ()) {
+        const RTS::PerformingAttackAction& m_performing_attack = m_action.performing_attack ();
+        writer.writeBits (uint32_t (ActionTag::PerformingAttack), kActionTagBits);
+        write_basic_action (writer, quantizer, m_performing_attack);
+        writer.writeSignedVarint (m_performing_attack.remaining_ticks ());
+    } else if (m_action.has_performing_cast ()) {
+        const RTS::PerformingCastAction& m_performing_cast = m_action.performing_cast ();
+        writer.writeBits (uint32_t (ActionTag::PerformingCast), kActionTagBits);
+        write_basic_action (writer, quantizer, m_performing_cast);
+        writer.writeBits (m_performing_cast.cast_type (), kCastTypeBits);
+        writer.writeSignedVarint (m_performing_cast.remaining_ticks ());
+    } else {
+        write_basic_action (writer, quantizer, m_action);
+    }
+}
+static bool read_unit_action (BitReader& reader, const Quantizer& quantizer, RTS::UnitAction* m_action)
+{
+    uint64_t tag;
+    if (!reader.readBits (kActionTagBits, tag))
+        return false;
+    switch (ActionTag (tag)) {
+    case ActionTag::PerformingAttack: {
+        RTS::PerformingAttackAction* m_performing_attack = m_action->mutable_performing_attack ();
+        int64_t remaining_ticks;
+        if (!read_next_action (reader, quantizer, m_performing_attack) || !reader.readSignedVarint (remaining_ticks))
+            return false;
+        m_performing_attack->set_remaining_ticks (remaining_ticks);
+    } return true;
+    case ActionTag::PerformingCast: {
+        RTS::PerformingCastAction* m_performing_cast = m_action->mutable_performing_cast ();
+        uint64_t cast_type;
+        int64_t remaining_ticks;
+        if (!read_next_action (reader, quantizer, m_performing_cast) ||
+            !reader.readBits (kCastTypeBits, cast_type) || !reader.readSignedVarint (remaining_ticks))
+            return false;
+        m_performing_cast->set_cast_type (RTS::CastType (cast_type));
+        m_performing_cast->set_remaining_ticks (remaining_ticks);
+    } return true;
+    default:
+        return read_basic_action (reader, quantizer, ActionTag (tag), m_action);
+    }
+}
+static void write_id (BitWriter& writer, uint32_t id, uint32_t& previous_id)
+{
+    // Entities come sorted by id, so differences stay small
+    writer.writeSignedVarint (int64_t (id) - int64_t (previous_id));
+    previous_id = id;
+}
+static bool read_id (BitReader& reader, uint32_t& id, uint32_t& previous_id)
+{
+    int64_t difference;
+    if (!reader.readSignedVarint (difference))
+        return false;
+    id = previous_id = uint32_t (int64_t (previous_id) + difference);
+    return true;
+}
+static void write_unit (BitWriter& writer, const Quantizer& quantizer, const RTS::Unit& m_unit, uint32_t& previous_id)
+{
+    write_id (writer, m_unit.id (), previous_id);
+    writer.writeBool (m_unit.has_client_id ());
+    if (m_unit.has_client_id ())
+        writer.writeBits (m_unit.client_id ().id (), 32);
+    writer.writeBits (m_unit.type (), kUnitTypeBits);
+    writer.writeBits (m_unit.team (), kTeamBits);
+    quantizer.write (writer, m_unit.position ());
+    write_orientation (writer, m_unit.orientation ());
+    writer.writeVarint (m_unit.health ());
+    write_unit_action (writer, quantizer, m_unit.current_action ());
+    writer.writeVarint (m_unit.attack_remaining_ticks ());
+    writer.writeVarint (m_unit.attack_cooldown_left_ticks ());
+    writer.writeVarint (m_unit.cast_cooldown_left_ticks ());
+    writer.writeBool (m_unit.has_ttl ());
+    if (m_unit.has_ttl ())
+        writer.writeSignedVarint (m_unit.ttl ().ttl_ticks ());
+}
+static bool read_unit (BitReader& reader, const Quantizer& quantizer, RTS::Unit* m_unit, uint32_t& previous_id)
+{
+    uint32_t id;
+    bool has_client_id, has_ttl;
+    uint64_t client_id, type, team, health, attack_remaining_ticks, attack_cooldown_left_ticks, cast_cooldown_left_ticks;
+    double orientation;
+    if (!read_id (reader, id, previous_id) || !reader.readBool (has_client_id))
+        return false;
+    if (has_client_id) {
+        if (!reader.readBits (32, client_id))
+            return false;
+        m_unit->mutable_client_id ()->set_id (client_id);
+    }
+    if (!reader.readBits (kUnitTypeBits, type) || !reader.readBits (kTeamBits, team) ||
+        !quantizer.read (reader, m_unit->mutable_position ()) || !read_orientation (reader, orientation) ||
+        !reader.readVarint (health) || !read_unit_action (reader, quantizer, m_unit->mutable_current_action ()) ||
+        !reader.readVarint (attack_remaining_ticks) || !reader.readVarint (attack_cooldown_left_ticks) ||
+        !reader.readVarint (cast_cooldown_left_ticks) || !reader.readBool (has_ttl))
+        return false;
+    if (has_ttl) {
+        int64_t ttl_ticks;
+        if (!reader.readSignedVarint (ttl_ticks))
+            return false;
+        m_unit->mutable_ttl ()->set_ttl_ticks (ttl_ticks);
+    }
+    m_unit->set_id (id);
+    m_unit->set_type (RTS::UnitType (type));
+    m_unit->set_team (RTS::Team (team));
+    m_unit->set_orientation (orientation);
+    m_unit->set_health (health);
+    m_unit->set_attack_remaining_ticks (attack_remaining_ticks);
+    m_unit->set_attack_cooldown_left_ticks (attack_cooldown_left_ticks);
+    m_unit->set_cast_cooldown_left_ticks (cast_cooldown_left_ticks);
+    return true;
+}
+static void write_missile (BitWriter& writer, const Quantizer& quantizer, const RTS::Missile& m_missile, uint32_t& previous_id)
+{
+    write_id (writer, m_missile.id (), previous_id);
+    writer.writeBits (m_missile.type (), kMissileTypeBits);
+    writer.writeBits (m_missile.team (), kTeamBits);
+    quantizer.write (writer, m_missile.position ());
+    quantizer.write (writer, m_missile.target_position ());
+    writer.writeBool (m_missile.has_target_unit ());
+    if (m_missile.has_target_unit ())
+        writer.writeVarint (m_missile.target_unit ().id ());
+}
+static bool read_missile (BitReader& reader, const Quantizer& quantizer, RTS::Missile* m_missile, uint32_t& previous_id)
+{
+    uint32_t id;
+    uint64_t type, team;
+    bool has_target_unit;
+    if (!read_id (reader, id, previous_id) || !reader.readBits (kMissileTypeBits, type) || !reader.readBits (kTeamBits, team) ||
+        !quantizer.read (reader, m_missile->mutable_position ()) || !quantizer.read (reader, m_missile->mutable_target_position ()) ||
+        !reader.readBool (has_target_unit))
+        return false;
+    if (has_target_unit) {
+        uint64_t target_id;
+        if (!reader.readVarint (target_id))
+            return false;
+        m_missile->mutable_target_unit ()->set_id (target_id);
+    }
+    m_missile->set_id (id);
+    m_missile->set_type (RTS::MissileType (type));
+    m_missile->set_team (RTS::Team (team));
+    return true;
+}
+static void write_minimap_unit (BitWriter& writer, const Quantizer& quantizer, const RTS::MinimapUnit& m_minimap_unit, uint32_t& previous_id)
+{
+    write_id (writer, m_minimap_unit.id (), previous_id);
+    writer.writeBits (m_minimap_unit.type (), kUnitTypeBits);
+    writer.writeBits (m_minimap_unit.team (), kTeamBits);
+    quantizer.write (writer, m_minimap_unit.position (), kMinimapPositionBits);
+    writer.writeVarint (m_minimap_unit.health ());
+}
+static bool read_minimap_unit (BitReader& reader, const Quantizer& quantizer, RTS::MinimapUnit* m_minimap_unit, uint32_t& previous_id)
+{
+    uint32_t id;
+    uint64_t type, team, health;
+    if (!read_id (reader, id, previous_id) || !reader.readBits (kUnitTypeBits, type) || !reader.readBits (kTeamBits, team) ||
+        !quantizer.read (reader, m_minimap_unit->mutable_position (), kMinimapPositionBits) || !reader.readVarint (health))
+        return false;
+    m_minimap_unit->set_id (id);
+    m_minimap_unit->set_type (RTS::UnitType (type));
+    m_minimap_unit->set_team (RTS::Team (team));
+    m_minimap_unit->set_health (health);
+    return true;
+}
+
+void encode (const RTS::MatchStateResponse& response, const Rectangle& area, RTS::PackedMatchStateResponse& packed)
+{
+    packed.set_tick (response.tick ());
+    packed.set_area_left (area.left ());
+    packed.set_area_right (area.right ());
+    packed.set_area_top (area.top ());
+    packed.set_area_bottom (area.bottom ());
+    Quantizer quantizer (area.left (), area.right (), area.top (), area.bottom ());
+
+    std::string* data = packed.mutable_data ();
+    data->clear ();
+    BitWriter writer (*data);
+    writer.writeVarint (response.units_size ());
+    writer.writeVarint (response.corpses_size ());
+    writer.writeVarint (response.missiles_size ());
+    writer.writeVarint (response.minimap_units_size ());
+    uint32_t previous_id = 0;
+    for (const RTS::Unit& m_unit: response.units ())
+        write_unit (writer, quantizer, m_unit, previous_id);
+    previous_id = 0;
+    for (const RTS::Corpse& m_corpse: response.corpses ()) {
+        write_unit (writer, quantizer, m_corpse.unit (), previous_id);
+        writer.writeVarint (m_corpse.decay_remaining_ticks ());
+    }
+    previous_id = 0;
+    for (const RTS::Missile& m_missile: response.missiles ())
+        write_missile (writer, quantizer, m_missile, previous_id);
+    previous_id = 0;
+    for (const RTS::MinimapUnit& m_minimap_unit: response.minimap_units ())
+        write_minimap_unit (writer, quantizer, m_minimap_unit, previous_id);
+    writer.flush ();
+}
+bool decode (const RTS::PackedMatchStateResponse& packed, RTS::MatchStateResponse& response, std::string& error_message)
+{
+    response.set_tick (packed.tick ());
+    Quantizer quantizer (packed.area_left (), packed.area_right (), packed.area_top (), packed.area_bottom ());
+
+    BitReader reader (packed.data ());
+    uint64_t unit_count, corpse_count, missile_count, minimap_unit_count;
+    if (!reader.readVarint (unit_count) || !reader.readVarint (corpse_count) || !reader.readVarint (missile_count) ||
+        !reader.readVarint (minimap_unit_count)) {
+        error_message = "Truncated packed match state header";
+        return false;
+    }
+    // Every entity takes well over a byte, reject counts that cannot fit before allocating
+    if (unit_count + corpse_count + missile_count + minimap_unit_count > packed.data ().size ()) {
+        error_message = "Invalid packed match state entity count";
+        return false;
+    }
+    uint32_t previous_id = 0;
+    for (uint64_t i = 0; i < unit_count; ++i) {
+        if (!read_unit (reader, quantizer, response.add_units (), previous_id)) {
+            error_message = "Truncated packed unit";
+            return false;
+        }
+    }
+    previous_id = 0;
+    for (uint64_t i = 0; i < corpse_count; ++i) {
+        RTS::Corpse* m_corpse = response.add_corpses ();
+        uint64_t decay_remaining_ticks;
+        if (!read_unit (reader, quantizer, m_corpse->mutable_unit (), previous_id) || !reader.readVarint (decay_remaining_ticks)) {
+            error_message = "Truncated packed corpse";
+            return false;
+        }
+        m_corpse->set_decay_remaining_ticks (decay_remaining_ticks);
+    }
+    previous_id = 0;
+    for (uint64_t i = 0; i < missile_count; ++i) {
+        if (!read_missile (reader, quantizer, response.add_missiles (), previous_id)) {
+            error_message = "Truncated packed missile";
+            return false;
+        }
+    }
+    previous_id = 0;
+    for (uint64_t i = 0; i < minimap_unit_count; ++i) {
+        if (!read_minimap_unit (reader, quantizer, response.add_minimap_units (), previous_id)) {
+            error_message = "Truncated packed minimap unit";
+            return false;
+        }
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "responses.pb.h"
+#include "rectangle.h"
+
+#include <string>
+
+
+// Compact bit-packed match state: positions quantized to the arena, orientation to
+// kOrientationBits, counters as varints and actions in tagged form. Lossy, so it is
+// only used for full snapshots where nothing is derived from previous ones.
+namespace RTSN::Packed {
+
+constexpr unsigned kPositionBits = 16;
+constexpr unsigned kOrientationBits = 10;
+
+void encode (const RTS::MatchStateResponse& response, const Rectangle& area, RTS::PackedMatchStateResponse& packed);
+bool decode (const RTS::PackedMatchStateResponse& packed, RTS::MatchStateResponse& response, std::string& error_message);
+
+}
@@ -249,11 +249,10 @@ static std::optional<std::pair<uint32_t, Missile>> parseMissile (const RTS::Miss
     return std::pair<uint32_t, Missile> (id, missile);
 }
 
-namespace RTSN::Parse {
-
-bool matchState (const RTS::MatchStateResponse& response,
-                 std::vector<std::pair<uint32_t, Unit>>& units, std::vector<std::pair<uint32_t, Corpse>>& corpses, std::vector<std::pair<uint32_t, Missile>>& missiles,
-                 std::string& error_message)
+template <typename MatchStateMessage>
+static bool parseEntities (const MatchStateMessage& response,
+                           std::vector<std::pair<uint32_t, Unit>>& units, std::vector<std::pair<uint32_t, Corpse>>& corpses, std::vector<std::pair<uint32_t, Missile>>& missiles,
+                           std::string& error_message)
 {
     for (int i = 0; i < response.units_size (); i++) {
         std::optional<std::pair<uint32_t, Unit>> id_unit = parseUnit (response.units (i), error_message);
@@ -276,4 +275,43 @@ bool matchState (const RTS::MatchStateResponse& response,
     return true;
 }
 
+namespace RTSN::Parse {
+
+bool matchState (const RTS::MatchStateResponse& response,
+                 std::vector<std::pair<uint32_t, Unit>>& units, std::vector<std::pair<uint32_t, Corpse>>& corpses, std::vector<std::pair<uint32_t, Missile>>& missiles,
+                 std::string& error_message)
+{
+    return parseEntities (response, units, corpses, missiles, error_message);
+}
+bool matchStateChunk (const RTS::MatchStateChunkResponse& response,
+                      std::vector<std::pair<uint32_t, Unit>>& units, std::vector<std::pair<uint32_t, Corpse>>& corpses, std::vector<std::pair<uint32_t, Missile>>& missiles,
+                      std::string& error_message)
+{
+    if (response.first_id () > response.last_id () || response.chunk_index () >= response.chunk_count ()) {
+        error_message = "Invalid match state chunk range";
+        return false;
+    }
+    if (!parseEntities (response, units, corpses, missiles, error_message))
+        return false;
+    for (const std::pair<uint32_t, Unit>& unit: units) {
+        if (unit.first < response.first_id () || unit.first > response.last_id ()) {
+            error_message = "Match state chunk entity out of range";
+            return false;
+        }
+    }
+    for (const std::pair<uint32_t, Corpse>& corpse: corpses) {
+        if (corpse.first < response.first_id () || corpse.first > response.last_id ()) {
+            error_message = "Match state chunk entity out of range";
+            return false;
+        }
+    }
+    for (const std::pair<uint32_t, Missile>& missile: missiles) {
+        if (missile.first < response.first_id () || missile.first > response.last_id ()) {
+            error_message = "Match state chunk entity out of range";
+            return false;
+        }
+    }
+    return true;
+}
+
 }
@@ -13,5 +13,8 @@ namespace RTSN::Parse {
 bool matchState (const RTS::MatchStateResponse& response,
                  std::vector<std::pair<uint32_t, Unit>>& units, std::vector<std::pair<uint32_t, Corpse>>& corpses, std::vector<std::pair<uint32_t, Missile>>& missiles,
                  std::string& error_message);
+bool matchStateChunk (const RTS::MatchStateChunkResponse& response,
+                      std::vector<std::pair<uint32_t, Unit>>& units, std::vector<std::pair<uint32_t, Corpse>>& corpses, std::vector<std::pair<uint32_t, Missile>>& missiles,
+                      std::string& error_message);
 
 }
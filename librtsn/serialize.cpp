@@ -1,5 +1,7 @@
 #include "serialize.h"
 
+#include <google/protobuf/io/coded_stream.h>
+
 
 static void fillStopAction (const StopAction& stop_action, RTS::StopAction* m_stop_action)
 {
@@ -94,11 +96,11 @@ static bool fillPerformingCastAction (const PerformingCastAction& performing_cas
     return true;
 }
 static bool fillUnit (uint32_t id, const Unit& unit, RTS::Unit& m_unit,
-                      const std::map<uint32_t, uint32_t>& red_unit_id_client_to_server_map,
-                      const std::map<uint32_t, uint32_t>& blue_unit_id_client_to_server_map)
+                      const std::pmr::map<uint32_t, uint32_t>& red_unit_id_client_to_server_map,
+                      const std::pmr::map<uint32_t, uint32_t>& blue_unit_id_client_to_server_map)
 {
     RTS::Team m_team;
-    const std::map<uint32_t, uint32_t>* unit_id_client_to_server_map;
+    const std::pmr::map<uint32_t, uint32_t>* unit_id_client_to_server_map;
     switch (unit.team) {
     case Unit::Team::Red: {
         m_team = RTS::Team::TEAM_RED;
@@ -113,7 +115,7 @@ static bool fillUnit (uint32_t id, const Unit& unit, RTS::Unit& m_unit,
     }
     m_unit.set_team (m_team);
     {
-        std::map<uint32_t, uint32_t>::const_iterator it = unit_id_client_to_server_map->find (id);
+        std::pmr::map<uint32_t, uint32_t>::const_iterator it = unit_id_client_to_server_map->find (id);
         if (it != unit_id_client_to_server_map->cend ())
             m_unit.mutable_client_id ()->set_id (it->first);
     }
@@ -169,8 +171,8 @@ static bool fillUnit (uint32_t id, const Unit& unit, RTS::Unit& m_unit,
     return true;
 }
 static bool fillCorpse (uint32_t id, const Corpse& corpse, RTS::Corpse& m_corpse,
-                        const std::map<uint32_t, uint32_t>& red_unit_id_client_to_server_map,
-                        const std::map<uint32_t, uint32_t>& blue_unit_id_client_to_server_map)
+                        const std::pmr::map<uint32_t, uint32_t>& red_unit_id_client_to_server_map,
+                        const std::pmr::map<uint32_t, uint32_t>& blue_unit_id_client_to_server_map)
 {
     m_corpse.set_decay_remaining_ticks (corpse.decay_remaining_ticks);
     return fillUnit (id, corpse.unit, *m_corpse.mutable_unit (), red_unit_id_client_to_server_map, blue_unit_id_client_to_server_map);
@@ -212,46 +214,146 @@ static bool fillMissile (uint32_t id, const Missile& missile, RTS::Missile& m_mi
 
     return true;
 }
+static bool visible_to (const MatchState* match_state, const std::optional<Unit::Team>& viewer_team, Unit::Team team, const Position& position)
+{
+    return !viewer_team.has_value () || team == *viewer_team || match_state->visibleTo (*viewer_team, position);
+}
 
 namespace RTSN::Serialize {
 
 void matchState (const MatchState* match_state, RTS::Response& response_oneof,
-                 const std::map<uint32_t, uint32_t>& red_unit_id_client_to_server_map,
-                 const std::map<uint32_t, uint32_t>& blue_unit_id_client_to_server_map)
+                 const std::pmr::map<uint32_t, uint32_t>& red_unit_id_client_to_server_map,
+                 const std::pmr::map<uint32_t, uint32_t>& blue_unit_id_client_to_server_map,
+                 const std::optional<Unit::Team>& viewer_team)
 {
     RTS::MatchStateResponse* response = response_oneof.mutable_match_state ();
 
     response->set_tick (match_state->getTickNo ());
 
     google::protobuf::RepeatedPtrField<RTS::Unit>* m_units = response->mutable_units ();
-    const std::map<uint32_t, Unit>& units = match_state->unitsRef ();
-    for (std::map<uint32_t, Unit>::const_iterator it = units.cbegin (); it != units.cend (); it++) {
+    const std::pmr::map<uint32_t, Unit>& units = match_state->unitsRef ();
+    for (std::pmr::map<uint32_t, Unit>::const_iterator it = units.cbegin (); it != units.cend (); it++) {
         uint32_t id = it->first;
         const Unit& unit = it->second;
+        if (!visible_to (match_state, viewer_team, unit.team, unit.position))
+            continue;
 
         if (!fillUnit (id, unit, *m_units->Add (), red_unit_id_client_to_server_map, blue_unit_id_client_to_server_map))
             m_units->RemoveLast ();
     }
 
     google::protobuf::RepeatedPtrField<RTS::Corpse>* m_corpses = response->mutable_corpses ();
-    const std::map<uint32_t, Corpse>& corpses = match_state->corpsesRef ();
-    for (std::map<uint32_t, Corpse>::const_iterator it = corpses.cbegin (); it != corpses.cend (); it++) {
+    const std::pmr::map<uint32_t, Corpse>& corpses = match_state->corpsesRef ();
+    for (std::pmr::map<uint32_t, Corpse>::const_iterator it = corpses.cbegin (); it != corpses.cend (); it++) {
         uint32_t id = it->first;
         const Corpse& corpse = it->second;
+        if (!visible_to (match_state, viewer_team, corpse.unit.team, corpse.unit.position))
+            continue;
 
         if (!fillCorpse (id, corpse, *m_corpses->Add (), red_unit_id_client_to_server_map, blue_unit_id_client_to_server_map))
             m_corpses->RemoveLast ();
     }
 
     google::protobuf::RepeatedPtrField<RTS::Missile>* m_missiles = response->mutable_missiles ();
-    const std::map<uint32_t, Missile>& missiles = match_state->missilesRef ();
-    for (std::map<uint32_t, Missile>::const_iterator it = missiles.cbegin (); it != missiles.cend (); it++) {
+    const std::pmr::map<uint32_t, Missile>& missiles = match_state->missilesRef ();
+    for (std::pmr::map<uint32_t, Missile>::const_iterator it = missiles.cbegin (); it != missiles.cend (); it++) {
         uint32_t id = it->first;
         const Missile& missile = it->second;
+        if (!visible_to (match_state, viewer_team, missile.sender_team, missile.position))
+            continue;
 
         if (!fillMissile (id, missile, *m_missiles->Add ()))
             m_missiles->RemoveLast ();
     }
 }
 
+void matchStateChunks (const MatchState* match_state, std::vector<RTS::Response>& responses, size_t max_chunk_size,
+                       const std::pmr::map<uint32_t, uint32_t>& red_unit_id_client_to_server_map,
+                       const std::pmr::map<uint32_t, uint32_t>& blue_unit_id_client_to_server_map,
+                       const std::optional<Unit::Team>& viewer_team)
+{
+    const std::pmr::map<uint32_t, Unit>& units = match_state->unitsRef ();
+    const std::pmr::map<uint32_t, Corpse>& corpses = match_state->corpsesRef ();
+    const std::pmr::map<uint32_t, Missile>& missiles = match_state->missilesRef ();
+    std::pmr::map<uint32_t, Unit>::const_iterator unit_it = units.cbegin ();
+    std::pmr::map<uint32_t, Corpse>::const_iterator corpse_it = corpses.cbegin ();
+    std::pmr::map<uint32_t, Missile>::const_iterator missile_it = missiles.cbegin ();
+
+    size_t first_response = responses.size ();
+    RTS::MatchStateChunkResponse* chunk = responses.emplace_back ().mutable_match_state_chunk ();
+    chunk->set_first_id (0);
+    size_t chunk_size = 0;
+    uint32_t chunk_last_entity_id = 0;
+    RTS::Unit m_unit;
+    RTS::Corpse m_corpse;
+    RTS::Missile m_missile;
+    for (;;) {
+        uint32_t id = UINT32_MAX;
+        if (unit_it != units.cend ())
+            id = qMin (id, unit_it->first);
+        if (corpse_it != corpses.cend ())
+            id = qMin (id, corpse_it->first);
+        if (missile_it != missiles.cend ())
+            id = qMin (id, missile_it->first);
+        if (unit_it == units.cend () && corpse_it == corpses.cend () && missile_it == missiles.cend ())
+            break;
+
+        // Corpses keep ids of their units, so the same id may show up twice and must stay within one chunk
+        google::protobuf::MessageLite* entity;
+        if (unit_it != units.cend () && unit_it->first == id) {
+            m_unit.Clear ();
+            const Unit& unit = unit_it->second;
+            bool filled = visible_to (match_state, viewer_team, unit.team, unit.position) &&
+                fillUnit (id, unit, m_unit, red_unit_id_client_to_server_map, blue_unit_id_client_to_server_map);
+            ++unit_it;
+            if (!filled)
+                continue;
+            entity = &m_unit;
+        } else if (corpse_it != corpses.cend () && corpse_it->first == id) {
+            m_corpse.Clear ();
+            const Corpse& corpse = corpse_it->second;
+            bool filled = visible_to (match_state, viewer_team, corpse.unit.team, corpse.unit.position) &&
+                fillCorpse (id, corpse, m_corpse, red_unit_id_client_to_server_map, blue_unit_id_client_to_server_map);
+            ++corpse_it;
+            if (!filled)
+                continue;
+            entity = &m_corpse;
+        } else {
+            m_missile.Clear ();
+            const Missile& missile = missile_it->second;
+            bool filled = visible_to (match_state, viewer_team, missile.sender_team, missile.position) && fillMissile (id, missile, m_missile);
+            ++missile_it;
+            if (!filled)
+                continue;
+            entity = &m_missile;
+        }
+        size_t entity_size = entity->ByteSizeLong ();
+        entity_size += 1 + google::protobuf::io::CodedOutputStream::VarintSize64 (entity_size);
+
+        if (chunk_size && chunk_size + entity_size > max_chunk_size && id > chunk_last_entity_id) {
+            chunk->set_last_id (id - 1);
+            chunk = responses.emplace_back ().mutable_match_state_chunk ();
+            chunk->set_first_id (id);
+            chunk_size = 0;
+        }
+        chunk_size += entity_size;
+        chunk_last_entity_id = id;
+        if (entity == &m_unit)
+            chunk->add_units ()->Swap (&m_unit);
+        else if (entity == &m_corpse)
+            chunk->add_corpses ()->Swap (&m_corpse);
+        else
+            chunk->add_missiles ()->Swap (&m_missile);
+    }
+    chunk->set_last_id (UINT32_MAX);
+
+    uint32_t chunk_count = responses.size () - first_response;
+    for (uint32_t i = 0; i < chunk_count; ++i) {
+        RTS::MatchStateChunkResponse* response = responses[first_response + i].mutable_match_state_chunk ();
+        response->set_tick (match_state->getTickNo ());
+        response->set_chunk_index (i);
+        response->set_chunk_count (chunk_count);
+    }
+}
+
 }
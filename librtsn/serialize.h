@@ -4,12 +4,22 @@
 #include "matchstate.h"
 
 #include <map>
+#include <optional>
+#include <vector>
 
 
+// With viewer_team set only entities of that team and ones it can see are serialized
 namespace RTSN::Serialize {
 
 void matchState (const MatchState* match_state, RTS::Response& response_oneof,
-                 const std::map<uint32_t, uint32_t>& red_unit_id_client_to_server_map,
-                 const std::map<uint32_t, uint32_t>& blue_unit_id_client_to_server_map);
+                 const std::pmr::map<uint32_t, uint32_t>& red_unit_id_client_to_server_map,
+                 const std::pmr::map<uint32_t, uint32_t>& blue_unit_id_client_to_server_map,
+                 const std::optional<Unit::Team>& viewer_team = {});
+// Packs entities into MatchStateChunkResponse messages ordered by id, each chunk payload is
+// kept within max_chunk_size bytes unless a single entity exceeds it
+void matchStateChunks (const MatchState* match_state, std::vector<RTS::Response>& responses, size_t max_chunk_size,
+                       const std::pmr::map<uint32_t, uint32_t>& red_unit_id_client_to_server_map,
+                       const std::pmr::map<uint32_t, uint32_t>& blue_unit_id_client_to_server_map,
+                       const std::optional<Unit::Team>& viewer_team = {});
 
 }
@@ -27,7 +27,7 @@ ActionPanelRenderer::ActionPanelRenderer ()
 }
 
 void ActionPanelRenderer::draw (QOpenGLFunctions& gl, ColoredRenderer& colored_renderer, TexturedRenderer& textured_renderer,
-                                HUD& hud, int margin, const QColor& panel_color, int selected_count, quint64 active_actions, bool contaminator_selected, qint64 cast_cooldown_left_ticks,
+                                HUD& hud, int margin, const QColor& panel_color, int selected_count, quint64 active_actions, bool contaminator_selected, qint64 cast_cooldown_left_ticks, quint32 tick_rate,
                                 const QMatrix4x4& ortho_matrix, const CoordMap& coord_map)
 {
     int area_w = hud.action_panel_rect.width ();
@@ -78,8 +78,8 @@ void ActionPanelRenderer::draw (QOpenGLFunctions& gl, ColoredRenderer& colored_r
                               (active_actions & (1 << quint64 (ActionButtonId::Spawn))) ? textures.active.spawn.get () : textures.basic.spawn.get (),
                               ortho_matrix);
             if (cast_cooldown_left_ticks) {
-                qreal max_cooldown_ticks = qMax (MatchState::effectAttackDescription (AttackDescription::Type::PestilenceMissile).cooldown_ticks,
-                                                 MatchState::effectAttackDescription (AttackDescription::Type::SpawnBeetle).cooldown_ticks);
+                qreal max_cooldown_ticks = MatchState::ticks (qMax (MatchState::effectAttackDescription (AttackDescription::Type::PestilenceMissile).cooldown_ms,
+                                                                    MatchState::effectAttackDescription (AttackDescription::Type::SpawnBeetle).cooldown_ms), tick_rate);
                 qreal remaining = qreal (cast_cooldown_left_ticks) / max_cooldown_ticks;
                 drawActionButtonShade (gl, colored_renderer,
                                        pestilence_button_rect, hud.pressed_action_button == ActionButtonId::Pestilence, remaining,
@@ -18,7 +18,7 @@ class ActionPanelRenderer
 public:
     ActionPanelRenderer ();
     void draw (QOpenGLFunctions& gl, ColoredRenderer& colored_renderer, TexturedRenderer& textured_renderer,
-               HUD& hud, int margin, const QColor& panel_color, int selected_count, quint64 active_actions, bool contaminator_selected, qint64 cast_cooldown_left_ticks,
+               HUD& hud, int margin, const QColor& panel_color, int selected_count, quint64 active_actions, bool contaminator_selected, qint64 cast_cooldown_left_ticks, quint32 tick_rate,
                const QMatrix4x4& ortho_matrix, const CoordMap& coord_map);
 
 private:
@@ -9,6 +9,9 @@
 #include "screens/readinessscreen.h"
 #include "matchstate.h"
 #include "parse.h"
+#include "delta.h"
+#include "packed.h"
+#include "interest.h"
 #include "singlemodeloader.h"
 #include "requests.pb.h"
 
@@ -18,6 +21,65 @@
 #include <QSettings>
 
 
+// Bundle stays within a single default-sized datagram, only a single command larger than that is sent fragmented
+static constexpr size_t kMaxBundledCommands = 8;
+static constexpr size_t kMaxBundleBytes = 400;
+// Field tag and length prefix of a repeated command
+static constexpr size_t kBundleEntryOverhead = 3;
+// Unacknowledged commands beyond this many are given up oldest first, the server is told to skip them
+static constexpr size_t kMaxPendingCommands = 64;
+static constexpr int kCommandResendIntervalMs = 40;
+// Viewport updates are unreliable, the last one is repeated so a lost update does not stick
+static constexpr int kViewportResendIntervalMs = 500;
+
+
+static bool fill_unit_action (const UnitActionVariant& action, RTS::UnitAction& unit_action)
+{
+    if (std::holds_alternative<MoveAction> (action)) {
+        MoveAction move_action = std::get<MoveAction> (action);
+        RTS::MoveAction* move = unit_action.mutable_move ();
+        if (move_action.target.index () == 0) {
+            move->mutable_position ()->mutable_position ()->set_x (std::get<Position> (move_action.target).x ());
+            move->mutable_position ()->mutable_position ()->set_y (std::get<Position> (move_action.target).y ());
+        } else {
+            move->mutable_unit ()->set_id (std::get<quint32> (move_action.target));
+        }
+    } else if (std::holds_alternative<AttackAction> (action)) {
+        AttackAction attack_action = std::get<AttackAction> (action);
+        RTS::AttackAction* attack = unit_action.mutable_attack ();
+        if (attack_action.target.index () == 0) {
+            attack->mutable_position ()->mutable_position ()->set_x (std::get<Position> (attack_action.target).x ());
+            attack->mutable_position ()->mutable_position ()->set_y (std::get<Position> (attack_action.target).y ());
+        } else {
+            attack->mutable_unit ()->set_id (std::get<quint32> (attack_action.target));
+        }
+    } else if (std::holds_alternative<CastAction> (action)) {
+        CastAction cast_action = std::get<CastAction> (action);
+        RTS::CastAction* cast = unit_action.mutable_cast ();
+        cast->mutable_position ()->mutable_position ()->set_x (cast_action.target.x ());
+        cast->mutable_position ()->mutable_position ()->set_y (cast_action.target.y ());
+        switch (cast_action.type) {
+        case (CastAction::Type::Pestilence): {
+            cast->set_type (RTS::CastType::CAST_TYPE_PESTILENCE);
+        } break;
+        case (CastAction::Type::SpawnBeetle): {
+            cast->set_type (RTS::CastType::CAST_TYPE_SPAWN_BEETLE);
+        } break;
+        default: {
+            return false;
+        }
+        }
+    } else if (std::holds_alternative<StopAction> (action)) {
+        StopAction stop_action = std::get<StopAction> (action);
+        RTS::StopAction* stop = unit_action.mutable_stop ();
+        if (stop_action.current_target.has_value ()) {
+            stop->mutable_target ()->set_id (stop_action.current_target.value ());
+        }
+    }
+    return true;
+}
+
+
 Application::Application (int& argc, char** argv)
     : QApplication (argc, argv)
 {
@@ -41,6 +103,8 @@ Application::Application (int& argc, char** argv)
 
     network_thread.reset (new NetworkThread (this));
     connect (&*network_thread, &NetworkThread::datagramReceived, this, &Application::sessionDatagramHandler);
+    connect (&command_resend_timer, &QTimer::timeout, this, &Application::sendCommandBundle);
+    connect (&viewport_resend_timer, &QTimer::timeout, this, &Application::sendViewport);
 }
 Application::~Application ()
 {
@@ -70,7 +134,7 @@ void Application::selectRolePlayer ()
     RTS::SelectRoleRequest* request = request_oneof.mutable_select_role ();
     request->set_role (RTS::Role::ROLE_PLAYER);
     std::string message = request_oneof.SerializeAsString ();
-    network_thread->sendDatagram ({this->host_address, this->port, session_id.value (), request_id++, {message.data (), message.data () + message.size ()}});
+    network_thread->sendDatagram ({this->host_address, this->port, session_id.value (), request_id++, {message.data (), message.data () + message.size ()}, true});
 }
 void Application::readinessCallback ()
 {
@@ -78,7 +142,7 @@ void Application::readinessCallback ()
     RTS::ReadyRequest* request = request_oneof.mutable_ready ();
     (void) request;
     std::string message = request_oneof.SerializeAsString ();
-    network_thread->sendDatagram ({this->host_address, this->port, session_id.value (), request_id++, {message.data (), message.data () + message.size ()}});
+    network_thread->sendDatagram ({this->host_address, this->port, session_id.value (), request_id++, {message.data (), message.data () + message.size ()}, true});
 }
 void Application::matchStartCallback ()
 {
@@ -121,11 +185,19 @@ void Application::loginCallback (const AuthorizationCredentials& credentials) //
     RTS::AuthorizationRequest* request = request_oneof.mutable_authorization ();
     request->set_login (credentials.login.toStdString ());
     request->set_password (credentials.password.toStdString ());
+    {
+        QSettings settings ("HC Software", "RTS Client");
+        request->set_max_datagram_size (settings.value ("network/max_datagram_size", 0).toUInt ());
+        request->set_path_mtu_discovery (settings.value ("network/path_mtu_discovery", true).toBool ());
+        request->set_fec_group_size (settings.value ("network/fec_group_size", 8).toUInt ());
+        // No path MTU probing towards the server, so this stays at the safe default unless configured
+        network_thread->setMaxDatagramSize (settings.value ("network/request_datagram_size", 0).toUInt ());
+    }
 
     std::string message;
     request_oneof.SerializeToString (&message);
 
-    network_thread->sendDatagram ({this->host_address, this->port, {}, request_id++, {message.data (), message.data () + message.size ()}});
+    network_thread->sendDatagram ({this->host_address, this->port, {}, request_id++, {message.data (), message.data () + message.size ()}, true});
 
     setCurrentWindow (authorization_progress_screen);
 }
@@ -137,11 +209,15 @@ void Application::createRoomCallback (const QString& name)
     RTS::Request request_oneof;
     RTS::CreateRoomRequest* request = request_oneof.mutable_create_room ();
     request->set_name (name.toStdString ());
+    {
+        QSettings settings ("HC Software", "RTS Client");
+        request->set_tick_rate (settings.value ("room/tick_rate", 0).toUInt ());
+    }
 
     std::string message;
     request_oneof.SerializeToString (&message);
 
-    network_thread->sendDatagram ({this->host_address, this->port, session_id.value (), request_id++, {message.data (), message.data () + message.size ()}});
+    network_thread->sendDatagram ({this->host_address, this->port, session_id.value (), request_id++, {message.data (), message.data () + message.size ()}, true});
 }
 void Application::joinRoomCallback (quint32 room_id)
 {
@@ -151,11 +227,34 @@ void Application::joinRoomCallback (quint32 room_id)
     RTS::Request request_oneof;
     RTS::JoinRoomRequest* request = request_oneof.mutable_join_room ();
     request->set_room_id (room_id);
+    {
+        QSettings settings ("HC Software", "RTS Client");
+        QString snapshot_mode_name = settings.value ("network/snapshot_mode", "delta").toString ();
+        if (snapshot_mode_name == "chunked")
+            snapshot_mode = RTS::SNAPSHOT_MODE_CHUNKED;
+        else if (snapshot_mode_name == "delta")
+            snapshot_mode = RTS::SNAPSHOT_MODE_DELTA;
+        else
+            snapshot_mode = RTS::SNAPSHOT_MODE_FULL;
+        request->set_snapshot_mode (snapshot_mode);
+        bool packed_snapshots = settings.value ("network/packed_snapshots", true).toBool ();
+        request->set_snapshot_encoding (packed_snapshots ? RTS::SNAPSHOT_ENCODING_PACKED : RTS::SNAPSHOT_ENCODING_PROTOBUF);
+        request->set_snapshot_budget (settings.value ("network/snapshot_budget", 204800).toUInt ());
+        request->set_snapshot_rate (settings.value ("network/snapshot_rate", 20).toUInt ());
+        redundant_commands = settings.value ("network/redundant_commands", true).toBool ();
+    }
+    snapshot_history.clear ();
+    known_units.clear ();
+    last_tick = 0;
+    next_command_sequence = 1;
+    skipped_command_sequence = 0;
+    pending_commands.clear ();
+    command_resend_timer.stop ();
 
     std::string message;
     request_oneof.SerializeToString (&message);
 
-    network_thread->sendDatagram ({this->host_address, this->port, session_id.value (), request_id++, {message.data (), message.data () + message.size ()}});
+    network_thread->sendDatagram ({this->host_address, this->port, session_id.value (), request_id++, {message.data (), message.data () + message.size ()}, true});
 }
 void Application::roleSelectedCallback ()
 {
@@ -196,7 +295,7 @@ void Application::createUnitCallback (Unit::Team /* team */, Unit::Type type, co
     std::string message;
     request_oneof.SerializeToString (&message);
 
-    network_thread->sendDatagram ({this->host_address, this->port, session_id.value (), request_id++, {message.data (), message.data () + message.size ()}});
+    network_thread->sendDatagram ({this->host_address, this->port, session_id.value (), request_id++, {message.data (), message.data () + message.size ()}, true});
 }
 void Application::savedCredentials (const QVector<AuthorizationCredentials>& credentials)
 {
@@ -221,52 +320,131 @@ void Application::unitActionCallback (quint32 id, const UnitActionVariant& actio
     RTS::Request request_oneof;
     RTS::UnitActionRequest* request = request_oneof.mutable_unit_action ();
     request->set_unit_id (id);
-    RTS::UnitAction* unit_action = request->mutable_action ();
-    if (std::holds_alternative<MoveAction> (action)) {
-        MoveAction move_action = std::get<MoveAction> (action);
-        RTS::MoveAction* move = unit_action->mutable_move ();
-        if (move_action.target.index () == 0) {
-            move->mutable_position ()->mutable_position ()->set_x (std::get<Position> (move_action.target).x ());
-            move->mutable_position ()->mutable_position ()->set_y (std::get<Position> (move_action.target).y ());
-        } else {
-            move->mutable_unit ()->set_id (std::get<quint32> (move_action.target));
-        }
-    } else if (std::holds_alternative<AttackAction> (action)) {
-        AttackAction attack_action = std::get<AttackAction> (action);
-        RTS::AttackAction* attack = unit_action->mutable_attack ();
-        if (attack_action.target.index () == 0) {
-            attack->mutable_position ()->mutable_position ()->set_x (std::get<Position> (attack_action.target).x ());
-            attack->mutable_position ()->mutable_position ()->set_y (std::get<Position> (attack_action.target).y ());
-        } else {
-            attack->mutable_unit ()->set_id (std::get<quint32> (attack_action.target));
-        }
-    } else if (std::holds_alternative<CastAction> (action)) {
-        CastAction cast_action = std::get<CastAction> (action);
-        RTS::CastAction* cast = unit_action->mutable_cast ();
-        cast->mutable_position ()->mutable_position ()->set_x (cast_action.target.x ());
-        cast->mutable_position ()->mutable_position ()->set_y (cast_action.target.y ());
-        switch (cast_action.type) {
-        case (CastAction::Type::Pestilence): {
-            cast->set_type (RTS::CastType::CAST_TYPE_PESTILENCE);
-        } break;
-        case (CastAction::Type::SpawnBeetle): {
-            cast->set_type (RTS::CastType::CAST_TYPE_SPAWN_BEETLE);
-        } break;
-        default: {
-            return;
-        }
-        }
-    } else if (std::holds_alternative<StopAction> (action)) {
-        StopAction stop_action = std::get<StopAction> (action);
-        RTS::StopAction* stop = unit_action->mutable_stop ();
-        if (stop_action.current_target.has_value ()) {
-            stop->mutable_target ()->set_id (stop_action.current_target.value ());
-        }
+    if (!fill_unit_action (action, *request->mutable_action ()))
+        return;
+
+    sendCommand (request_oneof);
+}
+void Application::groupActionCallback (const std::vector<quint32>& unit_ids, const UnitActionVariant& action)
+{
+    if (!session_id.has_value ())
+        return;
+
+    RTS::Request request_oneof;
+    RTS::GroupUnitActionRequest* request = request_oneof.mutable_group_unit_action ();
+    // Selection comes in map order, deltas of ascending ids fit in a byte or two each
+    quint32 previous_id = 0;
+    for (quint32 unit_id: unit_ids) {
+        request->add_unit_id_deltas (unit_id - previous_id);
+        previous_id = unit_id;
+    }
+    if (!fill_unit_action (action, *request->mutable_action ()))
+        return;
+
+    sendCommand (request_oneof);
+}
+void Application::viewportCallback (const Rectangle& viewport)
+{
+    this->viewport = viewport;
+    sendViewport ();
+}
+void Application::sendViewport ()
+{
+    if (!session_id.has_value () || !viewport.has_value ()) {
+        viewport_resend_timer.stop ();
+        return;
+    }
+
+    RTS::Request request_oneof;
+    RTS::ViewportUpdateRequest* request = request_oneof.mutable_viewport_update ();
+    request->set_left (viewport->left ());
+    request->set_right (viewport->right ());
+    request->set_top (viewport->top ());
+    request->set_bottom (viewport->bottom ());
+    request->set_sequence (++viewport_sequence);
+
+    std::string message;
+    request_oneof.SerializeToString (&message);
+
+    // Reliable delivery is unordered, a retransmitted old viewport could override a newer one
+    network_thread->sendDatagram ({this->host_address, this->port, session_id.value (), request_id++, {message.data (), message.data () + message.size ()}});
+    viewport_resend_timer.start (kViewportResendIntervalMs);
+}
+void Application::sendCommand (const RTS::Request& request_oneof)
+{
+    if (!redundant_commands) {
+        std::string message;
+        request_oneof.SerializeToString (&message);
+
+        network_thread->sendDatagram ({this->host_address, this->port, session_id.value (), request_id++, {message.data (), message.data () + message.size ()}, true});
+        return;
+    }
+
+    RTS::Command command;
+    command.set_sequence (next_command_sequence++);
+    command.set_tick (last_tick);
+    if (request_oneof.has_unit_action ())
+        *command.mutable_unit_action () = request_oneof.unit_action ();
+    else if (request_oneof.has_group_unit_action ())
+        *command.mutable_group_unit_action () = request_oneof.group_unit_action ();
+    else
+        return;
+    pending_commands.push_back (std::move (command));
+    if (pending_commands.size () > kMaxPendingCommands) {
+        skipped_command_sequence = pending_commands.front ().sequence ();
+        pending_commands.pop_front ();
+    }
+    sendCommandBundle ();
+}
+void Application::sendCommandBundle ()
+{
+    if (!session_id.has_value () || pending_commands.empty ()) {
+        command_resend_timer.stop ();
+        return;
+    }
+
+    // Server applies commands strictly in sequence, so the oldest unacknowledged ones go first
+    RTS::Request request_oneof;
+    RTS::CommandBundleRequest* request = request_oneof.mutable_command_bundle ();
+    request->set_skipped_sequence (skipped_command_sequence);
+    size_t bundle_bytes = 0;
+    for (size_t i = 0; i < pending_commands.size () && i < kMaxBundledCommands; ++i) {
+        size_t command_bytes = pending_commands[i].ByteSizeLong () + kBundleEntryOverhead;
+        if (i && bundle_bytes + command_bytes > kMaxBundleBytes)
+            break;
+        bundle_bytes += command_bytes;
+        *request->add_commands () = pending_commands[i];
+    }
+
+    std::string message;
+    request_oneof.SerializeToString (&message);
+
+    // Lost bundle is covered by the next one, no retransmission timeout to wait for
+    network_thread->sendDatagram ({this->host_address, this->port, session_id.value (), request_id++, {message.data (), message.data () + message.size ()}});
+    command_resend_timer.start (kCommandResendIntervalMs);
+}
+void Application::snapshotReceived (quint32 tick)
+{
+    // Server sends snapshots at a requested rate lowered on bad links, the observed gap drives interpolation
+    if (last_tick && tick > last_tick && tick - last_tick != snapshot_interval_ticks) {
+        snapshot_interval_ticks = tick - last_tick;
+        emit snapshotIntervalChanged (snapshot_interval_ticks);
     }
+    last_tick = tick;
+}
+void Application::sendSnapshotAck (quint32 tick)
+{
+    if (!session_id.has_value ())
+        return;
+
+    RTS::Request request_oneof;
+    RTS::SnapshotAckRequest* request = request_oneof.mutable_snapshot_ack ();
+    request->set_tick (tick);
 
     std::string message;
     request_oneof.SerializeToString (&message);
 
+    // Lost ack only delays switching to a newer baseline, the next one supersedes it
     network_thread->sendDatagram ({this->host_address, this->port, session_id.value (), request_id++, {message.data (), message.data () + message.size ()}});
 }
 
@@ -297,7 +475,7 @@ void Application::sessionDatagramHandler (const std::shared_ptr<HCCN::ServerToCl
             std::string message;
             request_oneof.SerializeToString (&message);
 
-            network_thread->sendDatagram ({this->host_address, this->port, *this->session_id, request_id++, {message.data (), message.data () + message.size ()}});
+            network_thread->sendDatagram ({this->host_address, this->port, *this->session_id, request_id++, {message.data (), message.data () + message.size ()}, true});
         } break;
         default: {
             QString message = "Response -> AuthorizationResponse -> UNKNOWN #" + QString::number (response.response_case ());
@@ -354,10 +532,21 @@ void Application::sessionDatagramHandler (const std::shared_ptr<HCCN::ServerToCl
         }
     } break;
     case RTS::Response::MessageCase::kMatchStart: {
-        emit startMatch ();
+        const RTS::MatchStartResponse& response = response_oneof.match_start ();
+        // Baselines and command sequences of the previous match are useless, the server starts both over
+        snapshot_history.clear ();
+        snapshot_history.setTickRate (response.tick_rate () ? response.tick_rate () : MatchState::kDefaultTickRate);
+        known_units.clear ();
+        last_tick = 0;
+        next_command_sequence = 1;
+        skipped_command_sequence = 0;
+        pending_commands.clear ();
+        command_resend_timer.stop ();
+        emit startMatch (response.tick_rate () ? response.tick_rate () : MatchState::kDefaultTickRate);
     } break;
     case RTS::Response::MessageCase::kMatchState: {
-        const RTS::MatchStateResponse& response = response_oneof.match_state ();
+        RTS::MatchStateResponse& response = *response_oneof.mutable_match_state ();
+        RTSN::Interest::expand (response, known_units);
         std::vector<std::pair<quint32, Unit>> units;
         std::vector<std::pair<quint32, Corpse>> corpses;
         std::vector<std::pair<quint32, Missile>> missiles;
@@ -367,7 +556,86 @@ void Application::sessionDatagramHandler (const std::shared_ptr<HCCN::ServerToCl
             return;
         }
         emit updateMatchState (units, corpses, missiles);
-        last_tick = response.tick ();
+        snapshotReceived (response.tick ());
+        if (snapshot_mode == RTS::SNAPSHOT_MODE_DELTA) {
+            RTSN::Delta::Snapshot snapshot;
+            RTSN::Delta::capture (response, snapshot);
+            snapshot_history.push (std::move (snapshot));
+            sendSnapshotAck (response.tick ());
+        }
+    } break;
+    case RTS::Response::MessageCase::kMatchStateDelta: {
+        const RTS::MatchStateDeltaResponse& response = response_oneof.match_state_delta ();
+        if (response.tick () <= last_tick)
+            break;
+        // Baseline may already be evicted from history, wait for delta against a newer ack
+        const RTSN::Delta::Snapshot* baseline = snapshot_history.find (response.baseline_tick ());
+        if (!baseline)
+            break;
+        RTSN::Delta::Snapshot snapshot;
+        std::string error_message;
+        if (!RTSN::Delta::apply (*baseline, response, snapshot, error_message)) {
+            QMessageBox::critical (nullptr, "Malformed message from server", QString::fromStdString (error_message));
+            return;
+        }
+        RTS::MatchStateResponse match_state;
+        RTSN::Delta::restore (snapshot, match_state);
+        std::vector<std::pair<quint32, Unit>> units;
+        std::vector<std::pair<quint32, Corpse>> corpses;
+        std::vector<std::pair<quint32, Missile>> missiles;
+        if (!RTSN::Parse::matchState (match_state, units, corpses, missiles, error_message)) {
+            QMessageBox::critical (nullptr, "Malformed message from server", QString::fromStdString (error_message));
+            return;
+        }
+        emit updateMatchState (units, corpses, missiles);
+        snapshotReceived (response.tick ());
+        snapshot_history.push (std::move (snapshot));
+        sendSnapshotAck (response.tick ());
+    } break;
+    case RTS::Response::MessageCase::kPackedMatchState: {
+        const RTS::PackedMatchStateResponse& response = response_oneof.packed_match_state ();
+        RTS::MatchStateResponse match_state;
+        std::string error_message;
+        if (!RTSN::Packed::decode (response, match_state, error_message)) {
+            QMessageBox::critical (nullptr, "Malformed message from server", QString::fromStdString (error_message));
+            return;
+        }
+        RTSN::Interest::expand (match_state, known_units);
+        std::vector<std::pair<quint32, Unit>> units;
+        std::vector<std::pair<quint32, Corpse>> corpses;
+        std::vector<std::pair<quint32, Missile>> missiles;
+        if (!RTSN::Parse::matchState (match_state, units, corpses, missiles, error_message)) {
+            QMessageBox::critical (nullptr, "Malformed message from server", QString::fromStdString (error_message));
+            return;
+        }
+        emit updateMatchState (units, corpses, missiles);
+        snapshotReceived (response.tick ());
+    } break;
+    case RTS::Response::MessageCase::kMatchStateChunk: {
+        const RTS::MatchStateChunkResponse& response = response_oneof.match_state_chunk ();
+        // Chunks of a newer tick already replaced this range
+        if (response.tick () < last_tick)
+            break;
+        std::vector<std::pair<quint32, Unit>> units;
+        std::vector<std::pair<quint32, Corpse>> corpses;
+        std::vector<std::pair<quint32, Missile>> missiles;
+        std::string error_message;
+        if (!RTSN::Parse::matchStateChunk (response, units, corpses, missiles, error_message)) {
+            QMessageBox::critical (nullptr, "Malformed message from server", QString::fromStdString (error_message));
+            return;
+        }
+        emit updateMatchStateRange (response.first_id (), response.last_id (), units, corpses, missiles);
+        snapshotReceived (response.tick ());
+    } break;
+    case RTS::Response::MessageCase::kCommandAck: {
+        const RTS::CommandAckResponse& response = response_oneof.command_ack ();
+        // Late ack of the previous match, sequences restarted with this one
+        if (response.sequence () >= next_command_sequence)
+            break;
+        while (!pending_commands.empty () && pending_commands.front ().sequence () <= response.sequence ())
+            pending_commands.pop_front ();
+        if (pending_commands.empty ())
+            command_resend_timer.stop ();
     } break;
     case RTS::Response::MessageCase::kError: {
         const RTS::ErrorResponse& response = response_oneof.error ();
@@ -414,8 +682,12 @@ void Application::showRoom (bool single_mode)
     connect (this, &Application::startMatch, room_widget, &RoomWidget::startMatchHandler);
     connect (this, &Application::startCountdown, room_widget, &RoomWidget::startCountDownHandler);
     connect (this, &Application::updateMatchState, room_widget, &RoomWidget::loadMatchState);
+    connect (this, &Application::updateMatchStateRange, room_widget, &RoomWidget::loadMatchStateRange);
+    connect (this, &Application::snapshotIntervalChanged, room_widget, &RoomWidget::setSnapshotInterval);
     connect (room_widget, &RoomWidget::createUnitRequested, this, &Application::createUnitCallback);
     connect (room_widget, &RoomWidget::unitActionRequested, this, &Application::unitActionCallback);
+    connect (room_widget, &RoomWidget::groupActionRequested, this, &Application::groupActionCallback);
+    connect (room_widget, &RoomWidget::viewportChanged, this, &Application::viewportCallback);
     connect (this, &Application::log, room_widget, &RoomWidget::log);
     setCurrentWindow (room_widget, true);
 
@@ -2,12 +2,16 @@
 
 #include "network_thread.h"
 #include "roomentry.h"
+#include "requests.pb.h"
 #include "responses.pb.h"
 #include "roomwidget.h"
+#include "delta.h"
 #include "authorizationcredentials.h"
 
 #include <QApplication>
 #include <QSharedPointer>
+#include <QTimer>
+#include <deque>
 
 class QNetworkDatagram;
 class MainWindow;
@@ -25,8 +29,11 @@ signals:
     void roomListUpdated (const QVector<RoomEntry>& room_list);
     void queryReadiness ();
     void startCountdown (Unit::Team team);
-    void startMatch ();
+    void startMatch (quint32 tick_rate);
     void updateMatchState (const std::vector<std::pair<quint32, Unit>>& units, const std::vector<std::pair<quint32, Corpse>>& corpses, const std::vector<std::pair<quint32, Missile>>& missiles);
+    void updateMatchStateRange (quint32 first_id, quint32 last_id,
+                                const std::vector<std::pair<quint32, Unit>>& units, const std::vector<std::pair<quint32, Corpse>>& corpses, const std::vector<std::pair<quint32, Missile>>& missiles);
+    void snapshotIntervalChanged (quint32 ticks);
     void log (const QString& message);
 
 private:
@@ -54,9 +61,16 @@ private slots:
     void createUnitCallback (Unit::Team team, Unit::Type type, const Position& positon);
     void savedCredentials (const QVector<AuthorizationCredentials>& credentials);
     void unitActionCallback (quint32 id, const UnitActionVariant& action);
+    void groupActionCallback (const std::vector<quint32>& unit_ids, const UnitActionVariant& action);
+    void viewportCallback (const Rectangle& viewport);
+    void sendViewport ();
+    void sendCommandBundle ();
 
 private:
     void selectRolePlayer ();
+    void sendSnapshotAck (quint32 tick);
+    void snapshotReceived (quint32 tick);
+    void sendCommand (const RTS::Request& request_oneof);
     bool single_mode = false;
     MainWindow* main_window = nullptr;
     QSharedPointer<NetworkThread> network_thread;
@@ -66,4 +80,16 @@ private:
     std::optional<quint64> session_id;
     quint64 request_id = 0;
     quint32 last_tick = 0;
+    quint32 snapshot_interval_ticks = 1;
+    RTS::SnapshotMode snapshot_mode = RTS::SNAPSHOT_MODE_FULL;
+    RTSN::Delta::SnapshotHistory snapshot_history;
+    std::map<quint32, RTS::Unit> known_units;
+    bool redundant_commands = false;
+    quint32 next_command_sequence = 1;
+    quint32 skipped_command_sequence = 0;
+    std::deque<RTS::Command> pending_commands;
+    QTimer command_resend_timer;
+    std::optional<Rectangle> viewport;
+    quint32 viewport_sequence = 0;
+    QTimer viewport_resend_timer;
 };
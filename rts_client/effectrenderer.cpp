@@ -23,7 +23,7 @@ EffectRenderer::EffectRenderer ()
     textures.pestilence_splash.splash = loadTexture2D (":/images/effects/pestilence-splash/splash.png");
 }
 
-void EffectRenderer::drawExplosion (QOpenGLFunctions& gl, ColoredTexturedRenderer& colored_textured_renderer, const Explosion& explosion, quint64 clock_ns,
+void EffectRenderer::drawExplosion (QOpenGLFunctions& gl, ColoredTexturedRenderer& colored_textured_renderer, const Explosion& explosion, quint64 clock_ns, quint32 tick_rate,
                                     const QMatrix4x4& ortho_matrix, const CoordMap& coord_map)
 {
     const AttackDescription& attack_description = MatchState::effectAttackDescription (AttackDescription::Type::GoonRocketExplosion);
@@ -40,7 +40,7 @@ void EffectRenderer::drawExplosion (QOpenGLFunctions& gl, ColoredTexturedRendere
     }
 
     qreal orientation = 0.0;
-    GLfloat alpha = explosion.remaining_ticks * 0.5 / attack_description.duration_ticks;
+    GLfloat alpha = explosion.remaining_ticks * 0.5 / MatchState::ticks (attack_description.duration_ms, tick_rate);
 
     quint64 period = explosionAnimationPeriodNS ();
     quint64 phase = clock_ns % period;
@@ -15,7 +15,7 @@ class EffectRenderer
 {
 public:
     EffectRenderer ();
-    void drawExplosion (QOpenGLFunctions& gl, ColoredTexturedRenderer& colored_textured_renderer, const Explosion& explosion, quint64 clock_ns,
+    void drawExplosion (QOpenGLFunctions& gl, ColoredTexturedRenderer& colored_textured_renderer, const Explosion& explosion, quint64 clock_ns, quint32 tick_rate,
                         const QMatrix4x4& ortho_matrix, const CoordMap& coord_map);
     void drawMissile (QOpenGLFunctions& gl, TexturedRenderer& textured_renderer, const Missile& missile, quint64 clock_ns,
                       const QMatrix4x4& ortho_matrix, const CoordMap& coord_map);
@@ -28,8 +28,8 @@ void GroupOverlayRenderer::draw (QOpenGLFunctions& gl, ColoredRenderer& colored_
     Unit::Type group_unit_counts[GROUP_COUNT];
     for (qint64 i = 0; i < GROUP_COUNT; ++i)
         group_unit_counts[i] = Unit::Type::Beetle;
-    const std::map<quint32, Unit>& units = match_state.unitsRef ();
-    for (std::map<quint32, Unit>::const_iterator it = units.cbegin (); it != units.cend (); ++it) {
+    const std::pmr::map<quint32, Unit>& units = match_state.unitsRef ();
+    for (std::pmr::map<quint32, Unit>::const_iterator it = units.cbegin (); it != units.cend (); ++it) {
         const Unit& unit = it->second;
         quint64 groups = unit.groups;
         for (qint64 i = 0; i < GROUP_COUNT; ++i) {
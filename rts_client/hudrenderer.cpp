@@ -322,8 +322,8 @@ void HUDRenderer::draw (QOpenGLFunctions& gl, ColoredRenderer& colored_renderer,
     qint64 cast_cooldown_left_ticks = 0x7fffffffffffffffLL;
     quint64 active_actions = 0;
     const Unit* last_selected_unit = nullptr;
-    const std::map<quint32, Unit>& units = match_state.unitsRef ();
-    for (std::map<quint32, Unit>::const_iterator it = units.cbegin (); it != units.cend (); ++it) {
+    const std::pmr::map<quint32, Unit>& units = match_state.unitsRef ();
+    for (std::pmr::map<quint32, Unit>::const_iterator it = units.cbegin (); it != units.cend (); ++it) {
         const Unit& unit = it->second;
         if (unit.selected) {
             if (std::holds_alternative<AttackAction> (unit.action) || std::holds_alternative<PerformingAttackAction> (unit.action)) {
@@ -368,6 +368,6 @@ void HUDRenderer::draw (QOpenGLFunctions& gl, ColoredRenderer& colored_renderer,
     selection_panel_renderer->draw (gl, colored_textured_renderer, device, hud.selection_panel_rect, selected_count, last_selected_unit, hud, match_state, ortho_matrix);
     group_overlay_renderer->draw (gl, colored_renderer, colored_textured_renderer, device, hud, match_state, ortho_matrix);
     action_panel_renderer->draw (gl, colored_renderer, textured_renderer,
-                                 hud, margin, panel_color, selected_count, active_actions, contaminator_selected, cast_cooldown_left_ticks,
+                                 hud, margin, panel_color, selected_count, active_actions, contaminator_selected, cast_cooldown_left_ticks, match_state.tickRate (),
                                  ortho_matrix, coord_map);
 }
@@ -1,12 +1,18 @@
 #include "network_manager.h"
 
+#include "control.h"
+
 #include <QThread>
 #include <QUdpSocket>
 #include <QCoreApplication>
 #include <QNetworkDatagram>
 
-NetworkManager::NetworkManager (QObject* parent)
+NetworkManager::NetworkManager (HCCN::SpscChannel<std::shared_ptr<HCCN::ServerToClient::Message>>& received,
+                                HCCN::SpscChannel<HCCN::ClientToServer::Message>& outgoing, QObject* parent)
     : QObject (parent)
+    , received (received)
+    , outgoing (outgoing)
+    , outgoing_notifier (outgoing.fd (), QSocketNotifier::Read)
 {
 }
 
@@ -16,21 +22,24 @@ bool NetworkManager::start (QString& error_message)
         error_message = socket.errorString ();
         return false;
     }
+    clock.start ();
     connect (&socket, &QUdpSocket::readyRead, this, &NetworkManager::recieveDatagrams);
-    connect (this, &NetworkManager::sendDatagram, this, &NetworkManager::sendDatagramHandler);
+    connect (&outgoing_notifier, &QSocketNotifier::activated, this, &NetworkManager::sendQueuedDatagrams);
+    connect (&retransmit_timer, &QTimer::timeout, this, &NetworkManager::retransmitHandler);
+    retransmit_timer.start (kRetransmitCheckIntervalMs);
     return true;
 }
-std::shared_ptr<HCCN::ServerToClient::Message> NetworkManager::takeDatagram ()
-{
-    QMutexLocker locker (&input_queue_mutex);
-    return input_queue.isEmpty () ? nullptr : input_queue.dequeue ();
-}
 void NetworkManager::recieveDatagrams ()
 {
     while (socket.hasPendingDatagrams ()) {
         QNetworkDatagram datagram = socket.receiveDatagram ();
+        if (HCCN::Control::isControl (datagram)) {
+            std::optional<QNetworkDatagram> inner = controlDatagramHandler (datagram);
+            if (!inner.has_value ())
+                continue;
+            datagram = *inner;
+        }
         if (std::shared_ptr<HCCN::ServerToClient::MessageFragment> message_fragment = HCCN::ServerToClient::MessageFragment::parse (datagram)) {
-            QMutexLocker locker (&input_queue_mutex);
             HCCN::TransportMessageIdentifier transport_message_identifier (message_fragment->host, message_fragment->port, message_fragment->response_id);
             QHash<HCCN::TransportMessageIdentifier, std::shared_ptr<HCCN::ServerToClient::MessageFragmentCollector>>::iterator fragment_collector_it =
                 input_fragment_queue.find (transport_message_identifier);
@@ -39,26 +48,100 @@ void NetworkManager::recieveDatagrams ()
                     HCCN::ServerToClient::MessageFragmentCollector& fragment_collector = **fragment_collector_it;
                     fragment_collector.insert (message_fragment);
                     if (fragment_collector.complete ()) {
-                        input_queue.enqueue (fragment_collector.build ());
+                        deliver (fragment_collector.build ());
                         fragment_collector_it->reset ();
                     }
                 }
             } else {
-                std::shared_ptr<HCCN::ServerToClient::MessageFragmentCollector> fragment_collector (new HCCN::ServerToClient::MessageFragmentCollector);
+                std::shared_ptr<HCCN::ServerToClient::MessageFragmentCollector> fragment_collector = HCCN::makePooled<HCCN::ServerToClient::MessageFragmentCollector> ();
                 fragment_collector->insert (message_fragment);
                 if (fragment_collector->complete ()) {
-                    input_queue.enqueue (fragment_collector->build ());
+                    deliver (fragment_collector->build ());
                     fragment_collector.reset ();
                 }
                 input_fragment_queue.insert (transport_message_identifier, fragment_collector);
             }
         }
     }
-    emit datagramsReady ();
+    for (const QNetworkDatagram& ack: reliable_transport.takeAcks ())
+        socket.writeDatagram (ack);
+    if (received_pending) {
+        received.notify ();
+        received_pending = false;
+    }
+}
+void NetworkManager::deliver (const std::shared_ptr<HCCN::ServerToClient::Message>& message)
+{
+    received.push (message);
+    received_pending = true;
+}
+std::optional<QNetworkDatagram> NetworkManager::controlDatagramHandler (const QNetworkDatagram& datagram)
+{
+    std::optional<HCCN::Control::Type> type = HCCN::Control::parseType (datagram);
+    if (!type.has_value ())
+        return {};
+
+    switch (*type) {
+    case HCCN::Control::Type::PathMtuProbe: {
+        uint64_t probe_id;
+        size_t size;
+        if (HCCN::Control::parsePathMtuProbe (datagram, probe_id, size))
+            socket.writeDatagram (HCCN::Control::encodePathMtuProbeAck (datagram.senderAddress (), datagram.senderPort (), probe_id, size));
+    } break;
+    case HCCN::Control::Type::PathMtuProbeAck: {
+    } break;
+    case HCCN::Control::Type::Reliable:
+    case HCCN::Control::Type::SelectiveAck: {
+        return reliable_transport.receive (datagram, clock.elapsed ());
+    }
+    case HCCN::Control::Type::Parity: {
+        parityFragmentHandler (datagram);
+    } break;
+    }
+    return {};
+}
+void NetworkManager::parityFragmentHandler (const QNetworkDatagram& datagram)
+{
+    std::shared_ptr<HCCN::ServerToClient::ParityFragment> parity_fragment = HCCN::ServerToClient::ParityFragment::parse (datagram);
+    if (!parity_fragment)
+        return;
+
+    HCCN::TransportMessageIdentifier transport_message_identifier (parity_fragment->host, parity_fragment->port, parity_fragment->response_id);
+    QHash<HCCN::TransportMessageIdentifier, std::shared_ptr<HCCN::ServerToClient::MessageFragmentCollector>>::iterator fragment_collector_it =
+        input_fragment_queue.find (transport_message_identifier);
+    if (fragment_collector_it == input_fragment_queue.end ())
+        fragment_collector_it = input_fragment_queue.insert (transport_message_identifier,
+                                                             HCCN::makePooled<HCCN::ServerToClient::MessageFragmentCollector> ());
+    if (!*fragment_collector_it)
+        return;
+    HCCN::ServerToClient::MessageFragmentCollector& fragment_collector = **fragment_collector_it;
+    fragment_collector.insertParity (parity_fragment);
+    if (fragment_collector.complete ()) {
+        deliver (fragment_collector.build ());
+        fragment_collector_it->reset ();
+    }
 }
-void NetworkManager::sendDatagramHandler (const HCCN::ClientToServer::Message& transport_message)
+void NetworkManager::retransmitHandler ()
 {
-    std::vector<QNetworkDatagram> datagrams = transport_message.encode ();
+    for (const QNetworkDatagram& datagram: reliable_transport.retransmissions (clock.elapsed ()))
+        socket.writeDatagram (datagram);
+}
+void NetworkManager::sendQueuedDatagrams ()
+{
+    outgoing.clear ();
+    HCCN::ClientToServer::Message transport_message;
+    while (outgoing.pop (transport_message))
+        sendDatagram (transport_message);
+}
+void NetworkManager::sendDatagram (const HCCN::ClientToServer::Message& transport_message)
+{
+    if (transport_message.reliable) {
+        for (const QNetworkDatagram& datagram: transport_message.encode (transport_message.max_datagram_size - HCCN::Control::kReliableOverhead))
+            if (std::optional<QNetworkDatagram> wrapped = reliable_transport.wrap (transport_message.host, transport_message.port, datagram.data (), clock.elapsed ()))
+                socket.writeDatagram (*wrapped);
+        return;
+    }
+    std::vector<QNetworkDatagram> datagrams = transport_message.encode (transport_message.max_datagram_size);
     for (const QNetworkDatagram& datagram: datagrams)
         socket.writeDatagram (datagram);
 }
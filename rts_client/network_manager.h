@@ -1,34 +1,48 @@
 #pragma once
 
 #include "client_to_server.h"
+#include "reliable_channel.h"
 #include "server_to_client.h"
+#include "spsc_channel.h"
 
+#include <QElapsedTimer>
+#include <QTimer>
 #include <QUdpSocket>
 #include <QNetworkDatagram>
-#include <QQueue>
-#include <QMutex>
+#include <QSocketNotifier>
 
 class NetworkManager: public QObject
 {
     Q_OBJECT
 
 public:
-    NetworkManager (QObject* parent = nullptr);
+    // Received messages go to the main thread through received, outgoing ones come back from it
+    NetworkManager (HCCN::SpscChannel<std::shared_ptr<HCCN::ServerToClient::Message>>& received,
+                    HCCN::SpscChannel<HCCN::ClientToServer::Message>& outgoing, QObject* parent = nullptr);
     bool start (QString& error_message);
-    std::shared_ptr<HCCN::ServerToClient::Message> takeDatagram ();
-
-signals:
-    void sendDatagram (const HCCN::ClientToServer::Message& transport_message);
-    void datagramsReady ();
 
 private:
+    HCCN::SpscChannel<std::shared_ptr<HCCN::ServerToClient::Message>>& received;
+    HCCN::SpscChannel<HCCN::ClientToServer::Message>& outgoing;
+    QSocketNotifier outgoing_notifier;
+    bool received_pending = false;
     QUdpSocket socket;
     int return_code = 0;
     QHash<HCCN::TransportMessageIdentifier, std::shared_ptr<HCCN::ServerToClient::MessageFragmentCollector>> input_fragment_queue;
-    QQueue<std::shared_ptr<HCCN::ServerToClient::Message>> input_queue;
-    QMutex input_queue_mutex;
+    HCCN::ReliableTransport reliable_transport;
+    QElapsedTimer clock;
+    QTimer retransmit_timer;
+
+    static constexpr int kRetransmitCheckIntervalMs = 10;
+
+private:
+    std::optional<QNetworkDatagram> controlDatagramHandler (const QNetworkDatagram& datagram);
+    void parityFragmentHandler (const QNetworkDatagram& datagram);
+    void deliver (const std::shared_ptr<HCCN::ServerToClient::Message>& message);
+    void sendDatagram (const HCCN::ClientToServer::Message& transport_message);
 
 private slots:
     void recieveDatagrams ();
-    void sendDatagramHandler (const HCCN::ClientToServer::Message& transport_message);
+    void retransmitHandler ();
+    void sendQueuedDatagrams ();
 };
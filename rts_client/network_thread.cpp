@@ -7,7 +7,9 @@
 
 NetworkThread::NetworkThread (QObject* parent)
     : QThread (parent)
+    , received_notifier (received.fd (), QSocketNotifier::Read)
 {
+    connect (&received_notifier, &QSocketNotifier::activated, this, &NetworkThread::recieveDatagrams);
 }
 
 const QString& NetworkThread::errorMessage ()
@@ -16,23 +18,29 @@ const QString& NetworkThread::errorMessage ()
 }
 void NetworkThread::sendDatagram (const HCCN::ClientToServer::Message& datagram)
 {
-    emit sendDatagramSignal (datagram);
+    HCCN::ClientToServer::Message message = datagram;
+    message.max_datagram_size = max_datagram_size;
+    outgoing.push (std::move (message));
+    outgoing.notify ();
+}
+void NetworkThread::setMaxDatagramSize (size_t max_datagram_size)
+{
+    this->max_datagram_size = HCCN::clampDatagramSize (max_datagram_size);
 }
 void NetworkThread::run ()
 {
-    NetworkManager network_manager;
+    NetworkManager network_manager (received, outgoing);
     if (!network_manager.start (error_message)) {
         return_code = 1;
         return;
     }
-    connect (this, &NetworkThread::sendDatagramSignal, &network_manager, &NetworkManager::sendDatagram, Qt::QueuedConnection);
-    connect (&network_manager, &NetworkManager::datagramsReady, this, &NetworkThread::recieveDatagrams, Qt::QueuedConnection);
     return_code = exec ();
 }
 void NetworkThread::recieveDatagrams ()
 {
-    NetworkManager* network_manager = (NetworkManager*) sender ();
-    while (std::shared_ptr<HCCN::ServerToClient::Message> network_message = network_manager->takeDatagram ()) {
+    received.clear ();
+    std::shared_ptr<HCCN::ServerToClient::Message> network_message;
+    while (received.pop (network_message)) {
         emit datagramReceived (network_message);
     }
 }
@@ -2,11 +2,14 @@
 
 #include "client_to_server.h"
 #include "server_to_client.h"
+#include "spsc_channel.h"
 
 #include <QThread>
 #include <QUdpSocket>
 #include <QNetworkDatagram>
+#include <QSocketNotifier>
 
+// Messages cross between the main thread and this one through lock-free queues with eventfd wakeups
 class NetworkThread: public QThread
 {
     Q_OBJECT
@@ -14,10 +17,11 @@ class NetworkThread: public QThread
 public:
     NetworkThread (QObject* parent = nullptr);
     const QString& errorMessage ();
+    // Main thread only, datagrams are cut to the size set here
     void sendDatagram (const HCCN::ClientToServer::Message& datagram);
+    void setMaxDatagramSize (size_t max_datagram_size);
 
 signals:
-    void sendDatagramSignal (const HCCN::ClientToServer::Message& datagram);
     void datagramReceived (const std::shared_ptr<HCCN::ServerToClient::Message>& datagram);
 
 protected:
@@ -26,6 +30,12 @@ protected:
     int return_code = 0;
     QString error_message;
 
+private:
+    HCCN::SpscChannel<std::shared_ptr<HCCN::ServerToClient::Message>> received {"network_to_main"};
+    HCCN::SpscChannel<HCCN::ClientToServer::Message> outgoing {"main_to_network"};
+    QSocketNotifier received_notifier;
+    size_t max_datagram_size = HCCN::kDefaultMaxDatagramSize;
+
 private slots:
     void recieveDatagrams ();
 };
@@ -31,6 +31,8 @@ static constexpr qreal PI_X_3_4 = 3.0 / 4.0 * M_PI;
 static constexpr qreal PI_X_1_4 = 1.0 / 4.0 * M_PI;
 
 static constexpr qint64 group_count = 20;
+// Client running behind the match clock by more ticks than this skips the rest
+static constexpr quint64 kMaxCatchUpTicks = 4;
 static constexpr qreal POINTS_PER_VIEWPORT_VERTICALLY = 20.0; // At zoom x1.0
 #define MAP_TO_SCREEN_FACTOR (coord_map.arena_viewport.height () / POINTS_PER_VIEWPORT_VERTICALLY)
 
@@ -98,6 +100,10 @@ void RoomWidget::unitActionCallback (quint32 id, const UnitActionVariant& action
 {
     emit unitActionRequested (id, action);
 }
+void RoomWidget::groupActionCallback (const std::vector<quint32>& unit_ids, const UnitActionVariant& action)
+{
+    emit groupActionRequested (unit_ids, action);
+}
 void RoomWidget::unitCreateCallback (Unit::Team team, Unit::Type type, const Position& position)
 {
     emit createUnitRequested (team, type, position);
@@ -109,9 +115,9 @@ void RoomWidget::startCountDownHandler (Unit::Team team)
 {
     awaitMatch (team);
 }
-void RoomWidget::startMatchHandler ()
+void RoomWidget::startMatchHandler (quint32 tick_rate)
 {
-    startMatch (this->team);
+    startMatch (this->team, tick_rate);
 }
 void RoomWidget::awaitMatch (Unit::Team team)
 {
@@ -121,17 +127,22 @@ void RoomWidget::awaitMatch (Unit::Team team)
     match_timer.stop ();
     starting_countdown = true;
 }
-void RoomWidget::startMatch (Unit::Team team)
+void RoomWidget::startMatch (Unit::Team team, quint32 tick_rate)
 {
     this->team = team;
+    match_state.setTickRate (tick_rate);
     pressed_button = ButtonId::None;
     connect (&match_state, &MatchState::unitActionRequested, this, &RoomWidget::unitActionCallback);
+    connect (&match_state, &MatchState::groupActionRequested, this, &RoomWidget::groupActionCallback);
     connect (&match_state, &MatchState::unitCreateRequested, this, &RoomWidget::unitCreateCallback);
     connect (&match_state, SIGNAL (soundEventEmitted (SoundEvent)), this, SLOT (playSound (SoundEvent)));
     coord_map.viewport_scale_power = 0;
     coord_map.viewport_scale = 1.0;
     coord_map.viewport_center = {};
-    match_timer.start (20);
+    match_ticks = 0;
+    match_clock.start ();
+    match_timer.setTimerType (Qt::PreciseTimer);
+    match_timer.start (1000/tick_rate);
     last_frame.restart ();
     starting_countdown = false;
 }
@@ -139,6 +150,15 @@ void RoomWidget::loadMatchState (const std::vector<std::pair<quint32, Unit>>& un
 {
     match_state.loadState (units, corpses, missiles);
 }
+void RoomWidget::loadMatchStateRange (quint32 first_id, quint32 last_id,
+                                      const std::vector<std::pair<quint32, Unit>>& units, const std::vector<std::pair<quint32, Corpse>>& corpses, const std::vector<std::pair<quint32, Missile>>& missiles)
+{
+    match_state.loadStateRange (first_id, last_id, units, corpses, missiles);
+}
+void RoomWidget::setSnapshotInterval (quint32 ticks)
+{
+    match_state.setCorrectionTicks (ticks);
+}
 QSharedPointer<QOpenGLTexture> RoomWidget::loadTexture2DRectangle (const QString& path)
 {
     QImage image = QImage (path).convertToFormat (QImage::Format_RGBA8888);
@@ -713,7 +733,21 @@ void RoomWidget::drawCountdownOverlay ()
 }
 void RoomWidget::tick ()
 {
-    match_state.tick ();
+    // Millisecond timer can't hit every tick rate exactly, run as many ticks as are due
+    quint64 due_ticks = match_clock.nsecsElapsed ()*match_state.tickRate ()/1000000000;
+    if (due_ticks > match_ticks + kMaxCatchUpTicks)
+        match_ticks = due_ticks - kMaxCatchUpTicks;
+    for (; match_ticks < due_ticks; ++match_ticks)
+        match_state.tick ();
+
+    // Server only needs the viewport for area of interest, skip small camera movements
+    Rectangle viewport = coord_map.toMapCoords (coord_map.arena_viewport);
+    if (!reported_viewport.has_value () ||
+        qAbs (viewport.left () - reported_viewport->left ()) + qAbs (viewport.top () - reported_viewport->top ()) +
+        qAbs (viewport.width () - reported_viewport->width ()) + qAbs (viewport.height () - reported_viewport->height ()) >= 1.0) {
+        reported_viewport = viewport;
+        emit viewportChanged (viewport);
+    }
 }
 void RoomWidget::playSound (SoundEvent event)
 {
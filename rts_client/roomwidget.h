@@ -50,7 +50,7 @@ public:
     RoomWidget (QWidget* parent = nullptr);
     virtual ~RoomWidget ();
     void awaitMatch (Unit::Team team);
-    void startMatch (Unit::Team team);
+    void startMatch (Unit::Team team, quint32 tick_rate = MatchState::kDefaultTickRate);
 #ifdef LOG_OVERLAY
     inline void log (const QString& message)
     {
@@ -70,17 +70,23 @@ signals:
     void quitRequested ();
     void createUnitRequested (Unit::Team team, Unit::Type type, const Position& position);
     void unitActionRequested (quint32 id, const UnitActionVariant& action);
+    void groupActionRequested (const std::vector<quint32>& unit_ids, const UnitActionVariant& action);
+    void viewportChanged (const Rectangle& viewport);
 
 private slots:
     void quitRequestedHandler ();
 
 public slots:
-    void startMatchHandler ();
+    void startMatchHandler (quint32 tick_rate);
     void startCountDownHandler (Unit::Team team);
     void loadMatchState (const std::vector<std::pair<quint32, Unit>>& units, const std::vector<std::pair<quint32, Corpse>>& corpses, const std::vector<std::pair<quint32, Missile>>& missiles);
+    void loadMatchStateRange (quint32 first_id, quint32 last_id,
+                              const std::vector<std::pair<quint32, Unit>>& units, const std::vector<std::pair<quint32, Corpse>>& corpses, const std::vector<std::pair<quint32, Missile>>& missiles);
+    void setSnapshotInterval (quint32 ticks);
     // void unitActionCallback (quint32 id, ActionType type, std::variant<QPointF, quint32> target);
 
     void unitActionCallback (quint32 id, const UnitActionVariant& action);
+    void groupActionCallback (const std::vector<quint32>& unit_ids, const UnitActionVariant& action);
     void unitCreateCallback (Unit::Team team, Unit::Type type, const Position& position);
 
 protected:
@@ -164,6 +170,8 @@ private:
     MatchState match_state;
     int mouse_scroll_border = 10;
     QTimer match_timer;
+    QElapsedTimer match_clock; // Timer only wakes the widget, ticks are counted against this clock
+    quint64 match_ticks = 0;
     QElapsedTimer last_frame;
     std::optional<QPoint> selection_start;
     bool camera_move_modifier_pressed = false;
@@ -172,6 +180,7 @@ private:
     bool shift_pressed = false;
     std::mt19937 random_generator;
     CoordMap coord_map;
+    std::optional<Rectangle> reported_viewport;
     QColor red_player_color = QColor (0xf1, 0x4b, 0x2c);
     QColor blue_player_color = QColor (0x48, 0xc0, 0xbb);
     QSharedPointer<ColoredRenderer> colored_renderer;
@@ -79,37 +79,37 @@ void SceneRenderer::drawCorpses (QOpenGLFunctions& gl, TexturedRenderer& texture
                                  MatchState& match_state,
                                  const QMatrix4x4& ortho_matrix, const CoordMap& coord_map)
 {
-    const std::map<quint32, Corpse>& corpses = match_state.corpsesRef ();
-    for (std::map<quint32, Corpse>::const_iterator it = corpses.cbegin (); it != corpses.cend (); ++it)
+    const std::pmr::map<quint32, Corpse>& corpses = match_state.corpsesRef ();
+    for (std::pmr::map<quint32, Corpse>::const_iterator it = corpses.cbegin (); it != corpses.cend (); ++it)
         unit_set_renderer->drawCorpse (gl, textured_renderer, it->second, ortho_matrix, coord_map);
 }
 void SceneRenderer::drawUnits (QOpenGLFunctions& gl, TexturedRenderer& textured_renderer, ColoredTexturedRenderer& colored_textured_renderer,
                                MatchState& match_state,
                                const QMatrix4x4& ortho_matrix, const CoordMap& coord_map)
 {
-    const std::map<quint32, Unit>& units = match_state.unitsRef ();
-    for (std::map<quint32, Unit>::const_iterator it = units.cbegin (); it != units.cend (); ++it)
-        unit_set_renderer->draw (gl, textured_renderer, colored_textured_renderer, it->second, match_state.clockNS (), ortho_matrix, coord_map);
+    const std::pmr::map<quint32, Unit>& units = match_state.unitsRef ();
+    for (std::pmr::map<quint32, Unit>::const_iterator it = units.cbegin (); it != units.cend (); ++it)
+        unit_set_renderer->draw (gl, textured_renderer, colored_textured_renderer, it->second, match_state.clockNS (), match_state.tickRate (), ortho_matrix, coord_map);
 }
 void SceneRenderer::drawUnitSelection (QOpenGLFunctions& gl, ColoredRenderer& colored_renderer,
                                        MatchState& match_state,
                                        const QMatrix4x4& ortho_matrix, const CoordMap& coord_map)
 {
-    const std::map<quint32, Unit>& units = match_state.unitsRef ();
-    for (std::map<quint32, Unit>::const_iterator it = units.cbegin (); it != units.cend (); ++it)
+    const std::pmr::map<quint32, Unit>& units = match_state.unitsRef ();
+    for (std::pmr::map<quint32, Unit>::const_iterator it = units.cbegin (); it != units.cend (); ++it)
         unit_set_renderer->drawSelection (gl, colored_renderer, it->second, ortho_matrix, coord_map);
 }
 void SceneRenderer::drawEffects (QOpenGLFunctions& gl, ColoredTexturedRenderer& colored_textured_renderer, TexturedRenderer& textured_renderer,
                                  MatchState& match_state,
                                  const QMatrix4x4& ortho_matrix, const CoordMap& coord_map)
 {
-    const std::map<quint32, Missile>& missiles = match_state.missilesRef ();
-    for (std::map<quint32, Missile>::const_iterator it = missiles.cbegin (); it != missiles.cend (); ++it)
+    const std::pmr::map<quint32, Missile>& missiles = match_state.missilesRef ();
+    for (std::pmr::map<quint32, Missile>::const_iterator it = missiles.cbegin (); it != missiles.cend (); ++it)
         effect_renderer->drawMissile (gl, textured_renderer, it->second, match_state.clockNS (), ortho_matrix, coord_map);
 
-    const std::map<quint32, Explosion>& explosions = match_state.explosionsRef ();
-    for (std::map<quint32, Explosion>::const_iterator it = explosions.cbegin (); it != explosions.cend (); ++it)
-        effect_renderer->drawExplosion (gl, colored_textured_renderer, it->second, match_state.clockNS (), ortho_matrix, coord_map);
+    const std::pmr::map<quint32, Explosion>& explosions = match_state.explosionsRef ();
+    for (std::pmr::map<quint32, Explosion>::const_iterator it = explosions.cbegin (); it != explosions.cend (); ++it)
+        effect_renderer->drawExplosion (gl, colored_textured_renderer, it->second, match_state.clockNS (), match_state.tickRate (), ortho_matrix, coord_map);
 }
 void SceneRenderer::drawUnitPaths (QOpenGLFunctions& gl, ColoredRenderer& colored_renderer,
                                    MatchState& match_state, Unit::Team team,
@@ -117,8 +117,8 @@ void SceneRenderer::drawUnitPaths (QOpenGLFunctions& gl, ColoredRenderer& colore
 {
     QVector<GLfloat> vertices;
     QVector<GLfloat> colors;
-    const std::map<quint32, Unit>& units = match_state.unitsRef ();
-    for (std::map<quint32, Unit>::const_iterator it = units.cbegin (); it != units.cend (); ++it) {
+    const std::pmr::map<quint32, Unit>& units = match_state.unitsRef ();
+    for (std::pmr::map<quint32, Unit>::const_iterator it = units.cbegin (); it != units.cend (); ++it) {
         const Unit& unit = it->second;
         const Position* target_position;
         if (unit.team == team && (target_position = getUnitTargetPosition (unit, match_state))) {
@@ -154,8 +154,8 @@ void SceneRenderer::drawUnitStats (QOpenGLFunctions& gl, ColoredRenderer& colore
                                    MatchState& match_state,
                                    const QMatrix4x4& ortho_matrix, const CoordMap& coord_map)
 {
-    const std::map<quint32, Unit>& units = match_state.unitsRef ();
-    for (std::map<quint32, Unit>::const_iterator it = units.cbegin (); it != units.cend (); ++it)
+    const std::pmr::map<quint32, Unit>& units = match_state.unitsRef ();
+    for (std::pmr::map<quint32, Unit>::const_iterator it = units.cbegin (); it != units.cend (); ++it)
         unit_set_renderer->drawHPBar (gl, colored_renderer, it->second, ortho_matrix, coord_map);
 }
 void SceneRenderer::drawSelectionBar (QOpenGLFunctions& gl, ColoredRenderer& colored_renderer,
@@ -182,8 +182,8 @@ void SceneRenderer::drawActionMarkers (QOpenGLFunctions& gl, TexturedRenderer& t
     std::set<uint32_t> attack_units;
     std::set<Position> cast_points;
 
-    const std::map<uint32_t, Unit>& units = match_state.unitsRef ();
-    for (std::map<uint32_t, Unit>::const_iterator it = units.begin (); it != units.end (); ++it) {
+    const std::pmr::map<uint32_t, Unit>& units = match_state.unitsRef ();
+    for (std::pmr::map<uint32_t, Unit>::const_iterator it = units.begin (); it != units.end (); ++it) {
         const Unit& unit = it->second;
         if (unit.team == team && unit.selected) {
             const UnitActionVariant& action = unit.action;
@@ -263,7 +263,7 @@ void SceneRenderer::drawActionMarkers (QOpenGLFunctions& gl, TexturedRenderer& t
         textured_renderer.fillRectangle (gl, screen_position.x () - texture->width () / 2, screen_position.y () - texture->height () / 2, texture, ortho_matrix);
     }
     for (const uint32_t& unit_id: move_units) {
-        std::map<uint32_t, Unit>::const_iterator unit_it = units.find (unit_id);
+        std::pmr::map<uint32_t, Unit>::const_iterator unit_it = units.find (unit_id);
         if (unit_it != units.end ()) {
             const Unit& unit = unit_it->second;
             QOpenGLTexture* texture = &*textures.action_markers.movement;
@@ -279,7 +279,7 @@ void SceneRenderer::drawActionMarkers (QOpenGLFunctions& gl, TexturedRenderer& t
         textured_renderer.fillRectangle (gl, screen_position.x () - texture->width () / 2, screen_position.y () - texture->height () / 2, texture, ortho_matrix);
     }
     for (const uint32_t& unit_id: attack_units) {
-        std::map<uint32_t, Unit>::const_iterator unit_it = units.find (unit_id);
+        std::pmr::map<uint32_t, Unit>::const_iterator unit_it = units.find (unit_id);
         if (unit_it != units.end ()) {
             const Unit& unit = unit_it->second;
             QOpenGLTexture* texture = &*textures.action_markers.attack;
@@ -317,8 +317,8 @@ const Position* SceneRenderer::getUnitTargetPosition (const UnitActionVariant& u
             return &std::get<Position> (action_target);
         } else if (std::holds_alternative<quint32> (action_target)) {
             quint32 target_unit_id = std::get<quint32> (action_target);
-            const std::map<quint32, Unit>& units = match_state.unitsRef ();
-            std::map<quint32, Unit>::const_iterator target_unit_it = units.find (target_unit_id);
+            const std::pmr::map<quint32, Unit>& units = match_state.unitsRef ();
+            std::pmr::map<quint32, Unit>::const_iterator target_unit_it = units.find (target_unit_id);
             if (target_unit_it != units.end ()) {
                 const Unit& target_unit = target_unit_it->second;
                 return &target_unit.position;
@@ -330,8 +330,8 @@ const Position* SceneRenderer::getUnitTargetPosition (const UnitActionVariant& u
             return &std::get<Position> (action_target);
         } else if (std::holds_alternative<quint32> (action_target)) {
             quint32 target_unit_id = std::get<quint32> (action_target);
-            const std::map<quint32, Unit>& units = match_state.unitsRef ();
-            std::map<quint32, Unit>::const_iterator target_unit_it = units.find (target_unit_id);
+            const std::pmr::map<quint32, Unit>& units = match_state.unitsRef ();
+            std::pmr::map<quint32, Unit>::const_iterator target_unit_it = units.find (target_unit_id);
             if (target_unit_it != units.end ()) {
                 const Unit& target_unit = target_unit_it->second;
                 return &target_unit.position;
@@ -348,8 +348,8 @@ const Position* SceneRenderer::getUnitTargetPosition (const IntentiveActionVaria
             return &std::get<Position> (action_target);
         } else if (std::holds_alternative<quint32> (action_target)) {
             quint32 target_unit_id = std::get<quint32> (action_target);
-            const std::map<quint32, Unit>& units = match_state.unitsRef ();
-            std::map<quint32, Unit>::const_iterator target_unit_it = units.find (target_unit_id);
+            const std::pmr::map<quint32, Unit>& units = match_state.unitsRef ();
+            std::pmr::map<quint32, Unit>::const_iterator target_unit_it = units.find (target_unit_id);
             if (target_unit_it != units.end ()) {
                 const Unit& target_unit = target_unit_it->second;
                 return &target_unit.position;
@@ -361,8 +361,8 @@ const Position* SceneRenderer::getUnitTargetPosition (const IntentiveActionVaria
             return &std::get<Position> (action_target);
         } else if (std::holds_alternative<quint32> (action_target)) {
             quint32 target_unit_id = std::get<quint32> (action_target);
-            const std::map<quint32, Unit>& units = match_state.unitsRef ();
-            std::map<quint32, Unit>::const_iterator target_unit_it = units.find (target_unit_id);
+            const std::pmr::map<quint32, Unit>& units = match_state.unitsRef ();
+            std::pmr::map<quint32, Unit>::const_iterator target_unit_it = units.find (target_unit_id);
             if (target_unit_it != units.end ()) {
                 const Unit& target_unit = target_unit_it->second;
                 return &target_unit.position;
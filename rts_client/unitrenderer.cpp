@@ -65,17 +65,17 @@ UnitRenderer::UnitRenderer (Unit::Type type, const QColor& team_color)
     pestilence_disease2 = loadTexture2D (":/images/effects/pestilence-disease/disease2.png");
 }
 
-void UnitRenderer::draw (QOpenGLFunctions& gl, TexturedRenderer& textured_renderer, ColoredTexturedRenderer& colored_textured_renderer, const Unit& unit, quint64 clock_ns,
+void UnitRenderer::draw (QOpenGLFunctions& gl, TexturedRenderer& textured_renderer, ColoredTexturedRenderer& colored_textured_renderer, const Unit& unit, quint64 clock_ns, quint32 tick_rate,
                          const QMatrix4x4& ortho_matrix, const CoordMap& coord_map)
 {
-    drawBody (gl, textured_renderer, unit, clock_ns, ortho_matrix, coord_map);
+    drawBody (gl, textured_renderer, unit, clock_ns, tick_rate, ortho_matrix, coord_map);
     drawPestilenceDisease (gl, colored_textured_renderer, unit, clock_ns, ortho_matrix, coord_map);
-    drawCooldownShade (gl, textured_renderer, unit, ortho_matrix, coord_map);
+    drawCooldownShade (gl, textured_renderer, unit, tick_rate, ortho_matrix, coord_map);
 }
 void UnitRenderer::drawCorpse (QOpenGLFunctions& gl, TexturedRenderer& textured_renderer, const Corpse& corpse,
                                const QMatrix4x4& ortho_matrix, const CoordMap& coord_map)
 {
-    drawBody (gl, textured_renderer, corpse.unit, 0, ortho_matrix, coord_map, false);
+    drawBody (gl, textured_renderer, corpse.unit, 0, 0, ortho_matrix, coord_map, false);
 }
 void UnitRenderer::drawSelection (QOpenGLFunctions& gl, ColoredRenderer& colored_renderer, const Unit& unit,
                                   const QMatrix4x4& ortho_matrix, const CoordMap& coord_map)
@@ -241,7 +241,7 @@ QColor UnitRenderer::getHPColor (qreal hp_ratio)
 {
     return QColor::fromRgbF (1.0 - hp_ratio, hp_ratio, 0.0);
 }
-void UnitRenderer::drawBody (QOpenGLFunctions& gl, TexturedRenderer& textured_renderer, const Unit& unit, quint64 clock_ns,
+void UnitRenderer::drawBody (QOpenGLFunctions& gl, TexturedRenderer& textured_renderer, const Unit& unit, quint64 clock_ns, quint32 tick_rate,
                              const QMatrix4x4& ortho_matrix, const CoordMap& coord_map, bool alive)
 {
     qreal sprite_scale;
@@ -278,7 +278,7 @@ void UnitRenderer::drawBody (QOpenGLFunctions& gl, TexturedRenderer& textured_re
         } else if (std::holds_alternative<PerformingCastAction> (unit.action)) {
             const PerformingCastAction& action = std::get<PerformingCastAction> (unit.action);
             qint64 remaining_ticks = action.remaining_ticks;
-            qint64 cast_duration_ticks = MatchState::effectAttackDescription (AttackDescription::Type::PestilenceMissile).duration_ticks;
+            qint64 cast_duration_ticks = MatchState::ticks (MatchState::effectAttackDescription (AttackDescription::Type::PestilenceMissile).duration_ms, tick_rate);
             texture = (remaining_ticks > cast_duration_ticks / 2) ? shooting1.get () : shooting2.get ();
         } else {
             texture = standing.get ();
@@ -417,7 +417,7 @@ void UnitRenderer::drawPestilenceDisease (QOpenGLFunctions& gl, ColoredTexturedR
 
     colored_textured_renderer.draw (gl, GL_TRIANGLES, vertices, colors, texture_coords, 6, indices, texture, ortho_matrix);
 }
-void UnitRenderer::drawCooldownShade (QOpenGLFunctions& gl, TexturedRenderer& textured_renderer, const Unit& unit,
+void UnitRenderer::drawCooldownShade (QOpenGLFunctions& gl, TexturedRenderer& textured_renderer, const Unit& unit, quint32 tick_rate,
                                       const QMatrix4x4& ortho_matrix, const CoordMap& coord_map)
 {
     if (unit.type != Unit::Type::Contaminator || !unit.cast_cooldown_left_ticks)
@@ -446,8 +446,8 @@ void UnitRenderer::drawCooldownShade (QOpenGLFunctions& gl, TexturedRenderer& te
 
     Position center = coord_map.toScreenCoords (unit.position);
 
-    qreal max_cooldown_ticks = qMax (MatchState::effectAttackDescription (AttackDescription::Type::PestilenceMissile).cooldown_ticks,
-                                     MatchState::effectAttackDescription (AttackDescription::Type::SpawnBeetle).cooldown_ticks);
+    qreal max_cooldown_ticks = MatchState::ticks (qMax (MatchState::effectAttackDescription (AttackDescription::Type::PestilenceMissile).cooldown_ms,
+                                                        MatchState::effectAttackDescription (AttackDescription::Type::SpawnBeetle).cooldown_ms), tick_rate);
     qreal remaining = qreal (unit.cast_cooldown_left_ticks) / max_cooldown_ticks;
 
     qreal scale = coord_map.viewport_scale * sprite_scale * MatchState::unitDiameter (unit.type) * coord_map.arena_viewport.height () / coord_map.POINTS_PER_VIEWPORT_VERTICALLY;
@@ -18,7 +18,7 @@ class UnitRenderer
 public:
     UnitRenderer (Unit::Type type, const QColor& team_color);
     void draw (QOpenGLFunctions& gl, TexturedRenderer& textured_renderer, ColoredTexturedRenderer& colored_textured_renderer,
-               const Unit& unit, quint64 clock_ns, const QMatrix4x4& ortho_matrix, const CoordMap& coord_map);
+               const Unit& unit, quint64 clock_ns, quint32 tick_rate, const QMatrix4x4& ortho_matrix, const CoordMap& coord_map);
     void drawCorpse (QOpenGLFunctions& gl, TexturedRenderer& textured_renderer, const Corpse& corpse,
                      const QMatrix4x4& ortho_matrix, const CoordMap& coord_map);
     void drawSelection (QOpenGLFunctions& gl, ColoredRenderer& colored_renderer, const Unit& unit,
@@ -33,11 +33,11 @@ private:
     static quint64 attackAnimationPeriodNS (Unit::Type type);
     static QColor getHPColor (qreal hp_ratio);
 
-    void drawBody (QOpenGLFunctions& gl, TexturedRenderer& textured_renderer, const Unit& unit, quint64 clock_ns,
+    void drawBody (QOpenGLFunctions& gl, TexturedRenderer& textured_renderer, const Unit& unit, quint64 clock_ns, quint32 tick_rate,
                    const QMatrix4x4& ortho_matrix, const CoordMap& coord_map, bool alive = true);
     void drawPestilenceDisease (QOpenGLFunctions& gl, ColoredTexturedRenderer& colored_textured_renderer, const Unit& unit, quint64 clock_ns,
                                 const QMatrix4x4& ortho_matrix, const CoordMap& coord_map);
-    void drawCooldownShade (QOpenGLFunctions& gl, TexturedRenderer& textured_renderer, const Unit& unit,
+    void drawCooldownShade (QOpenGLFunctions& gl, TexturedRenderer& textured_renderer, const Unit& unit, quint32 tick_rate,
                             const QMatrix4x4& ortho_matrix, const CoordMap& coord_map);
 
 private:
@@ -9,11 +9,11 @@ UnitSetRenderer::UnitSetRenderer (const QColor& red_team_color, const QColor& bl
     blue = QSharedPointer<UnitTeamRenderer> (new UnitTeamRenderer (blue_team_color));
 }
 
-void UnitSetRenderer::draw (QOpenGLFunctions& gl, TexturedRenderer& textured_renderer, ColoredTexturedRenderer& colored_textured_renderer, const Unit& unit, quint64 clock_ns,
+void UnitSetRenderer::draw (QOpenGLFunctions& gl, TexturedRenderer& textured_renderer, ColoredTexturedRenderer& colored_textured_renderer, const Unit& unit, quint64 clock_ns, quint32 tick_rate,
                             const QMatrix4x4& ortho_matrix, const CoordMap& coord_map)
 {
     if (UnitTeamRenderer* unit_team_renderer = selectUnitTeamRenderer (unit))
-        unit_team_renderer->draw (gl, textured_renderer, colored_textured_renderer, unit, clock_ns, ortho_matrix, coord_map);
+        unit_team_renderer->draw (gl, textured_renderer, colored_textured_renderer, unit, clock_ns, tick_rate, ortho_matrix, coord_map);
 }
 void UnitSetRenderer::drawCorpse (QOpenGLFunctions& gl, TexturedRenderer& textured_renderer, const Corpse& corpse,
                                   const QMatrix4x4& ortho_matrix, const CoordMap& coord_map)
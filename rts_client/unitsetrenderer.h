@@ -18,7 +18,7 @@ class UnitSetRenderer
 {
 public:
     UnitSetRenderer (const QColor& red_team_color, const QColor& red_blue_color);
-    void draw (QOpenGLFunctions& gl, TexturedRenderer& textured_renderer, ColoredTexturedRenderer& colored_textured_renderer, const Unit& unit, quint64 clock_ns,
+    void draw (QOpenGLFunctions& gl, TexturedRenderer& textured_renderer, ColoredTexturedRenderer& colored_textured_renderer, const Unit& unit, quint64 clock_ns, quint32 tick_rate,
                const QMatrix4x4& ortho_matrix, const CoordMap& coord_map);
     void drawCorpse (QOpenGLFunctions& gl, TexturedRenderer& textured_renderer, const Corpse& corpse,
                      const QMatrix4x4& ortho_matrix, const CoordMap& coord_map);
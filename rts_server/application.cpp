@@ -1,6 +1,8 @@
 #include "application.h"
 #include "network_thread.h"
-#include "room_thread.h"
+#include "request_router.h"
+#include "room_handle.h"
+#include "room_scheduler.h"
 
 #include <random>
 #include <QFile>
@@ -18,15 +20,57 @@ Application::Application (int& argc, char** argv)
 {
     next_session_id = std::mt19937_64 (time (nullptr)) () & 0x7fffffffffffffffULL;
     next_response_id = 0;
-    network_thread.reset (new NetworkThread ("0.0.0.0", 1331, this));
-    connect (&*network_thread, &NetworkThread::datagramReceived, this, &Application::sessionTransportClientToServerMessageHandler);
+    request_router.reset (new RequestRouter);
+    network_thread.reset (new NetworkThread ("0.0.0.0", 1331, request_router, this));
+    connect (&*network_thread, &NetworkThread::requestReceived, this, &Application::sessionTransportClientToServerMessageHandler);
+    connect (&*network_thread, &NetworkThread::transportStatsUpdated, this, &Application::transportStatsHandler);
+    room_scheduler.reset (new RoomScheduler (QThread::idealThreadCount ()));
 }
 
 void Application::sendResponseHandler (const RTS::Response& response_oneof, std::shared_ptr<Session> session, uint64_t request_id)
 {
     std::string message;
     response_oneof.SerializeToString (&message);
-    sendReply (*session, session->session_id, request_id, next_response_id++, message);
+    // Match state is superseded by the next tick and command acks by the next bundle, everything else must arrive
+    bool reliable = response_oneof.message_case () != RTS::Response::MessageCase::kMatchState &&
+        response_oneof.message_case () != RTS::Response::MessageCase::kMatchStateChunk &&
+        response_oneof.message_case () != RTS::Response::MessageCase::kMatchStateDelta &&
+        response_oneof.message_case () != RTS::Response::MessageCase::kPackedMatchState &&
+        response_oneof.message_case () != RTS::Response::MessageCase::kCommandAck;
+    sendReply (*session, session->session_id, request_id, next_response_id++, message, reliable);
+}
+void Application::sendSnapshotHandler (const HCCN::ServerToClient::SharedPayload& payload, std::shared_ptr<Session> session)
+{
+    sendReply (*session, session->session_id, {}, next_response_id++, payload, false);
+}
+void Application::transportStatsHandler (const std::vector<HCCN::TransportStats>& stats)
+{
+    for (const HCCN::TransportStats& peer_stats: stats) {
+        for (std::map<uint64_t, std::shared_ptr<Session>>::iterator it = sessions.begin (); it != sessions.end (); ++it) {
+            const std::shared_ptr<Session>& session = it->second;
+            if (session->client_address != peer_stats.host || session->client_port != peer_stats.port || !session->current_room.has_value ())
+                continue;
+            // Only the room reads transport stats, they reach it through its input queue
+            std::map<uint32_t, std::shared_ptr<RoomHandle>>::iterator room_it = rooms.find (*session->current_room);
+            if (room_it != rooms.end ())
+                room_it->second->postTransportStats (session, peer_stats);
+        }
+    }
+}
+void Application::updateMatchAdmission ()
+{
+    // One saturated room is enough, every new match would take worker time from it
+    bool refusing_matches = false;
+    for (std::map<uint32_t, std::shared_ptr<RoomHandle>>::const_iterator it = rooms.cbegin (); it != rooms.cend (); ++it) {
+        if (it->second->refusingMatches ())
+            refusing_matches = true;
+    }
+    if (refusing_matches == this->refusing_matches)
+        return;
+    this->refusing_matches = refusing_matches;
+    qDebug () << "metric server_match_admission action=" << (refusing_matches ? "refuse" : "accept");
+    for (std::map<uint32_t, std::shared_ptr<RoomHandle>>::iterator it = rooms.begin (); it != rooms.end (); ++it)
+        it->second->setAcceptingMatches (!refusing_matches);
 }
 
 uint64_t Application::nextSessionId ()
@@ -39,6 +83,7 @@ Application::~Application ()
     // TODO: Implement handling SIGINT
     network_thread->exit ();
     network_thread->wait ();
+    room_scheduler->stop ();
 }
 
 bool Application::init ()
@@ -68,8 +113,16 @@ bool Application::init ()
         user_passwords[std::string (fields.at (0).data (), fields.at (0).size ())] = std::string (fields.at (1).data (), fields.at (1).size ());
     }
 
+    std::string error_message;
+    if (!TickWatchdog::loadConfig ("server.ini", watchdog_config, error_message)) {
+        qDebug () << "Invalid watchdog config in server.ini:" << QString::fromStdString (error_message);
+        return false;
+    }
+    QSettings settings ("server.ini", QSettings::IniFormat);
+    room_scheduler->setPipelined (settings.value ("scheduler/pipelined", true).toBool ());
     loadRoomList ();
 
+    room_scheduler->start ();
     network_thread->start ();
 
     return true;
@@ -81,15 +134,39 @@ bool Application::clientMatch (const HCCN::ClientToServer::Message& client_trans
 void Application::sendReply (const HCCN::ClientToServer::Message& client_transport_message,
                              const std::optional<uint64_t>& session_id, const std::optional<uint64_t>& request_id, uint64_t response_id, const std::string& message)
 {
-    std::shared_ptr<HCCN::ServerToClient::Message> m (new HCCN::ServerToClient::Message (client_transport_message.host, client_transport_message.port,
-                                                                                         session_id, request_id, response_id, {message.data (), message.data () + message.size ()}));
+    std::shared_ptr<HCCN::ServerToClient::Message> m = HCCN::makePooled<HCCN::ServerToClient::Message> ();
+    m->host = client_transport_message.host;
+    m->port = client_transport_message.port;
+    m->session_id = session_id;
+    m->request_id = request_id;
+    m->response_id = response_id;
+    m->message.assign (message.begin (), message.end ());
+    m->reliable = true;
     network_thread->sendDatagram (m);
 }
 void Application::sendReply (const Session& session,
-                             const std::optional<uint64_t>& session_id, const std::optional<uint64_t>& request_id, uint64_t response_id, const std::string& message)
+                             const std::optional<uint64_t>& session_id, const std::optional<uint64_t>& request_id, uint64_t response_id, const std::string& message, bool reliable)
+{
+    std::shared_ptr<std::vector<char>> payload = HCCN::makePooled<std::vector<char>> ();
+    payload->assign (message.begin (), message.end ());
+    sendReply (session, session_id, request_id, response_id, payload, reliable);
+}
+void Application::sendReply (const Session& session,
+                             const std::optional<uint64_t>& session_id, const std::optional<uint64_t>& request_id, uint64_t response_id,
+                             const HCCN::ServerToClient::SharedPayload& payload, bool reliable)
 {
-    std::shared_ptr<HCCN::ServerToClient::Message> datagram (new HCCN::ServerToClient::Message (session.client_address, session.client_port,
-                                                                                                session_id, request_id, response_id, {message.data (), message.data () + message.size ()}));
+    std::shared_ptr<HCCN::ServerToClient::Message> datagram = HCCN::makePooled<HCCN::ServerToClient::Message> ();
+    datagram->host = session.client_address;
+    datagram->port = session.client_port;
+    datagram->session_id = session_id;
+    datagram->request_id = request_id;
+    datagram->response_id = response_id;
+    datagram->shared_message = payload;
+    datagram->max_datagram_size = session.max_datagram_size;
+    datagram->discover_path_mtu = session.path_mtu_discovery;
+    datagram->reliable = reliable;
+    if (!reliable)
+        datagram->fec_group_size = session.fec_group_size;
     network_thread->sendDatagram (datagram);
 }
 void Application::sendReplyError (const HCCN::ClientToServer::Message& client_transport_message, const std::string& error_message, RTS::ErrorCode error_code)
@@ -124,29 +201,27 @@ void Application::sendReplyRoomList (const Session& session,
         if (it->second->current_room.has_value ())
             room_client_counters[it->second->current_room.value ()]++;
     }
-    for (std::map<uint32_t, std::shared_ptr<RoomThread>>::const_iterator room_it = rooms.cbegin (); room_it != rooms.cend (); ++room_it) {
+    for (std::map<uint32_t, std::shared_ptr<RoomHandle>>::const_iterator room_it = rooms.cbegin (); room_it != rooms.cend (); ++room_it) {
         uint32_t room_id = room_it->first;
-        const RoomThread& room_thread = *room_it->second;
+        const RoomHandle& room_handle = *room_it->second;
         RTS::RoomInfo* room_info = room_info_list->Add ();
         room_info->set_id (room_id);
-        room_info->set_name (room_thread.name ());
+        room_info->set_name (room_handle.name ());
         room_info->set_client_count (room_client_counters[room_id]);
-        room_info->set_player_count (room_thread.playerCount ());
-        room_info->set_ready_player_count (room_thread.readyPlayerCount ());
-        room_info->set_spectator_count (room_thread.spectatorCount ());
+        room_info->set_player_count (room_handle.playerCount ());
+        room_info->set_ready_player_count (room_handle.readyPlayerCount ());
+        room_info->set_spectator_count (room_handle.spectatorCount ());
+        room_info->set_tick_rate (room_handle.tickRate ());
     }
 
     std::string message;
     response_oneof.SerializeToString (&message);
     sendReply (session, session_id, request_id, response_id, message);
 }
-void Application::sessionTransportClientToServerMessageHandler (const std::shared_ptr<HCCN::ClientToServer::Message>& transport_message)
+void Application::sessionTransportClientToServerMessageHandler (const std::shared_ptr<ClientRequest>& client_request)
 {
-    RTS::Request request_oneof;
-    if (!request_oneof.ParseFromArray (transport_message->message.data (), transport_message->message.size ())) {
-        qDebug () << "Failed to parse message from client";
-        return;
-    }
+    const RTS::Request& request_oneof = *client_request->request_oneof;
+    const std::shared_ptr<HCCN::ClientToServer::Message>& transport_message = client_request->transport_message;
 
     switch (request_oneof.message_case ()) {
     case RTS::Request::MessageCase::kAuthorization: {
@@ -169,12 +244,25 @@ void Application::sessionTransportClientToServerMessageHandler (const std::share
         if (old_session_id_it != login_session_ids.end ()) {
             uint64_t old_session_id = old_session_id_it->second;
             // TODO: Actual cleanup
-            sessions.erase (old_session_id);
+            std::map<uint64_t, std::shared_ptr<Session>>::iterator old_session_it = sessions.find (old_session_id);
+            if (old_session_it != sessions.end ()) {
+                // Same address logs in again, its transport state carries over to the new session
+                const Session& old_session = *old_session_it->second;
+                if (old_session.client_address != transport_message->host || old_session.client_port != transport_message->port)
+                    network_thread->closePeer (old_session.client_address, old_session.client_port);
+                sessions.erase (old_session_it);
+            }
+            request_router->removeSession (old_session_id);
         }
         uint64_t session_id = nextSessionId ();
         std::shared_ptr<Session> session = std::shared_ptr<Session> (new Session (transport_message->host, transport_message->port, login, session_id));
+        if (request.max_datagram_size ())
+            session->max_datagram_size = HCCN::clampDatagramSize (request.max_datagram_size ());
+        session->path_mtu_discovery = request.path_mtu_discovery ();
+        session->fec_group_size = request.fec_group_size ();
         sessions[session_id] = session;
         login_session_ids[login] = session_id;
+        request_router->addSession (session);
 
         RTS::Response response_oneof;
         RTS::AuthorizationResponse* response = response_oneof.mutable_authorization ();
@@ -219,6 +307,11 @@ void Application::sessionTransportClientToServerMessageHandler (const std::share
 
         // TODO: Actually verify join room
         session->current_room = request.room_id ();
+        // Snapshot settings belong to the room thread, the join request carries them there ahead of anything routed to the room
+        std::map<uint32_t, std::shared_ptr<RoomHandle>>::iterator room_it = rooms.find (request.room_id ());
+        if (room_it != rooms.end ())
+            room_it->second->post (client_request, session);
+        request_router->joinRoom (session_id, request.room_id ());
 
         RTS::Response response_oneof;
         RTS::JoinRoomResponse* response = response_oneof.mutable_join_room ();
@@ -235,15 +328,25 @@ void Application::sessionTransportClientToServerMessageHandler (const std::share
         std::shared_ptr<Session> session = validateSessionRequest (*transport_message, &session_id);
         if (!session)
             break;
+        uint32_t tick_rate = request.tick_rate () ? request.tick_rate () : MatchState::kDefaultTickRate;
+        if (!Room::isSupportedTickRate (tick_rate)) {
+            RTS::Response response_oneof;
+            RTS::CreateRoomResponse* response = response_oneof.mutable_create_room ();
+            setError (response->mutable_error (), "Unsupported tick rate", RTS::ERROR_CODE_MALFORMED_MESSAGE);
+
+            std::string message;
+            response_oneof.SerializeToString (&message);
+
+            sendReply (*session, session_id, transport_message->request_id, next_response_id++, message);
+            break;
+        }
         uint32_t new_room_id = 0;
         if (!rooms.empty ()) {
-            for (std::map<uint32_t, std::shared_ptr<RoomThread>>::const_iterator room_it = rooms.cbegin (); room_it != rooms.cend (); ++room_it)
+            for (std::map<uint32_t, std::shared_ptr<RoomHandle>>::const_iterator room_it = rooms.cbegin (); room_it != rooms.cend (); ++room_it)
                 new_room_id = qMax (new_room_id, room_it->first);
             ++new_room_id;
         }
-        rooms[new_room_id].reset (new RoomThread (request.name (), this));
-        connect (&*rooms[new_room_id], &RoomThread::receiveRequest, &*rooms[new_room_id], &RoomThread::receiveRequestHandler);
-        connect (&*rooms[new_room_id], &RoomThread::sendResponse, this, &Application::sendResponseHandler);
+        addRoom (new_room_id, request.name (), tick_rate, request.snapshot_rate ());
 
         RTS::Response response_oneof;
         RTS::CreateRoomResponse* response = response_oneof.mutable_create_room ();
@@ -265,7 +368,7 @@ void Application::sessionTransportClientToServerMessageHandler (const std::share
         std::shared_ptr<Session> session = validateSessionRequest (*transport_message, &session_id);
         if (!session)
             break;
-        std::map<uint32_t, std::shared_ptr<RoomThread>>::iterator room_it = rooms.find (request.room_id ());
+        std::map<uint32_t, std::shared_ptr<RoomHandle>>::iterator room_it = rooms.find (request.room_id ());
         if (room_it == rooms.end ()) {
             RTS::Response response_oneof;
             RTS::DeleteRoomResponse* response = response_oneof.mutable_delete_room ();
@@ -278,7 +381,9 @@ void Application::sessionTransportClientToServerMessageHandler (const std::share
             break;
         }
 
+        request_router->removeRoom (room_it->first);
         rooms.erase (room_it);
+        updateMatchAdmission ();
 
         RTS::Response response_oneof;
         RTS::DeleteRoomResponse* response = response_oneof.mutable_delete_room ();
@@ -305,7 +410,7 @@ void Application::sessionTransportClientToServerMessageHandler (const std::share
             sendReply (*session, session_id, transport_message->request_id, next_response_id++, message);
             break;
         }
-        std::map<uint32_t, std::shared_ptr<RoomThread>>::iterator it = rooms.find (session->current_room.value ());
+        std::map<uint32_t, std::shared_ptr<RoomHandle>>::iterator it = rooms.find (session->current_room.value ());
         if (it == rooms.end ()) {
             RTS::Response response_oneof;
             RTS::ErrorResponse* response = response_oneof.mutable_error ();
@@ -318,7 +423,8 @@ void Application::sessionTransportClientToServerMessageHandler (const std::share
             break;
         }
 
-        emit (it->second)->receiveRequest (request_oneof, session, transport_message->request_id);
+        // Router missed it, e.g. the session joined while the request was in flight
+        it->second->post (client_request, session);
     }
     }
 }
@@ -347,15 +453,26 @@ std::shared_ptr<Session> Application::validateSessionRequest (const HCCN::Client
     *session_id_ptr = session_id;
     return session;
 }
+void Application::addRoom (uint32_t room_id, const std::string& name, uint32_t tick_rate, uint32_t snapshot_rate)
+{
+    std::shared_ptr<RoomHandle>& room_handle = rooms[room_id];
+    room_handle.reset (new RoomHandle (name, tick_rate, snapshot_rate, watchdog_config, *room_scheduler, this));
+    connect (&*room_handle, &RoomHandle::sendResponse, this, &Application::sendResponseHandler);
+    connect (&*room_handle, &RoomHandle::sendSnapshot, this, &Application::sendSnapshotHandler);
+    connect (&*room_handle, &RoomHandle::refusingMatchesChanged, this, &Application::updateMatchAdmission);
+    room_handle->setAcceptingMatches (!refusing_matches);
+    request_router->addRoom (room_id, room_handle->roomRef ());
+}
 void Application::loadRoomList ()
 {
     QSettings room_settings ("room.ini", QSettings::IniFormat);
     int size = room_settings.beginReadArray ("rooms");
     for (int new_room_id = 0; new_room_id < size; ++new_room_id) {
         room_settings.setArrayIndex (new_room_id);
-        rooms[new_room_id].reset (new RoomThread (room_settings.value ("name").toString ().toStdString (), this));
-        connect (&*rooms[new_room_id], &RoomThread::receiveRequest, &*rooms[new_room_id], &RoomThread::receiveRequestHandler);
-        connect (&*rooms[new_room_id], &RoomThread::sendResponse, this, &Application::sendResponseHandler);
+        uint32_t tick_rate = room_settings.value ("tick_rate", MatchState::kDefaultTickRate).toUInt ();
+        if (!Room::isSupportedTickRate (tick_rate))
+            tick_rate = MatchState::kDefaultTickRate;
+        addRoom (new_room_id, room_settings.value ("name").toString ().toStdString (), tick_rate, room_settings.value ("snapshot_rate", 0).toUInt ());
     }
     room_settings.endArray ();
 }
@@ -364,10 +481,12 @@ void Application::storeRoomList ()
     QSettings room_settings ("room.ini", QSettings::IniFormat);
     room_settings.beginWriteArray ("rooms");
     int i = 0;
-    for (std::map<uint32_t, std::shared_ptr<RoomThread>>::const_iterator it = rooms.begin (); it != rooms.end (); ++it) {
-        RoomThread& room_thread = *it->second;
+    for (std::map<uint32_t, std::shared_ptr<RoomHandle>>::const_iterator it = rooms.begin (); it != rooms.end (); ++it) {
+        RoomHandle& room_handle = *it->second;
         room_settings.setArrayIndex (i++);
-        room_settings.setValue ("name", QString::fromStdString (room_thread.name ()));
+        room_settings.setValue ("name", QString::fromStdString (room_handle.name ()));
+        room_settings.setValue ("tick_rate", room_handle.tickRate ());
+        room_settings.setValue ("snapshot_rate", room_handle.snapshotRate ());
     }
     room_settings.endArray ();
 }
@@ -2,9 +2,11 @@
 
 #include "responses.pb.h"
 #include "matchstate.h"
+#include "client_request.h"
 #include "client_to_server.h"
 #include "server_to_client.h"
 #include "session.h"
+#include "tick_watchdog.h"
 
 #include <QCoreApplication>
 #include <QNetworkDatagram>
@@ -15,7 +17,9 @@
 
 
 class NetworkThread;
-class RoomThread;
+class RequestRouter;
+class RoomHandle;
+class RoomScheduler;
 
 
 class Application: public QCoreApplication
@@ -32,12 +36,19 @@ private:
     void setError (RTS::Error* error, const std::string& error_message, RTS::ErrorCode error_code);
 
 private slots:
-    void sessionTransportClientToServerMessageHandler (const std::shared_ptr<HCCN::ClientToServer::Message>& datagram);
+    void sessionTransportClientToServerMessageHandler (const std::shared_ptr<ClientRequest>& client_request);
     void sendResponseHandler (const RTS::Response& response_oneof, std::shared_ptr<Session> session, uint64_t request_id);
+    void sendSnapshotHandler (const HCCN::ServerToClient::SharedPayload& payload, std::shared_ptr<Session> session);
+    void transportStatsHandler (const std::vector<HCCN::TransportStats>& stats);
+    void updateMatchAdmission ();
 
 private:
+    std::shared_ptr<RequestRouter> request_router;
     std::shared_ptr<NetworkThread> network_thread;
-    std::map<uint32_t, std::shared_ptr<RoomThread>> rooms;
+    std::shared_ptr<RoomScheduler> room_scheduler; // Outlives rooms
+    std::map<uint32_t, std::shared_ptr<RoomHandle>> rooms;
+    TickWatchdog::Config watchdog_config;
+    bool refusing_matches = false;
     std::map<std::string, std::string> user_passwords;
     uint64_t next_session_id;
     uint64_t next_response_id;
@@ -49,12 +60,16 @@ private:
     void sendReply (const HCCN::ClientToServer::Message& client_transport_message,
                     const std::optional<uint64_t>& session_id, const std::optional<uint64_t>& request_id, uint64_t response_id, const std::string& msg);
     void sendReply (const Session& session,
-                    const std::optional<uint64_t>& session_id, const std::optional<uint64_t>& request_id, uint64_t response_id, const std::string& msg);
+                    const std::optional<uint64_t>& session_id, const std::optional<uint64_t>& request_id, uint64_t response_id, const std::string& msg, bool reliable = true);
+    void sendReply (const Session& session,
+                    const std::optional<uint64_t>& session_id, const std::optional<uint64_t>& request_id, uint64_t response_id,
+                    const HCCN::ServerToClient::SharedPayload& payload, bool reliable);
     void sendReplyError (const HCCN::ClientToServer::Message& client_transport_message, const std::string& error_message, RTS::ErrorCode error_code);
     void sendReplySessionExpired (const HCCN::ClientToServer::Message& client_transport_message,
                                   const uint64_t session_id, const std::optional<uint64_t>& request_id, uint64_t response_id);
     void sendReplyRoomList (const Session& session, const uint64_t session_id, const std::optional<uint64_t>& request_id, uint64_t response_id);
     std::shared_ptr<Session> validateSessionRequest (const HCCN::ClientToServer::Message& client_transport_message, uint64_t* session_id_ptr);
+    void addRoom (uint32_t room_id, const std::string& name, uint32_t tick_rate, uint32_t snapshot_rate);
     void loadRoomList ();
     void storeRoomList ();
 };
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "requests.pb.h"
+#include "client_to_server.h"
+#include "pool.h"
+
+#include <google/protobuf/arena.h>
+#include <memory>
+
+
+// Request decoded on the network thread. Pooled, see HCCN::makePooled (): the message lives on the request's
+// own arena, which starts out in an inline block kept across uses, so typical commands are parsed without
+// touching the heap once the pool is warm
+struct ClientRequest {
+    static constexpr size_t kArenaBlockSize = 1024;
+
+    ClientRequest ()
+        : arena (arena_block, sizeof (arena_block))
+        , request_oneof (google::protobuf::Arena::CreateMessage<RTS::Request> (&arena))
+    {
+    }
+    bool parse ()
+    {
+        return request_oneof->ParseFromArray (transport_message->message.data (), transport_message->message.size ());
+    }
+    void recycle ()
+    {
+        transport_message.reset ();
+        // Blocks the arena grew beyond the inline one go back to the heap, the inline one is reused
+        arena.Reset ();
+        request_oneof = google::protobuf::Arena::CreateMessage<RTS::Request> (&arena);
+    }
+
+    std::shared_ptr<HCCN::ClientToServer::Message> transport_message;
+    alignas (8) char arena_block[kArenaBlockSize];
+    google::protobuf::Arena arena;
+    RTS::Request* request_oneof;
+};
@@ -1,14 +1,26 @@
 #include "network_manager.h"
 
+#include "control.h"
+#include "request_router.h"
+
 #include <QThread>
 #include <QUdpSocket>
 #include <QCoreApplication>
 #include <QNetworkDatagram>
 
-NetworkManager::NetworkManager (const std::string& host, uint16_t port, QObject* parent)
+NetworkManager::NetworkManager (const std::string& host, uint16_t port, RequestRouter& request_router,
+                                HCCN::SpscChannel<std::shared_ptr<ClientRequest>>& requests,
+                                HCCN::SpscChannel<std::shared_ptr<HCCN::ServerToClient::Message>>& datagrams,
+                                HCCN::SpscChannel<std::pair<QHostAddress, uint16_t>>& closed_peers, QObject* parent)
     : QObject (parent)
     , host (host)
     , port (port)
+    , request_router (request_router)
+    , requests (requests)
+    , datagrams (datagrams)
+    , closed_peers (closed_peers)
+    , datagram_notifier (datagrams.fd (), QSocketNotifier::Read)
+    , closed_peer_notifier (closed_peers.fd (), QSocketNotifier::Read)
 {
 }
 
@@ -18,21 +30,29 @@ bool NetworkManager::start (std::string& error_message)
         error_message = socket.errorString ().toStdString ();
         return false;
     }
+    HCCN::PathMtuDiscovery::configureSocket (socket.socketDescriptor ());
+    clock.start ();
     connect (&socket, &QUdpSocket::readyRead, this, &NetworkManager::recieveDatagrams);
-    connect (this, &NetworkManager::sendDatagram, this, &NetworkManager::sendDatagramHandler);
+    connect (&datagram_notifier, &QSocketNotifier::activated, this, &NetworkManager::sendQueuedDatagrams);
+    connect (&closed_peer_notifier, &QSocketNotifier::activated, this, &NetworkManager::closePeers);
+    connect (&retransmit_timer, &QTimer::timeout, this, &NetworkManager::retransmitHandler);
+    retransmit_timer.start (kRetransmitCheckIntervalMs);
     return true;
 }
-std::shared_ptr<HCCN::ClientToServer::Message> NetworkManager::takeDatagram ()
-{
-    QMutexLocker locker (&input_queue_mutex);
-    return input_queue.isEmpty () ? nullptr : input_queue.dequeue ();
-}
 void NetworkManager::recieveDatagrams ()
 {
+    // Fragments, collectors, messages and requests are pooled. What still allocates per datagram is Qt's:
+    // receiveDatagram () builds a QNetworkDatagram and its QByteArray, and every new request id adds
+    // a node to input_fragment_queue
     while (socket.hasPendingDatagrams ()) {
         QNetworkDatagram datagram = socket.receiveDatagram ();
+        if (HCCN::Control::isControl (datagram)) {
+            std::optional<QNetworkDatagram> inner = controlDatagramHandler (datagram);
+            if (!inner.has_value ())
+                continue;
+            datagram = *inner;
+        }
         if (std::shared_ptr<HCCN::ClientToServer::MessageFragment> message_fragment = HCCN::ClientToServer::MessageFragment::parse (datagram)) {
-            QMutexLocker locker (&input_queue_mutex);
             HCCN::TransportMessageIdentifier transport_message_identifier (message_fragment->host, message_fragment->port, message_fragment->request_id);
             QHash<HCCN::TransportMessageIdentifier, std::shared_ptr<HCCN::ClientToServer::MessageFragmentCollector>>::iterator fragment_collector_it =
                 input_fragment_queue.find (transport_message_identifier);
@@ -41,26 +61,126 @@ void NetworkManager::recieveDatagrams ()
                     HCCN::ClientToServer::MessageFragmentCollector& fragment_collector = **fragment_collector_it;
                     fragment_collector.insert (message_fragment);
                     if (fragment_collector.complete ()) {
-                        input_queue.enqueue (fragment_collector.build ());
+                        deliver (fragment_collector.build ());
                         fragment_collector_it->reset ();
                     }
                 }
             } else {
-                std::shared_ptr<HCCN::ClientToServer::MessageFragmentCollector> fragment_collector (new HCCN::ClientToServer::MessageFragmentCollector);
+                std::shared_ptr<HCCN::ClientToServer::MessageFragmentCollector> fragment_collector = HCCN::makePooled<HCCN::ClientToServer::MessageFragmentCollector> ();
                 fragment_collector->insert (message_fragment);
                 if (fragment_collector->complete ()) {
-                    input_queue.enqueue (fragment_collector->build ());
+                    deliver (fragment_collector->build ());
                     fragment_collector.reset ();
                 }
                 input_fragment_queue.insert (transport_message_identifier, fragment_collector);
             }
         }
     }
-    emit datagramsReady ();
+    for (const QNetworkDatagram& ack: reliable_transport.takeAcks ())
+        socket.writeDatagram (ack);
+    if (requests_pending) {
+        requests.notify ();
+        requests_pending = false;
+    }
+}
+void NetworkManager::deliver (const std::shared_ptr<HCCN::ClientToServer::Message>& message)
+{
+    std::shared_ptr<ClientRequest> request = HCCN::makePooled<ClientRequest> ();
+    request->transport_message = message;
+    if (!request->parse ()) {
+        qDebug () << "Failed to parse message from client";
+        return;
+    }
+    if (request_router.route (request))
+        return;
+    requests.push (request);
+    requests_pending = true;
+}
+void NetworkManager::sendQueuedDatagrams ()
+{
+    datagrams.clear ();
+    std::shared_ptr<HCCN::ServerToClient::Message> message;
+    while (datagrams.pop (message))
+        sendDatagram (*message);
+}
+void NetworkManager::closePeers ()
+{
+    closed_peers.clear ();
+    std::pair<QHostAddress, uint16_t> peer;
+    while (closed_peers.pop (peer)) {
+        path_mtu_discovery.remove (HCCN::TransportPeerIdentifier (peer.first, peer.second));
+        reliable_transport.close (peer.first, peer.second);
+    }
 }
-void NetworkManager::sendDatagramHandler (const std::shared_ptr<HCCN::ServerToClient::Message>& message)
+void NetworkManager::sendDatagram (const HCCN::ServerToClient::Message& message)
 {
-    std::vector<QNetworkDatagram> datagrams = message->encode ();
-    for (const QNetworkDatagram& datagram: datagrams)
+    size_t max_datagram_size = discoverPathMtu (message);
+    if (message.reliable) {
+        for (const QNetworkDatagram& datagram: message.encode (max_datagram_size - HCCN::Control::kReliableOverhead))
+            if (std::optional<QNetworkDatagram> wrapped = reliable_transport.wrap (message.host, message.port, datagram.data (), clock.elapsed ()))
+                socket.writeDatagram (*wrapped);
+        return;
+    }
+    if (!encoder.send (socket.socketDescriptor (), message, max_datagram_size))
+        qDebug () << "Failed to send message to" << message.host << ":" << message.port;
+}
+void NetworkManager::retransmitHandler ()
+{
+    qint64 now = clock.elapsed ();
+    for (const QNetworkDatagram& datagram: reliable_transport.retransmissions (now))
         socket.writeDatagram (datagram);
+    if (now - last_stats_at >= kStatsIntervalMs) {
+        last_stats_at = now;
+        emit transportStatsUpdated (reliable_transport.stats ());
+    }
+}
+std::optional<QNetworkDatagram> NetworkManager::controlDatagramHandler (const QNetworkDatagram& datagram)
+{
+    std::optional<HCCN::Control::Type> type = HCCN::Control::parseType (datagram);
+    if (!type.has_value ())
+        return {};
+
+    uint64_t probe_id;
+    size_t size;
+    switch (*type) {
+    case HCCN::Control::Type::PathMtuProbe: {
+        if (HCCN::Control::parsePathMtuProbe (datagram, probe_id, size))
+            socket.writeDatagram (HCCN::Control::encodePathMtuProbeAck (datagram.senderAddress (), datagram.senderPort (), probe_id, size));
+    } break;
+    case HCCN::Control::Type::PathMtuProbeAck: {
+        if (!HCCN::Control::parsePathMtuProbe (datagram, probe_id, size))
+            break;
+        QHash<HCCN::TransportPeerIdentifier, HCCN::PathMtuDiscovery>::iterator discovery_it =
+            path_mtu_discovery.find (HCCN::TransportPeerIdentifier (datagram.senderAddress (), datagram.senderPort ()));
+        if (discovery_it != path_mtu_discovery.end ())
+            discovery_it->acknowledge (probe_id, size);
+    } break;
+    case HCCN::Control::Type::Reliable:
+    case HCCN::Control::Type::SelectiveAck: {
+        return reliable_transport.receive (datagram, clock.elapsed ());
+    }
+    case HCCN::Control::Type::Parity: {
+        qDebug () << "Unexpected parity fragment from client";
+    } break;
+    }
+    return {};
+}
+size_t NetworkManager::discoverPathMtu (const HCCN::ServerToClient::Message& message)
+{
+    size_t max_datagram_size = HCCN::clampDatagramSize (message.max_datagram_size);
+    if (!message.discover_path_mtu || max_datagram_size == HCCN::kDefaultMaxDatagramSize)
+        return max_datagram_size;
+
+    HCCN::TransportPeerIdentifier peer (message.host, message.port);
+    QHash<HCCN::TransportPeerIdentifier, HCCN::PathMtuDiscovery>::iterator discovery_it = path_mtu_discovery.find (peer);
+    if (discovery_it == path_mtu_discovery.end ())
+        discovery_it = path_mtu_discovery.insert (peer, HCCN::PathMtuDiscovery (max_datagram_size));
+    HCCN::PathMtuDiscovery& discovery = *discovery_it;
+    discovery.setCeiling (max_datagram_size);
+
+    // Probes ride along with regular traffic, so the search advances at the rate messages are sent
+    uint64_t probe_id;
+    if (std::optional<size_t> probe_size = discovery.nextProbe (clock.elapsed (), probe_id))
+        socket.writeDatagram (HCCN::Control::encodePathMtuProbe (message.host, message.port, probe_id, *probe_size));
+    return discovery.datagramSize ();
 }
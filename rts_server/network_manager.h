@@ -1,38 +1,68 @@
 #pragma once
 
+#include "client_request.h"
 #include "client_to_server.h"
+#include "path_mtu_discovery.h"
+#include "reliable_channel.h"
 #include "server_to_client.h"
+#include "spsc_channel.h"
 
+#include <QElapsedTimer>
+#include <QTimer>
 #include <QUdpSocket>
 #include <QNetworkDatagram>
-#include <QQueue>
-#include <QMutex>
+#include <QSocketNotifier>
 
 
+class RequestRouter;
+
 class NetworkManager: public QObject
 {
     Q_OBJECT
 
 public:
-    NetworkManager (const std::string& host, uint16_t port, QObject* parent = nullptr);
+    // Requests the router does not take go to the main thread through requests, datagrams come back from it
+    NetworkManager (const std::string& host, uint16_t port, RequestRouter& request_router,
+                    HCCN::SpscChannel<std::shared_ptr<ClientRequest>>& requests,
+                    HCCN::SpscChannel<std::shared_ptr<HCCN::ServerToClient::Message>>& datagrams,
+                    HCCN::SpscChannel<std::pair<QHostAddress, uint16_t>>& closed_peers, QObject* parent = nullptr);
     bool start (std::string& error_message);
-    std::shared_ptr<HCCN::ClientToServer::Message> takeDatagram ();
 
 signals:
-    void sendDatagram (const std::shared_ptr<HCCN::ServerToClient::Message>& datagram);
-    void datagramsReady ();
+    void transportStatsUpdated (const std::vector<HCCN::TransportStats>& stats);
 
 private slots:
     void recieveDatagrams ();
-    void sendDatagramHandler (const std::shared_ptr<HCCN::ServerToClient::Message>& datagram);
+    void sendQueuedDatagrams ();
+    void closePeers ();
+    void retransmitHandler ();
 
 private:
+    static constexpr int kRetransmitCheckIntervalMs = 10;
+    static constexpr qint64 kStatsIntervalMs = 1000;
+
+    std::optional<QNetworkDatagram> controlDatagramHandler (const QNetworkDatagram& datagram);
+    void deliver (const std::shared_ptr<HCCN::ClientToServer::Message>& message);
+    void sendDatagram (const HCCN::ServerToClient::Message& message);
+    size_t discoverPathMtu (const HCCN::ServerToClient::Message& message);
+
     const std::string host;
     const uint16_t port;
+    RequestRouter& request_router;
+    HCCN::SpscChannel<std::shared_ptr<ClientRequest>>& requests;
+    HCCN::SpscChannel<std::shared_ptr<HCCN::ServerToClient::Message>>& datagrams;
+    HCCN::SpscChannel<std::pair<QHostAddress, uint16_t>>& closed_peers;
+    QSocketNotifier datagram_notifier;
+    QSocketNotifier closed_peer_notifier;
+    bool requests_pending = false;
 
     QUdpSocket socket;
+    HCCN::ServerToClient::ScatterGatherEncoder encoder;
+    QHash<HCCN::TransportPeerIdentifier, HCCN::PathMtuDiscovery> path_mtu_discovery;
+    HCCN::ReliableTransport reliable_transport;
+    QElapsedTimer clock;
+    QTimer retransmit_timer;
+    qint64 last_stats_at = 0;
     int return_code = 0;
     QHash<HCCN::TransportMessageIdentifier, std::shared_ptr<HCCN::ClientToServer::MessageFragmentCollector>> input_fragment_queue;
-    QQueue<std::shared_ptr<HCCN::ClientToServer::Message>> input_queue;
-    QMutex input_queue_mutex;
 };
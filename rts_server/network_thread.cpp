@@ -1,16 +1,20 @@
 #include "network_thread.h"
 
 #include "network_manager.h"
+#include "request_router.h"
 
 #include <QThread>
 #include <QUdpSocket>
 
 
-NetworkThread::NetworkThread (const std::string& host, uint16_t port, QObject* parent)
+NetworkThread::NetworkThread (const std::string& host, uint16_t port, const std::shared_ptr<RequestRouter>& request_router, QObject* parent)
     : QThread (parent)
     , host (host)
     , port (port)
+    , request_router (request_router)
+    , request_notifier (requests.fd (), QSocketNotifier::Read)
 {
+    connect (&request_notifier, &QSocketNotifier::activated, this, &NetworkThread::takeRequests);
 }
 
 const std::string& NetworkThread::errorMessage ()
@@ -19,22 +23,28 @@ const std::string& NetworkThread::errorMessage ()
 }
 void NetworkThread::sendDatagram (const std::shared_ptr<HCCN::ServerToClient::Message>& datagram)
 {
-    emit sendDatagramSignal (datagram);
+    datagrams.push (datagram);
+    datagrams.notify ();
+}
+void NetworkThread::closePeer (const QHostAddress& host, uint16_t port)
+{
+    closed_peers.push ({host, port});
+    closed_peers.notify ();
 }
 void NetworkThread::run ()
 {
-    NetworkManager network_manager (host, port);
+    NetworkManager network_manager (host, port, *request_router, requests, datagrams, closed_peers);
     if (!network_manager.start (error_message)) {
         return_code = 1;
         return;
     }
-    connect (this, &NetworkThread::sendDatagramSignal, &network_manager, &NetworkManager::sendDatagram, Qt::QueuedConnection);
-    connect (&network_manager, &NetworkManager::datagramsReady, this, &NetworkThread::recieveDatagrams, Qt::QueuedConnection);
+    connect (&network_manager, &NetworkManager::transportStatsUpdated, this, &NetworkThread::transportStatsUpdated, Qt::QueuedConnection);
     return_code = exec ();
 }
-void NetworkThread::recieveDatagrams ()
+void NetworkThread::takeRequests ()
 {
-    NetworkManager* network_manager = (NetworkManager*) sender ();
-    while (std::shared_ptr<HCCN::ClientToServer::Message> network_message = network_manager->takeDatagram ())
-        emit datagramReceived (network_message);
+    requests.clear ();
+    std::shared_ptr<ClientRequest> request;
+    while (requests.pop (request))
+        emit requestReceived (request);
 }
@@ -1,25 +1,38 @@
 #pragma once
 
+#include "client_request.h"
 #include "client_to_server.h"
+#include "reliable_channel.h"
 #include "server_to_client.h"
+#include "spsc_channel.h"
 
 #include <QThread>
 #include <QUdpSocket>
 #include <QNetworkDatagram>
+#include <QSocketNotifier>
+#include <memory>
 
 
+class RequestRouter;
+
+// Owns the socket. Datagrams are decoded on this thread as well, room-bound requests go straight to their room
+// through the router and only lobby control and error replies reach the main thread. Both directions between
+// the main thread and this one are lock-free queues with eventfd wakeups
 class NetworkThread: public QThread
 {
     Q_OBJECT
 
 public:
-    NetworkThread (const std::string& host, uint16_t port, QObject* parent = nullptr);
+    NetworkThread (const std::string& host, uint16_t port, const std::shared_ptr<RequestRouter>& request_router, QObject* parent = nullptr);
     const std::string& errorMessage ();
+    // Main thread only
     void sendDatagram (const std::shared_ptr<HCCN::ServerToClient::Message>& datagram);
+    // Main thread only, drops transport state kept for a peer whose session ended
+    void closePeer (const QHostAddress& host, uint16_t port);
 
 signals:
-    void sendDatagramSignal (const std::shared_ptr<HCCN::ServerToClient::Message>& datagram);
-    void datagramReceived (const std::shared_ptr<HCCN::ClientToServer::Message>& datagram);
+    void requestReceived (const std::shared_ptr<ClientRequest>& request);
+    void transportStatsUpdated (const std::vector<HCCN::TransportStats>& stats);
 
 protected:
     void run () override;
@@ -27,10 +40,15 @@ protected:
 private:
     const std::string host;
     const uint16_t port;
+    const std::shared_ptr<RequestRouter> request_router;
+    HCCN::SpscChannel<std::shared_ptr<ClientRequest>> requests {"network_to_main"};
+    HCCN::SpscChannel<std::shared_ptr<HCCN::ServerToClient::Message>> datagrams {"main_to_network"};
+    HCCN::SpscChannel<std::pair<QHostAddress, uint16_t>> closed_peers {"main_to_network_closed"};
+    QSocketNotifier request_notifier;
 
     int return_code = 0;
     std::string error_message;
 
 private slots:
-    void recieveDatagrams ();
+    void takeRequests ();
 };
@@ -0,0 +1,69 @@
+#include "request_router.h"
+
+#include "room.h"
+
+
+void RequestRouter::addSession (const std::shared_ptr<Session>& session)
+{
+    QMutexLocker locker (&mutex);
+    sessions[session->session_id] = {session, {}};
+}
+void RequestRouter::removeSession (uint64_t session_id)
+{
+    QMutexLocker locker (&mutex);
+    sessions.erase (session_id);
+}
+void RequestRouter::joinRoom (uint64_t session_id, uint32_t room_id)
+{
+    QMutexLocker locker (&mutex);
+    std::map<uint64_t, Route>::iterator it = sessions.find (session_id);
+    if (it != sessions.end ())
+        it->second.room_id = room_id;
+}
+void RequestRouter::addRoom (uint32_t room_id, const std::shared_ptr<Room>& room)
+{
+    QMutexLocker locker (&mutex);
+    rooms[room_id] = room;
+}
+void RequestRouter::removeRoom (uint32_t room_id)
+{
+    QMutexLocker locker (&mutex);
+    rooms.erase (room_id);
+}
+bool RequestRouter::route (const std::shared_ptr<const ClientRequest>& request)
+{
+    switch (request->request_oneof->message_case ()) {
+    case RTS::Request::MessageCase::kAuthorization:
+    case RTS::Request::MessageCase::kQueryRoomList:
+    case RTS::Request::MessageCase::kStopQueryRoomList:
+    case RTS::Request::MessageCase::kJoinRoom:
+    case RTS::Request::MessageCase::kCreateRoom:
+    case RTS::Request::MessageCase::kDeleteRoom:
+    case RTS::Request::MessageCase::MESSAGE_NOT_SET:
+        return false;
+    default:
+        break;
+    }
+
+    const HCCN::ClientToServer::Message& transport_message = *request->transport_message;
+    if (!transport_message.session_id.has_value ())
+        return false;
+    std::shared_ptr<Session> session;
+    std::shared_ptr<Room> room;
+    {
+        QMutexLocker locker (&mutex);
+        std::map<uint64_t, Route>::const_iterator session_it = sessions.find (*transport_message.session_id);
+        if (session_it == sessions.cend () || !session_it->second.room_id.has_value ())
+            return false;
+        session = session_it->second.session;
+        // Client address is fixed at authorization, safe to read from any thread
+        if (transport_message.host != session->client_address || transport_message.port != session->client_port)
+            return false;
+        std::map<uint32_t, std::shared_ptr<Room>>::const_iterator room_it = rooms.find (*session_it->second.room_id);
+        if (room_it == rooms.cend ())
+            return false;
+        room = room_it->second;
+    }
+    room->post (request, session);
+    return true;
+}
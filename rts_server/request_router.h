@@ -0,0 +1,36 @@
+#pragma once
+
+#include "client_request.h"
+#include "session.h"
+
+#include <QMutex>
+#include <map>
+#include <memory>
+#include <optional>
+
+
+class Room;
+
+// Thread-safe index of sessions and rooms the network thread delivers room-bound requests with, straight into
+// the room's input queue. Application owns sessions and rooms and keeps this index in step with them
+class RequestRouter
+{
+public:
+    void addSession (const std::shared_ptr<Session>& session);
+    void removeSession (uint64_t session_id);
+    void joinRoom (uint64_t session_id, uint32_t room_id);
+    void addRoom (uint32_t room_id, const std::shared_ptr<Room>& room);
+    void removeRoom (uint32_t room_id);
+    // Returns false for lobby control and for every request that needs an error response, those go to the main thread
+    bool route (const std::shared_ptr<const ClientRequest>& request);
+
+private:
+    struct Route {
+        std::shared_ptr<Session> session;
+        std::optional<uint32_t> room_id;
+    };
+
+    QMutex mutex;
+    std::map<uint64_t, Route> sessions;
+    std::map<uint32_t, std::shared_ptr<Room>> rooms;
+};
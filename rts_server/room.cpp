@@ -1,34 +1,379 @@
 #include "room.h"
 
 #include "serialize.h"
+#include "packed.h"
+#include "interest.h"
 
 #include <QThread>
 #include <QUdpSocket>
 #include <QCoreApplication>
 #include <QNetworkDatagram>
-#include <QTimer>
+#include <algorithm>
 
 
-static constexpr uint32_t kTickDurationMs = 20;
+static constexpr uint32_t kSupportedTickRates[] = {20, 30, 50, 64, 128};
+static constexpr uint32_t kMatchStartDelayMs = 5000;
+// Each condition doubles the snapshot interval of a session, capped so that client corrections stay small
+static constexpr double kHighSnapshotRttMs = 250.0;
+static constexpr double kHighSnapshotLossRate = 0.1;
+static constexpr uint32_t kMaxSnapshotIntervalMs = 200;
+static constexpr uint32_t kTickStatsIntervalS = 5;
+// Stamped commands wait in the jitter buffer for at most this long
+static constexpr uint32_t kMaxInputDelayMs = 200;
+// HCCN meta and ids, Response oneof tag and chunk header
+static constexpr size_t kSnapshotChunkOverhead = 64;
 
 
-Room::Room (QObject* parent)
+static size_t snapshot_chunk_size (const Session& session)
+{
+    // Discovered path MTU is only known to the network thread, stay within the safe size then
+    size_t datagram_size = session.path_mtu_discovery ? HCCN::kDefaultMaxDatagramSize : session.max_datagram_size;
+    return datagram_size - kSnapshotChunkOverhead;
+}
+static RTS::Team session_team (const Session& session)
+{
+    return *session.current_team == Unit::Team::Red ? RTS::TEAM_RED : RTS::TEAM_BLUE;
+}
+static uint32_t command_apply_tick (Session& session, uint32_t command_tick, uint32_t tick_no, uint32_t max_delay_ticks)
+{
+    // Lag from the state the client saw to command arrival, smoothed like RTT in RFC 6298
+    double lag_ticks = command_tick < tick_no ? tick_no - command_tick : 0;
+    if (session.command_lag_ticks.has_value ()) {
+        session.command_lag_deviation_ticks += (std::abs (lag_ticks - *session.command_lag_ticks) - session.command_lag_deviation_ticks)/4;
+        *session.command_lag_ticks += (lag_ticks - *session.command_lag_ticks)/8;
+    } else {
+        session.command_lag_ticks = lag_ticks;
+        session.command_lag_deviation_ticks = lag_ticks/2;
+    }
+    // Buffer depth covers the usual lag plus jitter, so commands keep their spacing on the server
+    // and only the late ones are pulled in to the next tick
+    uint32_t delay_ticks = qMin<uint32_t> (std::ceil (*session.command_lag_ticks + 2*session.command_lag_deviation_ticks), max_delay_ticks);
+    uint32_t apply_tick = qBound (tick_no + 1, qMin (command_tick, tick_no) + delay_ticks, tick_no + max_delay_ticks);
+    // Shrinking delay estimate must not move a command ahead of one issued before it
+    apply_tick = qMax (apply_tick, session.last_apply_tick);
+    session.last_apply_tick = apply_tick;
+    return apply_tick;
+}
+static HCCN::ServerToClient::SharedPayload serialize_payload (const RTS::Response& response_oneof)
+{
+    std::shared_ptr<std::vector<char>> payload = HCCN::makePooled<std::vector<char>> ();
+    payload->resize (response_oneof.ByteSizeLong ());
+    response_oneof.SerializeToArray (payload->data (), payload->size ());
+    return payload;
+}
+
+static bool parse_unit_action (const RTS::UnitAction& action, UnitActionVariant& unit_action, std::string& error_message)
+{
+    switch (action.action_case ()) {
+    case RTS::UnitAction::ActionCase::kMove: {
+        const RTS::MoveAction& move = action.move ();
+        if (move.has_position ()) {
+            unit_action = MoveAction (Position (move.position ().position ().x (), move.position ().position ().y ()));
+        } else if (move.has_unit ()) {
+            unit_action = MoveAction (move.unit ().id ());
+        } else {
+            error_message = "Malformed message";
+            return false;
+        }
+    } break;
+    case RTS::UnitAction::ActionCase::kAttack: {
+        const RTS::AttackAction& attack = action.attack ();
+        if (attack.has_position ()) {
+            const RTS::Vector2D& target_position = attack.position ().position ();
+            unit_action = AttackAction (Position (target_position.x (), target_position.y ()));
+        } else if (attack.has_unit ()) {
+            unit_action = AttackAction (attack.unit ().id ());
+        } else {
+            error_message = "Malformed message";
+            return false;
+        }
+    } break;
+    case RTS::UnitAction::ActionCase::kCast: {
+        CastAction::Type type;
+        switch (action.cast ().type ()) {
+        case (RTS::CastType::CAST_TYPE_PESTILENCE): {
+            type = CastAction::Type::Pestilence;
+        } break;
+        case (RTS::CastType::CAST_TYPE_SPAWN_BEETLE): {
+            type = CastAction::Type::SpawnBeetle;
+        } break;
+        default: {
+            error_message = "Malformed message: invalid cast type";
+        } return false;
+        }
+        unit_action = CastAction (type, Position (action.cast ().position ().position ().x (), action.cast ().position ().position ().y ()));
+    } break;
+    case RTS::UnitAction::ActionCase::kStop: {
+        StopAction stop = StopAction ();
+        if (action.stop ().has_target ()) {
+            stop.current_target = action.stop ().target ().id ();
+        } else {
+            stop.current_target.reset ();
+        }
+        unit_action = stop;
+    } break;
+    default: {
+        error_message = "Invalid unit action specified";
+    } return false;
+    }
+    return true;
+}
+
+
+bool Room::isSupportedTickRate (uint32_t tick_rate)
+{
+    return std::find (std::begin (kSupportedTickRates), std::end (kSupportedTickRates), tick_rate) != std::end (kSupportedTickRates);
+}
+Room::Room (uint32_t tick_rate, uint32_t snapshot_rate, const TickWatchdog::Config& watchdog_config, QObject* parent)
     : QObject (parent)
+    , tick_rate (tick_rate)
+    , snapshot_rate (snapshot_rate)
+    , watchdog (watchdog_config, tick_rate)
+{
+}
+uint32_t Room::tickRate () const
 {
-    timer.reset (new QTimer (this));
-    connect (&*timer, &QTimer::timeout, this, &Room::tick);
+    return tick_rate;
+}
+void Room::setAcceptingMatches (bool accepting_matches)
+{
+    this->accepting_matches = accepting_matches;
 }
 
+void Room::post (const std::shared_ptr<const ClientRequest>& request, const std::shared_ptr<Session>& session)
+{
+    QMutexLocker locker (&input_queue_mutex);
+    input_queue.push_back ({request, session});
+}
+void Room::postTransportStats (const std::shared_ptr<Session>& session, const HCCN::TransportStats& stats)
+{
+    QMutexLocker locker (&input_queue_mutex);
+    transport_stats_queue.emplace_back (session, stats);
+}
 void Room::tick ()
 {
-    RTS::Response response_oneof;
-    RTSN::Serialize::matchState (&*match_state, response_oneof, red_unit_id_client_to_server_map, blue_unit_id_client_to_server_map);
+    if (!prepareTick (false))
+        return;
+    sendSnapshots ();
+    simulate ();
+    finishTick ();
+}
+bool Room::prepareTick (bool publish_view)
+{
+    tick_timer.start ();
 
-    emit sendResponseRoom (response_oneof, red_team, {});
-    emit sendResponseRoom (response_oneof, blue_team, {});
+    std::vector<QueuedRequest> requests;
+    std::vector<std::pair<std::shared_ptr<Session>, HCCN::TransportStats>> transport_stats;
+    {
+        QMutexLocker locker (&input_queue_mutex);
+        requests.swap (input_queue);
+        transport_stats.swap (transport_stats_queue);
+    }
+    for (const std::pair<std::shared_ptr<Session>, HCCN::TransportStats>& session_stats: transport_stats)
+        session_stats.first->transport_stats = session_stats.second;
+    for (const QueuedRequest& request: requests)
+        receiveRequestHandlerRoom (*request.request->request_oneof, request.session, request.request->transport_message->request_id);
+    if (match_start_countdown_ticks && !--match_start_countdown_ticks)
+        readyHandler ();
+    flushOutput ();
+    if (!match_state)
+        return false;
+    if (publish_view) {
+        if (!view_state)
+            view_state.reset (new MatchState (tick_rate, &view_memory));
+        match_state->copyView (*view_state);
+        snapshot_view = &*view_state;
+    }
+    return true;
+}
+void Room::sendSnapshots ()
+{
+    const MatchState* state = snapshot_view ? snapshot_view : &*match_state;
+
+    // Every distinct snapshot is serialized once in this thread and fanned out as a shared payload,
+    // snapshots differ per team since each one only contains what the team can see
+    std::map<Unit::Team, RTS::Response> full_responses;
+    std::map<Unit::Team, HCCN::ServerToClient::SharedPayload> full_payloads;
+    std::map<std::pair<Unit::Team, size_t>, std::vector<HCCN::ServerToClient::SharedPayload>> chunk_payloads;
+    std::map<Unit::Team, RTSN::Delta::Snapshot> current_snapshots;
+    uint32_t tick_no = state->getTickNo ();
+    for (const std::shared_ptr<Session>& session: {red_team, blue_team}) {
+        // Snapshots are only built for teams having a session due, skipped ticks cost neither serialization nor egress
+        if (tick_no < session->next_snapshot_tick)
+            continue;
+        uint32_t interval_ticks = snapshotIntervalTicks (*session);
+        session->next_snapshot_tick = tick_no + interval_ticks;
+        Unit::Team team = *session->current_team;
+        if (session->snapshot_mode == RTS::SNAPSHOT_MODE_CHUNKED) {
+            size_t max_chunk_size = snapshot_chunk_size (*session);
+            std::vector<HCCN::ServerToClient::SharedPayload>& payloads = chunk_payloads[{team, max_chunk_size}];
+            if (payloads.empty ()) {
+                std::vector<RTS::Response> responses;
+                RTSN::Serialize::matchStateChunks (state, responses, max_chunk_size, red_unit_id_client_to_server_map, blue_unit_id_client_to_server_map, team);
+                for (const RTS::Response& response_oneof: responses)
+                    payloads.push_back (serialize_payload (response_oneof));
+            }
+            for (const HCCN::ServerToClient::SharedPayload& payload: payloads)
+                sendSnapshotRoom (payload, session);
+            continue;
+        }
 
+        std::map<Unit::Team, RTS::Response>::iterator full_it = full_responses.find (team);
+        if (full_it == full_responses.end ()) {
+            full_it = full_responses.emplace (team, RTS::Response ()).first;
+            RTSN::Serialize::matchState (state, full_it->second, red_unit_id_client_to_server_map, blue_unit_id_client_to_server_map, team);
+        }
+        const RTS::Response& full_response = full_it->second;
+        if (session->snapshot_mode == RTS::SNAPSHOT_MODE_DELTA) {
+            std::map<Unit::Team, RTSN::Delta::Snapshot>::iterator current_it = current_snapshots.find (team);
+            if (current_it == current_snapshots.end ()) {
+                current_it = current_snapshots.emplace (team, RTSN::Delta::Snapshot ()).first;
+                RTSN::Delta::capture (full_response.match_state (), current_it->second);
+            }
+            const RTSN::Delta::Snapshot& current_snapshot = current_it->second;
+            // History holds what the client reconstructed, which differs from match state when budget held changes back
+            const RTSN::Delta::Snapshot* baseline = session->acked_snapshot_tick.has_value () ?
+                session->snapshot_history.find (*session->acked_snapshot_tick) : nullptr;
+            // No acknowledged baseline or it fell out of history, send keyframe
+            if (baseline) {
+                RTS::Response response_oneof;
+                RTSN::Delta::Snapshot view;
+                bool packed = true;
+                if (session->snapshot_budget) {
+                    std::map<Unit::Team, RTSN::Delta::Snapshot>::const_iterator previous_it = last_snapshots.find (team);
+                    // Budget is per second, a snapshot gets the share of the ticks since the previous one
+                    size_t budget = session->snapshot_budget*interval_ticks/tick_rate;
+                    if (watchdog.active (TickWatchdog::Step::InterestDetail))
+                        budget /= 2;
+                    std::string error_message;
+                    packed = session->snapshot_packer.pack (*baseline, current_snapshot, previous_it != last_snapshots.cend () ? &previous_it->second : nullptr,
+                                                            {session_team (*session), session->viewport}, budget,
+                                                            *response_oneof.mutable_match_state_delta (), view, error_message);
+                    if (!packed)
+                        qDebug () << "Budgeted delta does not apply, sending keyframe:" << QString::fromStdString (error_message);
+                } else {
+                    RTSN::Delta::encode (*baseline, current_snapshot, *response_oneof.mutable_match_state_delta ());
+                    view = current_snapshot;
+                }
+                if (packed) {
+                    session->snapshot_history.push (std::move (view));
+                    sendSnapshotRoom (serialize_payload (response_oneof), session);
+                    continue;
+                }
+            }
+            session->snapshot_history.push (RTSN::Delta::Snapshot (current_snapshot));
+        } else {
+            // Area of interest differs per session, delta keyframes stay unfiltered to serve as baselines
+            RTS::Response response_oneof;
+            RTSN::Interest::Viewer viewer = {session_team (*session), session->viewport, watchdog.active (TickWatchdog::Step::InterestDetail)};
+            RTSN::Interest::filter (full_response.match_state (), viewer, tick_rate, *response_oneof.mutable_match_state (), interval_ticks);
+            if (session->snapshot_encoding == RTS::SNAPSHOT_ENCODING_PACKED) {
+                RTS::Response packed_response_oneof;
+                RTSN::Packed::encode (response_oneof.match_state (), state->areaRef (), *packed_response_oneof.mutable_packed_match_state ());
+                sendSnapshotRoom (serialize_payload (packed_response_oneof), session);
+            } else {
+                sendSnapshotRoom (serialize_payload (response_oneof), session);
+            }
+            continue;
+        }
+        HCCN::ServerToClient::SharedPayload& full_payload = full_payloads[team];
+        if (!full_payload)
+            full_payload = serialize_payload (full_response);
+        sendSnapshotRoom (full_payload, session);
+    }
+    // Teams without a session due keep the snapshot they were last sent
+    for (std::map<Unit::Team, RTSN::Delta::Snapshot>::iterator it = current_snapshots.begin (); it != current_snapshots.end (); ++it)
+        last_snapshots[it->first] = std::move (it->second);
+    snapshot_view = nullptr;
+    flushOutput ();
+}
+void Room::simulate ()
+{
     match_state->tick ();
 }
+void Room::finishTick ()
+{
+    recordTickDuration (tick_timer.nsecsElapsed ());
+}
+void Room::recordTickDuration (int64_t duration_ns)
+{
+    uint32_t old_level = watchdog.level ();
+    if (watchdog.record (duration_ns))
+        applyDegradation (old_level);
+
+    tick_durations_ns.push_back (duration_ns);
+    if (tick_durations_ns.size () < kTickStatsIntervalS*tick_rate)
+        return;
+
+    TickStats stats = schedule_stats;
+    schedule_stats = {};
+    stats.ticks = tick_durations_ns.size ();
+    int64_t total_ns = 0;
+    for (int64_t tick_duration_ns: tick_durations_ns) {
+        total_ns += tick_duration_ns;
+        if (tick_duration_ns > 1000000000/tick_rate)
+            ++stats.overruns;
+    }
+    std::vector<int64_t>::iterator p99_it = tick_durations_ns.begin () + tick_durations_ns.size ()*99/100;
+    std::nth_element (tick_durations_ns.begin (), p99_it, tick_durations_ns.end ());
+    stats.mean_ms = total_ns/1000000.0/stats.ticks;
+    stats.p99_ms = *p99_it/1000000.0;
+    stats.max_ms = *std::max_element (p99_it, tick_durations_ns.end ())/1000000.0;
+    tick_durations_ns.clear ();
+    stats.memory = match_memory.stats ();
+    emit tickStatsUpdated (stats);
+}
+void Room::applyDegradation (uint32_t old_level)
+{
+    bool applied = watchdog.level () > old_level;
+    if (applied && watchdog.lastStep () == TickWatchdog::Step::Spectators)
+        shedSpectators ();
+    emit degradationChanged (watchdog.level (), watchdog.lastStep (), applied, watchdog.lastOverrunShare ());
+}
+void Room::recordSchedule (int64_t lateness_ns, uint32_t late_ticks)
+{
+    watchdog.recordLateness (lateness_ns);
+    size_t bucket = std::lower_bound (kJitterBucketBoundsUs.begin (), kJitterBucketBoundsUs.end (), lateness_ns/1000) - kJitterBucketBoundsUs.begin ();
+    ++schedule_stats.jitter_histogram[bucket];
+    ++schedule_stats.late_histogram[qMin (late_ticks, kMaxCatchUpTicks)];
+}
+void Room::recordDroppedTicks (uint32_t ticks)
+{
+    schedule_stats.dropped_ticks += ticks;
+    uint32_t old_level = watchdog.level ();
+    if (watchdog.recordDropped (ticks))
+        applyDegradation (old_level);
+}
+HCCN::SpscChannel<RoomOutput>& Room::output ()
+{
+    return output_channel;
+}
+void Room::sendResponseRoom (const RTS::Response& response, const std::shared_ptr<Session>& session, uint64_t request_id)
+{
+    output_channel.push ({response, nullptr, session, request_id});
+    output_pending = true;
+}
+void Room::sendSnapshotRoom (const HCCN::ServerToClient::SharedPayload& payload, const std::shared_ptr<Session>& session)
+{
+    output_channel.push ({{}, payload, session, 0});
+    output_pending = true;
+}
+void Room::flushOutput ()
+{
+    if (!output_pending)
+        return;
+    output_channel.notify ();
+    output_pending = false;
+}
+void Room::shedSpectators ()
+{
+    if (spectators.empty ())
+        return;
+    for (const std::shared_ptr<Session>& session: spectators)
+        session->current_role = RTS::Role::ROLE_UNSPECIFIED;
+    spectators.clear ();
+    emitStatsUpdated ();
+}
 void Room::setError (RTS::Error* error, const std::string& error_message, RTS::ErrorCode error_code)
 {
     error->set_message (error_message);
@@ -36,7 +381,33 @@ void Room::setError (RTS::Error* error, const std::string& error_message, RTS::E
 }
 void Room::init_matchstate ()
 {
-    match_state.reset (new MatchState ());
+    // Whatever the previous match allocated goes back to the heap at once
+    match_state.reset ();
+    view_state.reset ();
+    red_unit_id_client_to_server_map.clear ();
+    blue_unit_id_client_to_server_map.clear ();
+    match_memory.release ();
+    view_memory.release ();
+    match_state.reset (new MatchState (tick_rate, &match_memory));
+    match_state->setFogOfWar (true);
+    last_snapshots.clear ();
+    for (const std::shared_ptr<Session>& session: players)
+        resetMatchState (*session);
+    for (const std::shared_ptr<Session>& session: spectators)
+        resetMatchState (*session);
+}
+void Room::resetMatchState (Session& session)
+{
+    session.acked_snapshot_tick.reset ();
+    session.snapshot_history.clear ();
+    session.snapshot_history.setTickRate (tick_rate);
+    session.snapshot_packer = {};
+    session.next_snapshot_tick = 0;
+    session.snapshot_interval_remainder = 0;
+    session.applied_command_sequence = 0;
+    session.last_apply_tick = 0;
+    session.command_lag_ticks.reset ();
+    session.command_lag_deviation_ticks = 0.0;
 }
 void Room::emitStatsUpdated ()
 {
@@ -47,9 +418,38 @@ void Room::emitStatsUpdated ()
     }
     emit statsUpdated (players.size (), ready_player_count, spectators.size ());
 }
+uint32_t Room::snapshotIntervalTicks (Session& session) const
+{
+    uint32_t rate = session.snapshot_rate ? session.snapshot_rate : snapshot_rate;
+    if (!rate)
+        return 1;
+    uint32_t slowdown = 1;
+    if (session.transport_stats.rtt_ms >= kHighSnapshotRttMs)
+        slowdown *= 2;
+    if (session.transport_stats.loss_rate >= kHighSnapshotLossRate)
+        slowdown *= 2;
+    if (watchdog.active (TickWatchdog::Step::SnapshotRate))
+        slowdown *= 2;
+    // Interval is tick_rate*slowdown/rate ticks, the remainder of the division is carried to the next one
+    uint32_t interval_ticks = (tick_rate*slowdown + session.snapshot_interval_remainder)/rate;
+    session.snapshot_interval_remainder = (tick_rate*slowdown + session.snapshot_interval_remainder)%rate;
+    uint32_t max_interval_ticks = qMax<uint32_t> (1, kMaxSnapshotIntervalMs*tick_rate/1000);
+    if (interval_ticks < 1 || interval_ticks > max_interval_ticks)
+        session.snapshot_interval_remainder = 0;
+    return qBound<uint32_t> (1, interval_ticks, max_interval_ticks);
+}
 void Room::receiveRequestHandlerRoom (const RTS::Request& request_oneof, std::shared_ptr<Session> session, uint64_t request_id)
 {
     switch (request_oneof.message_case ()) {
+    case RTS::Request::MessageCase::kJoinRoom: {
+        // Posted by the main thread, which already answered the client
+        const RTS::JoinRoomRequest& request = request_oneof.join_room ();
+        session->snapshot_mode = request.snapshot_mode ();
+        session->snapshot_budget = request.snapshot_budget ();
+        session->snapshot_encoding = request.snapshot_encoding ();
+        session->snapshot_rate = request.snapshot_rate ();
+        resetMatchState (*session);
+    } break;
     case RTS::Request::MessageCase::kSelectRole: {
         const RTS::SelectRoleRequest& request = request_oneof.select_role ();
 
@@ -58,7 +458,7 @@ void Room::receiveRequestHandlerRoom (const RTS::Request& request_oneof, std::sh
                 RTS::Response response_oneof;
                 RTS::SelectRoleResponse* response = response_oneof.mutable_select_role ();
                 setError (response->mutable_error (), "Too many players in room", RTS::ERROR_CODE_TOO_MANY_PLAYERS_IN_ROOM);
-                emit sendResponseRoom (response_oneof, session, request_id);
+                sendResponseRoom (response_oneof, session, request_id);
                 return;
             }
             session->current_role = RTS::Role::ROLE_PLAYER;
@@ -68,27 +468,34 @@ void Room::receiveRequestHandlerRoom (const RTS::Request& request_oneof, std::sh
             RTS::Response response_oneof;
             RTS::SelectRoleResponse* response = response_oneof.mutable_select_role ();
             response->mutable_success ();
-            emit sendResponseRoom (response_oneof, session, request_id);
+            sendResponseRoom (response_oneof, session, request_id);
         } else if (request.role () == RTS::Role::ROLE_SPECTATOR) {
             RTS::Response response_oneof;
             RTS::SelectRoleResponse* response = response_oneof.mutable_select_role ();
             setError (response->mutable_error (), "Spectatorship not implemented", RTS::ERROR_CODE_NOT_IMPLEMENTED);
-            emit sendResponseRoom (response_oneof, session, request_id);
+            sendResponseRoom (response_oneof, session, request_id);
         } else {
             RTS::Response response_oneof;
             RTS::SelectRoleResponse* response = response_oneof.mutable_select_role ();
             setError (response->mutable_error (), "Invalid role specified", RTS::ERROR_CODE_MALFORMED_MESSAGE);
-            emit sendResponseRoom (response_oneof, session, request_id);
+            sendResponseRoom (response_oneof, session, request_id);
         }
     } break;
     case RTS::Request::MessageCase::kReady: {
+        if (!accepting_matches) {
+            RTS::Response response_oneof;
+            RTS::ReadyResponse* response = response_oneof.mutable_ready ();
+            setError (response->mutable_error (), "Server overloaded, no new matches for now", RTS::ERROR_CODE_SERVER_OVERLOADED);
+            sendResponseRoom (response_oneof, session, request_id);
+            return;
+        }
         session->ready = true;
         emitStatsUpdated ();
 
         RTS::Response response_oneof;
         RTS::ReadyResponse* response = response_oneof.mutable_ready ();
         response->mutable_success ();
-        emit sendResponseRoom (response_oneof, session, request_id);
+        sendResponseRoom (response_oneof, session, request_id);
 
         if (players.size () == 2 && players[0]->ready && players[1]->ready) {
             red_team = players[0];
@@ -101,16 +508,16 @@ void Room::receiveRequestHandlerRoom (const RTS::Request& request_oneof, std::sh
                 RTS::Response response_oneof;
                 RTS::MatchPreparedResponse* response = response_oneof.mutable_match_prepared ();
                 response->set_team (RTS::Team::TEAM_RED);
-                emit sendResponseRoom (response_oneof, red_team, request_id);
+                sendResponseRoom (response_oneof, red_team, request_id);
             }
             {
                 RTS::Response response_oneof;
                 RTS::MatchPreparedResponse* response = response_oneof.mutable_match_prepared ();
                 response->set_team (RTS::Team::TEAM_BLUE);
-                emit sendResponseRoom (response_oneof, blue_team, request_id);
+                sendResponseRoom (response_oneof, blue_team, request_id);
             }
 
-            QTimer::singleShot (5000, this, &Room::readyHandler);
+            match_start_countdown_ticks = kMatchStartDelayMs*tick_rate/1000;
         }
     } break;
     case RTS::Request::MessageCase::kUnitCreate: {
@@ -136,7 +543,7 @@ void Room::receiveRequestHandlerRoom (const RTS::Request& request_oneof, std::sh
             RTS::Response response_oneof;
             RTS::SelectRoleResponse* response = response_oneof.mutable_select_role ();
             setError (response->mutable_error (), "Invalid role specified", RTS::ERROR_CODE_MALFORMED_MESSAGE);
-            emit sendResponseRoom (response_oneof, session, request_id);
+            sendResponseRoom (response_oneof, session, request_id);
         } return;
         }
         Unit::Team team = *session->current_team;
@@ -144,10 +551,10 @@ void Room::receiveRequestHandlerRoom (const RTS::Request& request_oneof, std::sh
             RTS::Response response_oneof;
             RTS::SelectRoleResponse* response = response_oneof.mutable_select_role ();
             setError (response->mutable_error (), "No position specified", RTS::ERROR_CODE_MALFORMED_MESSAGE);
-            emit sendResponseRoom (response_oneof, session, request_id);
+            sendResponseRoom (response_oneof, session, request_id);
         }
         const RTS::Vector2D& position = request.position ();
-        std::map<uint32_t, Unit>::iterator unit = match_state->createUnit (type, team, Position (position.x (), position.y ()), 0);
+        std::pmr::map<uint32_t, Unit>::iterator unit = match_state->createUnit (type, team, Position (position.x (), position.y ()), 0);
         if (*session->current_team == Unit::Team::Red) {
             red_unit_id_client_to_server_map[request.id ()] = unit->first;
         } else if (*session->current_team == Unit::Team::Blue) {
@@ -156,104 +563,131 @@ void Room::receiveRequestHandlerRoom (const RTS::Request& request_oneof, std::sh
             RTS::Response response_oneof;
             RTS::SelectRoleResponse* response = response_oneof.mutable_select_role ();
             setError (response->mutable_error (), "Unexpected team specified", RTS::ERROR_CODE_MALFORMED_MESSAGE);
-            emit sendResponseRoom (response_oneof, session, request_id);
+            sendResponseRoom (response_oneof, session, request_id);
         }
     } break;
     case RTS::Request::MessageCase::kUnitAction: {
-        const RTS::UnitActionRequest& request = request_oneof.unit_action ();
-        const RTS::UnitAction& action = request.action ();
-        uint32_t id;
-        if (session->current_team == Unit::Team::Red) {
-            id = red_unit_id_client_to_server_map[request.unit_id ()];
-        } else if (session->current_team == Unit::Team::Blue) {
-            id = blue_unit_id_client_to_server_map[request.unit_id ()];
-        } else {
+        if (!match_state) {
             RTS::Response response_oneof;
             RTS::ErrorResponse* response = response_oneof.mutable_error ();
-            setError (response->mutable_error (), "Malformed message", RTS::ERROR_CODE_MALFORMED_MESSAGE);
-            emit sendResponseRoom (response_oneof, session, request_id);
+            setError (response->mutable_error (), "Match not started", RTS::ERROR_CODE_MATCH_NOT_STARTED);
+            sendResponseRoom (response_oneof, session, request_id);
             return;
         }
-        switch (action.action_case ()) {
-        case RTS::UnitAction::ActionCase::kMove: {
-            if (action.move ().has_position ()) {
-                match_state->setUnitAction (request.unit_id (), MoveAction (Position (action.move ().position ().position ().x (),
-                                                                                     action.move ().position ().position ().y ())));
-            } else if (action.move ().has_unit ()) {
-                match_state->setUnitAction (request.unit_id (), MoveAction (action.move ().unit ().id ()));
-            } else {
-                RTS::Response response_oneof;
-                RTS::ErrorResponse* response = response_oneof.mutable_error ();
-                setError (response->mutable_error (), "Malformed message", RTS::ERROR_CODE_MALFORMED_MESSAGE);
-                emit sendResponseRoom (response_oneof, session, request_id);
-            }
-        } break;
-        case RTS::UnitAction::ActionCase::kAttack: {
-            const RTS::AttackAction& attack = action.attack ();
-            if (attack.has_position ()) {
-                const RTS::Vector2D& target_position = attack.position ().position ();
-                match_state->setUnitAction (request.unit_id (), AttackAction (Position (target_position.x (), target_position.y ())));
-            } else if (attack.has_unit ()) {
-                match_state->setUnitAction (request.unit_id (), AttackAction (attack.unit ().id ()));
-            } else {
-                RTS::Response response_oneof;
-                RTS::ErrorResponse* response = response_oneof.mutable_error ();
-                setError (response->mutable_error (), "Malformed message", RTS::ERROR_CODE_MALFORMED_MESSAGE);
-                emit sendResponseRoom (response_oneof, session, request_id);
-            }
-        } break;
-        case RTS::UnitAction::ActionCase::kCast: {
-            CastAction::Type type;
-            type = CastAction::Type::Unknown;
-            switch (action.cast ().type ()) {
-            case (RTS::CastType::CAST_TYPE_PESTILENCE): {
-                type = CastAction::Type::Pestilence;
-            } break;
-            case (RTS::CastType::CAST_TYPE_SPAWN_BEETLE): {
-                type = CastAction::Type::SpawnBeetle;
-            } break;
-            default: {
-                RTS::Response response_oneof;
-                RTS::ErrorResponse* response = response_oneof.mutable_error ();
-                setError (response->mutable_error (), "Malformed message: invalid cast type", RTS::ERROR_CODE_MALFORMED_MESSAGE);
-                emit sendResponseRoom (response_oneof, session, request_id);
-            } return;
-            }
-            CastAction cast = CastAction (type, Position (action.cast ().position ().position ().x (), action.cast ().position ().position ().y ()));
-            match_state->setUnitAction (request.unit_id (), cast);
-        } break;
-        case RTS::UnitAction::ActionCase::kStop: {
-            StopAction stop = StopAction ();
-            if (action.stop ().has_target ()) {
-                stop.current_target = action.stop ().target ().id ();
-            } else {
-                stop.current_target.reset ();
-            }
-            match_state->setUnitAction (request.unit_id (), stop);
-        } break;
-        default: {
+        // Plain requests may arrive reordered, request id orders them within a tick
+        unitActionRequest (request_oneof.unit_action (), session, request_id, match_state->getTickNo () + 1, MatchState::CommandSource::Request, request_id);
+    } break;
+    case RTS::Request::MessageCase::kGroupUnitAction: {
+        if (!match_state) {
             RTS::Response response_oneof;
-            RTS::SelectRoleResponse* response = response_oneof.mutable_select_role ();
-            setError (response->mutable_error (), "Invalid unit action specified", RTS::ERROR_CODE_MALFORMED_MESSAGE);
-            emit sendResponseRoom (response_oneof, session, request_id);
+            RTS::ErrorResponse* response = response_oneof.mutable_error ();
+            setError (response->mutable_error (), "Match not started", RTS::ERROR_CODE_MATCH_NOT_STARTED);
+            sendResponseRoom (response_oneof, session, request_id);
+            return;
+        }
+        groupUnitActionRequest (request_oneof.group_unit_action (), session, request_id, match_state->getTickNo () + 1, MatchState::CommandSource::Request, request_id);
+    } break;
+    case RTS::Request::MessageCase::kCommandBundle: {
+        const RTS::CommandBundleRequest& request = request_oneof.command_bundle ();
+        // Bundles repeat unacknowledged commands, apply each sequence once and in order,
+        // a command past a gap waits for the client to resend the missing ones unless it gave up on them.
+        // Before the match starts nothing is applied, the ack still tells the client where the room stands
+        if (match_state) {
+            if (request.skipped_sequence () > session->applied_command_sequence)
+                session->applied_command_sequence = request.skipped_sequence ();
+            for (const RTS::Command& command: request.commands ()) {
+                if (command.sequence () != session->applied_command_sequence + 1)
+                    continue;
+                session->applied_command_sequence = command.sequence ();
+                uint32_t apply_tick = command_apply_tick (*session, command.tick (), match_state->getTickNo (), kMaxInputDelayMs*tick_rate/1000);
+                if (command.has_unit_action ())
+                    unitActionRequest (command.unit_action (), session, request_id, apply_tick, MatchState::CommandSource::Bundle, command.sequence ());
+                else if (command.has_group_unit_action ())
+                    groupUnitActionRequest (command.group_unit_action (), session, request_id, apply_tick, MatchState::CommandSource::Bundle, command.sequence ());
+            }
         }
+        RTS::Response response_oneof;
+        RTS::CommandAckResponse* response = response_oneof.mutable_command_ack ();
+        response->set_sequence (session->applied_command_sequence);
+        sendResponseRoom (response_oneof, session, request_id);
+    } break;
+    case RTS::Request::MessageCase::kViewportUpdate: {
+        const RTS::ViewportUpdateRequest& request = request_oneof.viewport_update ();
+        // Updates travel unreliably and may be reordered, keep the newest one
+        if (request.sequence () > session->viewport_sequence) {
+            session->viewport_sequence = request.sequence ();
+            session->viewport = Rectangle (request.left (), request.right (), request.top (), request.bottom ());
         }
     } break;
+    case RTS::Request::MessageCase::kSnapshotAck: {
+        const RTS::SnapshotAckRequest& request = request_oneof.snapshot_ack ();
+        // Acks travel unreliably and may be reordered, keep the newest one. History is cleared per match,
+        // so a late ack from the previous match finds no snapshot of that tick and is dropped
+        if (match_state && session->snapshot_history.find (request.tick ()) &&
+            (!session->acked_snapshot_tick.has_value () || request.tick () > *session->acked_snapshot_tick))
+            session->acked_snapshot_tick = request.tick ();
+    } break;
     default: {
         RTS::Response response_oneof;
         RTS::ErrorResponse* response = response_oneof.mutable_error ();
         setError (response->mutable_error (), "Unknown message from client", RTS::ERROR_CODE_MALFORMED_MESSAGE);
-        emit sendResponseRoom (response_oneof, session, request_id);
+        sendResponseRoom (response_oneof, session, request_id);
+    }
+    }
+}
+void Room::unitActionRequest (const RTS::UnitActionRequest& request, const std::shared_ptr<Session>& session, uint64_t request_id, uint32_t apply_tick, MatchState::CommandSource source, uint64_t order)
+{
+    // Unit ids are the server's, the client learns them from snapshots
+    const RTS::UnitAction& action = request.action ();
+    if (session->current_team != Unit::Team::Red && session->current_team != Unit::Team::Blue) {
+        RTS::Response response_oneof;
+        RTS::ErrorResponse* response = response_oneof.mutable_error ();
+        setError (response->mutable_error (), "Malformed message", RTS::ERROR_CODE_MALFORMED_MESSAGE);
+        sendResponseRoom (response_oneof, session, request_id);
+        return;
+    }
+    UnitActionVariant unit_action;
+    std::string error_message;
+    if (!parse_unit_action (action, unit_action, error_message)) {
+        RTS::Response response_oneof;
+        RTS::ErrorResponse* response = response_oneof.mutable_error ();
+        setError (response->mutable_error (), error_message, RTS::ERROR_CODE_MALFORMED_MESSAGE);
+        sendResponseRoom (response_oneof, session, request_id);
+        return;
+    }
+    match_state->scheduleUnitAction (apply_tick, source, order, *session->current_team, request.unit_id (), unit_action);
+}
+void Room::groupUnitActionRequest (const RTS::GroupUnitActionRequest& request, const std::shared_ptr<Session>& session, uint64_t request_id, uint32_t apply_tick, MatchState::CommandSource source, uint64_t order)
+{
+    UnitActionVariant unit_action;
+    std::string error_message;
+    if (!session->current_team.has_value ()) {
+        RTS::Response response_oneof;
+        RTS::ErrorResponse* response = response_oneof.mutable_error ();
+        setError (response->mutable_error (), "Malformed message", RTS::ERROR_CODE_MALFORMED_MESSAGE);
+        sendResponseRoom (response_oneof, session, request_id);
+        return;
+    }
+    if (!parse_unit_action (request.action (), unit_action, error_message)) {
+        RTS::Response response_oneof;
+        RTS::ErrorResponse* response = response_oneof.mutable_error ();
+        setError (response->mutable_error (), error_message, RTS::ERROR_CODE_MALFORMED_MESSAGE);
+        sendResponseRoom (response_oneof, session, request_id);
+        return;
     }
+    // Whole selection is scheduled in a single dispatch
+    uint32_t unit_id = 0;
+    for (uint32_t unit_id_delta: request.unit_id_deltas ()) {
+        unit_id += unit_id_delta;
+        match_state->scheduleUnitAction (apply_tick, source, order, *session->current_team, unit_id, unit_action);
     }
 }
 void Room::readyHandler ()
 {
     init_matchstate ();
-    timer->start (kTickDurationMs);
     RTS::Response response_oneof;
     RTS::MatchStartResponse* response = response_oneof.mutable_match_start ();
-    (void) response;
-    emit sendResponseRoom (response_oneof, red_team, {});
-    emit sendResponseRoom (response_oneof, blue_team, {});
+    response->set_tick_rate (tick_rate);
+    sendResponseRoom (response_oneof, red_team, {});
+    sendResponseRoom (response_oneof, blue_team, {});
 }
@@ -3,46 +3,134 @@
 #include "requests.pb.h"
 #include "responses.pb.h"
 #include "application.h"
+#include "client_request.h"
 #include "matchstate.h"
+#include "delta.h"
+#include "tick_watchdog.h"
+#include "spsc_channel.h"
 
 #include <QUdpSocket>
 #include <QNetworkDatagram>
 #include <QMutex>
-#include <QTimer>
+#include <QElapsedTimer>
+#include <array>
+#include <atomic>
 #include <memory>
 
 
+// Ticks further behind their deadline than this are dropped instead of caught up
+constexpr uint32_t kMaxCatchUpTicks = 4;
+// Upper bounds of tick start jitter buckets, the last bucket holds everything above
+constexpr std::array<int64_t, 8> kJitterBucketBoundsUs = {50, 100, 250, 500, 1000, 2000, 5000, 10000};
+
+// Wall time of Room::tick over the last report window
+struct TickStats {
+    uint32_t ticks = 0;
+    double mean_ms = 0.0;
+    double p99_ms = 0.0;
+    double max_ms = 0.0;
+    uint32_t overruns = 0; // Ticks that took longer than the tick duration
+    std::array<uint32_t, kJitterBucketBoundsUs.size () + 1> jitter_histogram = {}; // Tick start past its deadline
+    std::array<uint32_t, kMaxCatchUpTicks + 1> late_histogram = {}; // Whole ticks behind when started
+    uint32_t dropped_ticks = 0;
+    MatchMemory::Stats memory; // Of the current match, as of the end of the window
+};
+
+// Response or snapshot on its way from a room to the main thread
+struct RoomOutput {
+    std::optional<RTS::Response> response;
+    HCCN::ServerToClient::SharedPayload snapshot;
+    std::shared_ptr<Session> session;
+    uint64_t request_id = 0;
+};
+
 class Room: public QObject
 {
     Q_OBJECT
 
 public:
-    Room (QObject* parent = nullptr);
+    static bool isSupportedTickRate (uint32_t tick_rate);
+
+    Room (uint32_t tick_rate, uint32_t snapshot_rate, const TickWatchdog::Config& watchdog_config, QObject* parent = nullptr);
     bool start (std::string& error_message);
+    uint32_t tickRate () const;
+    // Thread-safe, refused players get an error on ready and the room stays in the lobby
+    void setAcceptingMatches (bool accepting_matches);
+    // Thread-safe, requests are handled at the start of the next tick
+    void post (const std::shared_ptr<const ClientRequest>& request, const std::shared_ptr<Session>& session);
+    // Thread-safe, stats are applied at the start of the next tick along with requests
+    void postTransportStats (const std::shared_ptr<Session>& session, const HCCN::TransportStats& stats);
+    // Driven by RoomScheduler, one worker at a time
+    void tick ();
+    // Same tick in stages: prepareTick handles input and returns false while there is no match, with publish_view
+    // snapshots are then built from an immutable view of the tick so sendSnapshots and simulate may run concurrently
+    bool prepareTick (bool publish_view);
+    void sendSnapshots ();
+    void simulate ();
+    void finishTick ();
+    void recordSchedule (int64_t lateness_ns, uint32_t late_ticks);
+    void recordDroppedTicks (uint32_t ticks);
+    // Consumed by the main thread, woken up once per tick stage that produced anything
+    HCCN::SpscChannel<RoomOutput>& output ();
 
 public slots:
     void receiveRequestHandlerRoom (const RTS::Request& request_oneof, std::shared_ptr<Session> session, uint64_t request_id);
 
 signals:
-    void sendResponseRoom (const RTS::Response& response, const std::shared_ptr<Session>& session, uint64_t request_id);
     void receiveRequest (const RTS::Request& request, const std::shared_ptr<Session>& session, uint64_t request_id);
     void statsUpdated (uint32_t player_count, uint32_t ready_player_count, uint32_t spectator_count);
+    void tickStatsUpdated (const TickStats& stats);
+    void degradationChanged (uint32_t level, TickWatchdog::Step step, bool applied, double overrun_share);
+
+private:
+    struct QueuedRequest {
+        std::shared_ptr<const ClientRequest> request;
+        std::shared_ptr<Session> session;
+    };
 
-private slots:
     void readyHandler ();
-    void tick ();
+    void sendResponseRoom (const RTS::Response& response, const std::shared_ptr<Session>& session, uint64_t request_id);
+    void sendSnapshotRoom (const HCCN::ServerToClient::SharedPayload& payload, const std::shared_ptr<Session>& session);
+    void flushOutput ();
 
-private:
     std::vector<std::shared_ptr<Session>> players;
     std::shared_ptr<Session> red_team;
     std::shared_ptr<Session> blue_team;
-    std::shared_ptr<QTimer> timer;
+    QMutex input_queue_mutex;
+    std::vector<QueuedRequest> input_queue;
+    std::vector<std::pair<std::shared_ptr<Session>, HCCN::TransportStats>> transport_stats_queue;
+    HCCN::SpscChannel<RoomOutput> output_channel {"room_to_main"};
+    bool output_pending = false;
+    uint32_t match_start_countdown_ticks = 0;
+    MatchMemory match_memory; // Released when the next match starts, so declared before everything living in it
+    MatchMemory view_memory; // Of view_state, used by whichever thread runs the current stage of the tick
     std::shared_ptr<MatchState> match_state;
-    std::map<uint32_t, uint32_t> red_unit_id_client_to_server_map;
-    std::map<uint32_t, uint32_t> blue_unit_id_client_to_server_map;
+    std::shared_ptr<MatchState> view_state; // Copy of the tick pipelined snapshots are built from, reused every tick
+    const MatchState* snapshot_view = nullptr; // Set between prepareTick and sendSnapshots when pipelined
+    std::pmr::map<uint32_t, uint32_t> red_unit_id_client_to_server_map {match_memory.resource ()};
+    std::pmr::map<uint32_t, uint32_t> blue_unit_id_client_to_server_map {match_memory.resource ()};
     std::vector<std::shared_ptr<Session>> spectators; // not gonna use for now
+    std::map<Unit::Team, RTSN::Delta::Snapshot> last_snapshots;
+    const uint32_t tick_rate;
+    const uint32_t snapshot_rate;
     void setError (RTS::Error* error, const std::string& error_message, RTS::ErrorCode error_code);
     void init_matchstate ();
+    // Snapshot baselines, schedule and command sequencing of the previous match would carry over into the next one
+    void resetMatchState (Session& session);
     void emitStatsUpdated ();
+    void recordTickDuration (int64_t duration_ns);
+    // Acts on the step the watchdog just applied or lifted
+    void applyDegradation (uint32_t old_level);
+    void shedSpectators ();
+    void unitActionRequest (const RTS::UnitActionRequest& request, const std::shared_ptr<Session>& session, uint64_t request_id, uint32_t apply_tick, MatchState::CommandSource source, uint64_t order);
+    void groupUnitActionRequest (const RTS::GroupUnitActionRequest& request, const std::shared_ptr<Session>& session, uint64_t request_id, uint32_t apply_tick, MatchState::CommandSource source, uint64_t order);
+    // Ticks until the session's next snapshot, rates not dividing the tick rate alternate between
+    // the neighbouring intervals so that the average matches the rate
+    uint32_t snapshotIntervalTicks (Session& session) const;
     int sampling = 0;
+    QElapsedTimer tick_timer;
+    std::vector<int64_t> tick_durations_ns;
+    TickStats schedule_stats;
+    TickWatchdog watchdog;
+    std::atomic<bool> accepting_matches {true};
 };
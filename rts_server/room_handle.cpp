@@ -0,0 +1,127 @@
+#include "room_handle.h"
+#include "room.h"
+
+#include <QUdpSocket>
+
+
+RoomHandle::RoomHandle (const std::string& name, uint32_t tick_rate, uint32_t snapshot_rate, const TickWatchdog::Config& watchdog_config,
+                        RoomScheduler& scheduler, QObject* parent)
+    : QObject (parent)
+    , name_ (name)
+    , tick_rate (tick_rate)
+    , snapshot_rate (snapshot_rate)
+    , scheduler (scheduler)
+{
+    // Room emits from scheduler workers, everything it reports is queued to this thread;
+    // responses and snapshots come through its output channel, stats through queued signals
+    room.reset (new Room (tick_rate, snapshot_rate, watchdog_config));
+    output_notifier.reset (new QSocketNotifier (room->output ().fd (), QSocketNotifier::Read));
+    connect (&*output_notifier, &QSocketNotifier::activated, this, &RoomHandle::takeRoomOutput);
+    connect (&*room, &Room::statsUpdated, this, &RoomHandle::updateStats, Qt::QueuedConnection);
+    connect (&*room, &Room::tickStatsUpdated, this, &RoomHandle::updateTickStats, Qt::QueuedConnection);
+    connect (&*room, &Room::degradationChanged, this, &RoomHandle::updateDegradation, Qt::QueuedConnection);
+    scheduler.add (room);
+}
+RoomHandle::~RoomHandle ()
+{
+    scheduler.remove (room);
+}
+
+const std::shared_ptr<Room>& RoomHandle::roomRef () const
+{
+    return room;
+}
+const std::string& RoomHandle::name () const
+{
+    return name_;
+}
+uint32_t RoomHandle::tickRate () const
+{
+    return tick_rate;
+}
+uint32_t RoomHandle::snapshotRate () const
+{
+    return snapshot_rate;
+}
+uint32_t RoomHandle::playerCount () const
+{
+    return player_count;
+}
+uint32_t RoomHandle::readyPlayerCount () const
+{
+    return ready_player_count;
+}
+uint32_t RoomHandle::spectatorCount () const
+{
+    return spectator_count;
+}
+const TickStats& RoomHandle::tickStats () const
+{
+    return tick_stats;
+}
+uint32_t RoomHandle::degradationLevel () const
+{
+    return degradation_level;
+}
+bool RoomHandle::refusingMatches () const
+{
+    return refusing_matches;
+}
+void RoomHandle::setAcceptingMatches (bool accepting_matches)
+{
+    room->setAcceptingMatches (accepting_matches);
+}
+void RoomHandle::post (const std::shared_ptr<const ClientRequest>& request, const std::shared_ptr<Session>& session)
+{
+    room->post (request, session);
+}
+void RoomHandle::postTransportStats (const std::shared_ptr<Session>& session, const HCCN::TransportStats& stats)
+{
+    room->postTransportStats (session, stats);
+}
+void RoomHandle::takeRoomOutput ()
+{
+    HCCN::SpscChannel<RoomOutput>& output = room->output ();
+    output.clear ();
+    RoomOutput item;
+    while (output.pop (item)) {
+        if (item.response.has_value ())
+            emit sendResponse (*item.response, item.session, item.request_id);
+        else
+            emit sendSnapshot (item.snapshot, item.session);
+    }
+}
+void RoomHandle::updateStats (uint32_t player_count, uint32_t ready_player_count, uint32_t spectator_count)
+{
+    this->player_count = player_count;
+    this->ready_player_count = ready_player_count;
+    this->spectator_count = spectator_count;
+}
+void RoomHandle::updateTickStats (const TickStats& stats)
+{
+    tick_stats = stats;
+    qDebug () << "Room" << QString::fromStdString (name_) << "tick latency: mean" << stats.mean_ms << "ms, p99" << stats.p99_ms
+              << "ms, max" << stats.max_ms << "ms," << stats.overruns << "of" << stats.ticks << "ticks overran,"
+              << stats.dropped_ticks << "ticks dropped";
+    QString jitter_histogram;
+    for (size_t i = 0; i < stats.jitter_histogram.size (); ++i) {
+        jitter_histogram += i < kJitterBucketBoundsUs.size () ? QString ("<=%1us:").arg (kJitterBucketBoundsUs[i]) : QString (">%1us:").arg (kJitterBucketBoundsUs.back ());
+        jitter_histogram += QString::number (stats.jitter_histogram[i]) + " ";
+    }
+    QString late_histogram;
+    for (size_t i = 0; i < stats.late_histogram.size (); ++i)
+        late_histogram += QString ("%1:%2 ").arg (i).arg (stats.late_histogram[i]);
+    qDebug () << "Room" << QString::fromStdString (name_) << "tick jitter" << jitter_histogram << "ticks behind" << late_histogram;
+    qDebug () << "metric room_memory room=" << QString::fromStdString (name_) << "bytes=" << stats.memory.bytes << "peak_bytes=" << stats.memory.peak_bytes
+              << "heap_allocations=" << stats.memory.heap_allocations << "scratch_peak_bytes=" << stats.memory.scratch_peak_bytes;
+}
+void RoomHandle::updateDegradation (uint32_t level, TickWatchdog::Step step, bool applied, double overrun_share)
+{
+    degradation_level = level;
+    qDebug () << "metric room_degradation room=" << QString::fromStdString (name_) << "step=" << TickWatchdog::stepName (step)
+              << "action=" << (applied ? "apply" : "lift") << "level=" << level << "overrun_share=" << overrun_share;
+    if (step == TickWatchdog::Step::NewMatches) {
+        refusing_matches = applied;
+        emit refusingMatchesChanged ();
+    }
+}
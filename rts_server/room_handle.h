@@ -0,0 +1,63 @@
+#pragma once
+
+#include "room.h"
+#include "room_scheduler.h"
+#include "application.h"
+
+#include "requests.pb.h"
+#include "responses.pb.h"
+
+#include <QUdpSocket>
+#include <QNetworkDatagram>
+#include <QSocketNotifier>
+#include <memory>
+
+// Main thread side of a room: keeps lobby stats and relays responses, the room itself is ticked by RoomScheduler
+class RoomHandle: public QObject
+{
+    Q_OBJECT
+
+public:
+    RoomHandle (const std::string& name, uint32_t tick_rate, uint32_t snapshot_rate, const TickWatchdog::Config& watchdog_config,
+                RoomScheduler& scheduler, QObject* parent = nullptr);
+    ~RoomHandle ();
+    const std::shared_ptr<Room>& roomRef () const;
+    const std::string& name () const;
+    uint32_t tickRate () const;
+    uint32_t snapshotRate () const;
+    uint32_t playerCount () const;
+    uint32_t readyPlayerCount () const;
+    uint32_t spectatorCount () const;
+    const TickStats& tickStats () const;
+    uint32_t degradationLevel () const;
+    // Watchdog of this room reached the step refusing new matches
+    bool refusingMatches () const;
+    void setAcceptingMatches (bool accepting_matches);
+    void post (const std::shared_ptr<const ClientRequest>& request, const std::shared_ptr<Session>& session);
+    void postTransportStats (const std::shared_ptr<Session>& session, const HCCN::TransportStats& stats);
+
+private:
+    const std::string name_;
+    const uint32_t tick_rate;
+    const uint32_t snapshot_rate;
+    RoomScheduler& scheduler;
+    std::shared_ptr<Room> room;
+    std::unique_ptr<QSocketNotifier> output_notifier;
+    uint32_t player_count = 0;
+    uint32_t ready_player_count = 0;
+    uint32_t spectator_count = 0;
+    TickStats tick_stats;
+    uint32_t degradation_level = 0;
+    bool refusing_matches = false;
+
+signals:
+    void sendResponse (const RTS::Response& response, const std::shared_ptr<Session>& session, uint64_t request_id);
+    void sendSnapshot (const HCCN::ServerToClient::SharedPayload& payload, const std::shared_ptr<Session>& session);
+    void refusingMatchesChanged ();
+
+private slots:
+    void takeRoomOutput ();
+    void updateStats (uint32_t player_count, uint32_t ready_player_count, uint32_t spectator_count);
+    void updateTickStats (const TickStats& stats);
+    void updateDegradation (uint32_t level, TickWatchdog::Step step, bool applied, double overrun_share);
+};
@@ -0,0 +1,329 @@
+#include "room_scheduler.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <time.h>
+
+
+// Rooms added while the clock sleeps get their first tick this late at most
+static constexpr int64_t kMaxClockSleepNs = 10'000'000;
+static constexpr int64_t kReportIntervalNs = 5'000'000'000;
+// Reservoir of tick durations the p99 of a report is taken from, every tick of the interval is equally likely in it
+static constexpr size_t kTickStatsWindow = 4096;
+
+
+static int64_t monotonic_ns ()
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return int64_t (ts.tv_sec)*1000000000 + ts.tv_nsec;
+}
+static void sleep_until_ns (int64_t deadline_ns)
+{
+    struct timespec ts;
+    ts.tv_sec = deadline_ns/1000000000;
+    ts.tv_nsec = deadline_ns%1000000000;
+    while (clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR)
+        ;
+}
+
+RoomWorker::RoomWorker (RoomScheduler& scheduler, size_t index, QObject* parent)
+    : QThread (parent)
+    , scheduler (scheduler)
+    , index (index)
+{
+}
+void RoomWorker::run ()
+{
+    scheduler.workerLoop (index);
+}
+
+RoomScheduler::RoomScheduler (size_t worker_count, QObject* parent)
+    : QThread (parent)
+{
+    worker_count = qMax<size_t> (1, worker_count);
+    for (size_t i = 0; i < worker_count; ++i)
+        queues.emplace_back (new WorkerQueue);
+    for (size_t i = 0; i < worker_count; ++i) {
+        workers.emplace_back (new RoomWorker (*this, i));
+        workers.back ()->start ();
+    }
+    tick_durations_ns.reserve (kTickStatsWindow);
+}
+RoomScheduler::~RoomScheduler ()
+{
+    stop ();
+}
+void RoomScheduler::add (const std::shared_ptr<Room>& room)
+{
+    QMutexLocker locker (&mutex);
+    std::shared_ptr<Task> task (new Task);
+    task->room = room;
+    task->home = leastLoadedWorker ();
+    task->period_ns = 1000000000/room->tickRate ();
+    task->deadline_ns = monotonic_ns () + task->period_ns;
+    tasks[&*room] = task;
+}
+void RoomScheduler::remove (const std::shared_ptr<Room>& room)
+{
+    QMutexLocker locker (&mutex);
+    std::map<Room*, std::shared_ptr<Task>>::iterator it = tasks.find (&*room);
+    if (it == tasks.end ())
+        return;
+    std::shared_ptr<Task> task = it->second;
+    tasks.erase (it);
+    while (task->queued)
+        task_finished.wait (&mutex);
+    queues[task->home]->load_ns -= task->cost_ns;
+}
+void RoomScheduler::stop ()
+{
+    {
+        QMutexLocker locker (&mutex);
+        if (stopping)
+            return;
+        stopping = true;
+        work_available.wakeAll ();
+    }
+    wait ();
+    for (const std::unique_ptr<RoomWorker>& worker: workers)
+        worker->wait ();
+
+    // Tasks still queued will never run, release whoever waits in remove ()
+    QMutexLocker locker (&mutex);
+    for (const std::unique_ptr<WorkerQueue>& queue: queues) {
+        for (const std::shared_ptr<Task>& task: queue->tasks)
+            task->queued = false;
+        queue->tasks.clear ();
+    }
+    queued_count = 0;
+    task_finished.wakeAll ();
+}
+void RoomScheduler::setPipelined (bool pipelined)
+{
+    this->pipelined = pipelined;
+}
+RoomScheduler::Stats RoomScheduler::stats () const
+{
+    QMutexLocker locker (&mutex);
+    return last_stats;
+}
+void RoomScheduler::run ()
+{
+    int64_t next_report_ns = monotonic_ns () + kReportIntervalNs;
+    for (;;) {
+        int64_t wakeup_ns;
+        {
+            QMutexLocker locker (&mutex);
+            if (stopping)
+                return;
+            int64_t now_ns = monotonic_ns ();
+            wakeup_ns = queueDueTasks (now_ns);
+            if (now_ns >= next_report_ns) {
+                report ();
+                next_report_ns += kReportIntervalNs;
+            }
+        }
+        sleep_until_ns (wakeup_ns);
+    }
+}
+int64_t RoomScheduler::queueDueTasks (int64_t now_ns)
+{
+    int64_t wakeup_ns = now_ns + kMaxClockSleepNs;
+    for (std::map<Room*, std::shared_ptr<Task>>::iterator it = tasks.begin (); it != tasks.end (); ++it) {
+        const std::shared_ptr<Task>& task = it->second;
+        // Busy room is due again one period after the deadline it is working on at the earliest
+        if (task->queued) {
+            wakeup_ns = qMin (wakeup_ns, task->deadline_ns + task->period_ns);
+            continue;
+        }
+        if (task->deadline_ns > now_ns) {
+            wakeup_ns = qMin (wakeup_ns, task->deadline_ns);
+            continue;
+        }
+        task->queued = true;
+        WorkerQueue& queue = *queues[task->home];
+        {
+            QMutexLocker queue_locker (&queue.mutex);
+            queue.tasks.push_back (task);
+        }
+        ++queued_count;
+    }
+    work_available.wakeAll ();
+    return wakeup_ns;
+}
+void RoomScheduler::workerLoop (size_t index)
+{
+    std::shared_ptr<Task> task;
+    std::shared_ptr<SnapshotJob> job;
+    while (takeWork (index, task, job)) {
+        if (job) {
+            runSnapshotJob (job);
+            job.reset ();
+            continue;
+        }
+        // Written back by finishTask, the scheduler keeps reading the deadline while the room is busy
+        int64_t deadline_ns = task->deadline_ns;
+        uint32_t ticks = 0;
+        int64_t busy_ns = 0;
+        int64_t now_ns = monotonic_ns ();
+        while (deadline_ns <= now_ns && ticks < kMaxCatchUpTicks) {
+            int64_t lateness_ns = now_ns - deadline_ns;
+            task->room->recordSchedule (lateness_ns, lateness_ns/task->period_ns);
+            if (pipelined)
+                tickPipelined (task->room);
+            else
+                task->room->tick ();
+            deadline_ns += task->period_ns;
+            ++ticks;
+            int64_t end_ns = monotonic_ns ();
+            busy_ns += end_ns - now_ns;
+            now_ns = end_ns;
+        }
+        // Still behind after catching up: skip the backlog instead of spiralling
+        if (deadline_ns <= now_ns) {
+            uint32_t dropped_ticks = (now_ns - deadline_ns)/task->period_ns + 1;
+            deadline_ns += dropped_ticks*task->period_ns;
+            task->room->recordDroppedTicks (dropped_ticks);
+        }
+        finishTask (task, ticks ? busy_ns/ticks : 0, deadline_ns);
+        task.reset ();
+    }
+}
+bool RoomScheduler::takeWork (size_t index, std::shared_ptr<Task>& task, std::shared_ptr<SnapshotJob>& job)
+{
+    {
+        QMutexLocker locker (&mutex);
+        while (!queued_count && snapshot_jobs.empty () && !stopping)
+            work_available.wait (&mutex);
+        if (stopping)
+            return false;
+        // Rooms waiting for their snapshots are mid-tick, they go before rooms not started yet
+        if (!snapshot_jobs.empty ()) {
+            job = std::move (snapshot_jobs.front ());
+            snapshot_jobs.pop_front ();
+            return true;
+        }
+        --queued_count;
+    }
+    // Every queued task was pushed before the count grew, so some deque holds one for us
+    for (;;) {
+        {
+            WorkerQueue& queue = *queues[index];
+            QMutexLocker queue_locker (&queue.mutex);
+            if (!queue.tasks.empty ()) {
+                task = std::move (queue.tasks.back ());
+                queue.tasks.pop_back ();
+                return true;
+            }
+        }
+        for (size_t i = 1; i < queues.size (); ++i) {
+            WorkerQueue& queue = *queues[(index + i)%queues.size ()];
+            QMutexLocker queue_locker (&queue.mutex);
+            if (!queue.tasks.empty ()) {
+                task = std::move (queue.tasks.front ());
+                queue.tasks.pop_front ();
+                queue_locker.unlock ();
+                QMutexLocker locker (&mutex);
+                ++steals;
+                return true;
+            }
+        }
+    }
+}
+void RoomScheduler::tickPipelined (const std::shared_ptr<Room>& room)
+{
+    if (!room->prepareTick (true))
+        return;
+    std::shared_ptr<SnapshotJob> job (new SnapshotJob);
+    job->room = room;
+    {
+        QMutexLocker locker (&mutex);
+        snapshot_jobs.push_back (job);
+        work_available.wakeOne ();
+    }
+    room->simulate ();
+
+    bool taken;
+    {
+        QMutexLocker locker (&mutex);
+        std::deque<std::shared_ptr<SnapshotJob>>::iterator it = std::find (snapshot_jobs.begin (), snapshot_jobs.end (), job);
+        taken = it == snapshot_jobs.end ();
+        if (taken) {
+            while (!job->done)
+                snapshot_job_finished.wait (&mutex);
+            ++overlapped_snapshots;
+        } else {
+            snapshot_jobs.erase (it);
+        }
+    }
+    // No worker was idle during the simulation, the tick costs the sum of both then
+    if (!taken)
+        room->sendSnapshots ();
+    room->finishTick ();
+}
+void RoomScheduler::runSnapshotJob (const std::shared_ptr<SnapshotJob>& job)
+{
+    job->room->sendSnapshots ();
+    QMutexLocker locker (&mutex);
+    job->done = true;
+    snapshot_job_finished.wakeAll ();
+}
+void RoomScheduler::finishTask (const std::shared_ptr<Task>& task, int64_t duration_ns, int64_t deadline_ns)
+{
+    QMutexLocker locker (&mutex);
+    task->deadline_ns = deadline_ns;
+    int64_t old_cost_ns = task->cost_ns;
+    task->cost_ns = old_cost_ns ? old_cost_ns + (duration_ns - old_cost_ns)/8 : duration_ns;
+    queues[task->home]->load_ns += task->cost_ns - old_cost_ns;
+    ++tick_samples_seen;
+    if (tick_durations_ns.size () < kTickStatsWindow) {
+        tick_durations_ns.push_back (duration_ns);
+    } else {
+        uint64_t slot = tick_sample_random ()%tick_samples_seen;
+        if (slot < kTickStatsWindow)
+            tick_durations_ns[slot] = duration_ns;
+    }
+
+    if (duration_ns > task->period_ns && tasks.count (&*task->room)) {
+        size_t target = leastLoadedWorker ();
+        if (queues[target]->load_ns + task->cost_ns < queues[task->home]->load_ns) {
+            queues[task->home]->load_ns -= task->cost_ns;
+            queues[target]->load_ns += task->cost_ns;
+            task->home = target;
+            ++migrations;
+        }
+    }
+    task->queued = false;
+    task_finished.wakeAll ();
+}
+size_t RoomScheduler::leastLoadedWorker () const
+{
+    size_t least_loaded = 0;
+    for (size_t i = 1; i < queues.size (); ++i) {
+        if (queues[i]->load_ns < queues[least_loaded]->load_ns)
+            least_loaded = i;
+    }
+    return least_loaded;
+}
+void RoomScheduler::report ()
+{
+    Stats stats;
+    stats.worker_count = workers.size ();
+    stats.room_count = tasks.size ();
+    stats.rooms_per_worker = double (stats.room_count)/stats.worker_count;
+    if (!tick_durations_ns.empty ()) {
+        std::vector<int64_t>::iterator p99_it = tick_durations_ns.begin () + tick_durations_ns.size ()*99/100;
+        std::nth_element (tick_durations_ns.begin (), p99_it, tick_durations_ns.end ());
+        stats.p99_tick_ms = *p99_it/1000000.0;
+        tick_durations_ns.clear ();
+    }
+    tick_samples_seen = 0;
+    stats.steals = steals;
+    stats.migrations = migrations;
+    stats.overlapped_snapshots = overlapped_snapshots;
+    last_stats = stats;
+    qDebug () << "Room scheduler:" << stats.room_count << "rooms on" << stats.worker_count << "workers (" << stats.rooms_per_worker
+              << "per core ), p99 tick" << stats.p99_tick_ms << "ms," << stats.steals << "steals," << stats.migrations << "migrations,"
+              << stats.overlapped_snapshots << "overlapped snapshots";
+}
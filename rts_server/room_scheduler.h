@@ -0,0 +1,114 @@
+#pragma once
+
+#include "room.h"
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <memory>
+#include <random>
+#include <vector>
+
+
+class RoomScheduler;
+
+class RoomWorker: public QThread
+{
+public:
+    RoomWorker (RoomScheduler& scheduler, size_t index, QObject* parent = nullptr);
+
+protected:
+    void run () override;
+
+private:
+    RoomScheduler& scheduler;
+    const size_t index;
+};
+
+// Fixed pool of simulation workers, one per core, ticking rooms against a shared clock.
+// Each room keeps an absolute tick deadline on CLOCK_MONOTONIC, so a late wakeup never shifts
+// later ticks; a room that fell behind catches up by up to kMaxCatchUpTicks ticks in a row and
+// drops the rest of its backlog. Every due room is pushed to the back of its home worker's deque, workers take their own
+// tasks from the back and steal from the front of other deques when idle. Room that overran
+// its tick moves home to the least loaded worker if that evens out the load.
+// When pipelined, a room publishes a view of its tick and offers sending its snapshots to idle workers
+// while it simulates the next tick; whatever no one picked up by then is sent by the room's own worker
+class RoomScheduler: public QThread
+{
+public:
+    struct Stats {
+        size_t worker_count = 0;
+        size_t room_count = 0;
+        double rooms_per_worker = 0.0;
+        double p99_tick_ms = 0.0;
+        uint64_t steals = 0;
+        uint64_t migrations = 0;
+        uint64_t overlapped_snapshots = 0; // Snapshots sent by another worker while their room simulated
+    };
+
+    RoomScheduler (size_t worker_count, QObject* parent = nullptr);
+    ~RoomScheduler ();
+    void add (const std::shared_ptr<Room>& room);
+    // Returns once the room is neither queued nor being ticked
+    void remove (const std::shared_ptr<Room>& room);
+    void stop ();
+    void setPipelined (bool pipelined);
+    Stats stats () const;
+
+protected:
+    void run () override;
+
+private:
+    friend class RoomWorker;
+    struct Task {
+        std::shared_ptr<Room> room;
+        size_t home;
+        bool queued = false;
+        int64_t cost_ns = 0; // Smoothed tick duration
+        int64_t period_ns = 0; // Tick duration at the room's tick rate
+        int64_t deadline_ns = 0; // Monotonic time the next tick is due, only written under the scheduler mutex
+    };
+    struct SnapshotJob {
+        std::shared_ptr<Room> room;
+        bool done = false;
+    };
+    struct WorkerQueue {
+        QMutex mutex;
+        std::deque<std::shared_ptr<Task>> tasks;
+        int64_t load_ns = 0; // Cost of rooms at home here, guarded by the scheduler mutex
+    };
+
+    // Queues every idle room whose deadline has passed, returns when the clock has to wake up next
+    int64_t queueDueTasks (int64_t now_ns);
+    void workerLoop (size_t index);
+    // Blocks until there is a snapshot job or a due room, returns false when stopping
+    bool takeWork (size_t index, std::shared_ptr<Task>& task, std::shared_ptr<SnapshotJob>& job);
+    void tickPipelined (const std::shared_ptr<Room>& room);
+    void runSnapshotJob (const std::shared_ptr<SnapshotJob>& job);
+    // Stores the deadline the worker advanced to and makes the room due again
+    void finishTask (const std::shared_ptr<Task>& task, int64_t duration_ns, int64_t deadline_ns);
+    size_t leastLoadedWorker () const;
+    void report ();
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::vector<std::unique_ptr<RoomWorker>> workers;
+    mutable QMutex mutex;
+    QWaitCondition work_available;
+    QWaitCondition task_finished;
+    QWaitCondition snapshot_job_finished;
+    std::deque<std::shared_ptr<SnapshotJob>> snapshot_jobs; // Not yet taken, guarded by the scheduler mutex
+    std::atomic<bool> pipelined {false};
+    std::map<Room*, std::shared_ptr<Task>> tasks;
+    size_t queued_count = 0;
+    bool stopping = false;
+    std::vector<int64_t> tick_durations_ns;
+    uint64_t tick_samples_seen = 0; // Since the last report
+    std::minstd_rand tick_sample_random;
+    uint64_t steals = 0;
+    uint64_t migrations = 0;
+    uint64_t overlapped_snapshots = 0;
+    Stats last_stats;
+};
@@ -2,6 +2,8 @@
 
 #include "entities.pb.h"
 #include "matchstate.h"
+#include "reliable_channel.h"
+#include "budget.h"
 
 #include <QNetworkDatagram>
 
@@ -29,4 +31,25 @@ struct Session {
     std::optional<Unit::Team> current_team = {};
     bool query_room_list_requested = false;
     bool ready = false;
+    // Owned by the room thread once the session joined, main thread changes go through the room's input queue
+    RTS::SnapshotMode snapshot_mode = RTS::SNAPSHOT_MODE_FULL;
+    std::optional<uint32_t> acked_snapshot_tick = {};
+    size_t snapshot_budget = 0;
+    RTSN::Delta::SnapshotHistory snapshot_history;
+    RTSN::Budget::Packer snapshot_packer;
+    RTS::SnapshotEncoding snapshot_encoding = RTS::SNAPSHOT_ENCODING_PROTOBUF;
+    std::optional<Rectangle> viewport = {};
+    uint32_t viewport_sequence = 0;
+    uint32_t snapshot_rate = 0;
+    uint32_t next_snapshot_tick = 0;
+    uint32_t snapshot_interval_remainder = 0; // Fraction of a tick carried between intervals, in 1/rate of a tick
+    uint32_t applied_command_sequence = 0;
+    uint32_t last_apply_tick = 0;
+    std::optional<double> command_lag_ticks = {};
+    double command_lag_deviation_ticks = 0.0;
+    HCCN::TransportStats transport_stats;
+    // Fixed at authorization
+    size_t max_datagram_size = HCCN::kDefaultMaxDatagramSize;
+    bool path_mtu_discovery = false;
+    uint32_t fec_group_size = 0;
 };
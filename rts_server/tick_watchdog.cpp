@@ -0,0 +1,144 @@
+#include "tick_watchdog.h"
+
+#include <QSettings>
+#include <QStringList>
+#include <algorithm>
+
+
+static const TickWatchdog::Step kSteps[] = {
+    TickWatchdog::Step::SnapshotRate,
+    TickWatchdog::Step::InterestDetail,
+    TickWatchdog::Step::Spectators,
+    TickWatchdog::Step::NewMatches,
+};
+
+
+static bool parse_step (const std::string& name, TickWatchdog::Step& step)
+{
+    for (TickWatchdog::Step candidate: kSteps) {
+        if (name == TickWatchdog::stepName (candidate)) {
+            step = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool TickWatchdog::loadConfig (const QString& path, Config& config, std::string& error_message)
+{
+    QSettings settings (path, QSettings::IniFormat);
+    config.overrun_fraction = settings.value ("watchdog/overrun_fraction", config.overrun_fraction).toDouble ();
+    config.overrun_share = settings.value ("watchdog/overrun_share", config.overrun_share).toDouble ();
+    config.window_ms = settings.value ("watchdog/window_ms", config.window_ms).toUInt ();
+    config.escalate_windows = settings.value ("watchdog/escalate_windows", config.escalate_windows).toUInt ();
+    config.recover_windows = settings.value ("watchdog/recover_windows", config.recover_windows).toUInt ();
+    if (config.overrun_fraction <= 0.0 || config.overrun_share <= 0.0 || config.overrun_share > 1.0) {
+        error_message = "Overrun fraction and share must be positive, share at most 1";
+        return false;
+    }
+    if (!config.window_ms || !config.escalate_windows || !config.recover_windows) {
+        error_message = "Window length and window counts must be positive";
+        return false;
+    }
+    if (settings.contains ("watchdog/ladder")) {
+        // Empty ladder disables degradation
+        config.ladder.clear ();
+        for (const QString& name: settings.value ("watchdog/ladder").toStringList ()) {
+            // "ladder=" reads as a single empty name
+            if (name.trimmed ().isEmpty ())
+                continue;
+            Step step;
+            if (!parse_step (name.trimmed ().toStdString (), step)) {
+                error_message = "Unknown degradation step '" + name.toStdString () + "'";
+                return false;
+            }
+            if (std::find (config.ladder.begin (), config.ladder.end (), step) != config.ladder.end ()) {
+                error_message = "Degradation step '" + name.toStdString () + "' listed twice";
+                return false;
+            }
+            config.ladder.push_back (step);
+        }
+    }
+    return true;
+}
+const char* TickWatchdog::stepName (Step step)
+{
+    switch (step) {
+    case Step::SnapshotRate:
+        return "snapshot_rate";
+    case Step::InterestDetail:
+        return "interest_detail";
+    case Step::Spectators:
+        return "spectators";
+    case Step::NewMatches:
+        return "new_matches";
+    default:
+        return "unknown";
+    }
+}
+
+TickWatchdog::TickWatchdog (const Config& config, uint32_t tick_rate)
+    : config (config)
+    , overrun_ns (config.overrun_fraction*1000000000/tick_rate)
+    , window_ticks (qMax<uint32_t> (1, config.window_ms*tick_rate/1000))
+{
+}
+void TickWatchdog::recordLateness (int64_t lateness_ns)
+{
+    late = lateness_ns > overrun_ns;
+}
+bool TickWatchdog::record (int64_t duration_ns)
+{
+    if (duration_ns > overrun_ns || late)
+        ++window_overruns;
+    late = false;
+    ++window_tick_count;
+    return closeWindow ();
+}
+bool TickWatchdog::recordDropped (uint32_t ticks)
+{
+    window_overruns += ticks;
+    window_tick_count += ticks;
+    return closeWindow ();
+}
+bool TickWatchdog::closeWindow ()
+{
+    if (window_tick_count < window_ticks)
+        return false;
+
+    last_overrun_share = double (window_overruns)/window_tick_count;
+    bool overrun = last_overrun_share >= config.overrun_share;
+    window_tick_count = 0;
+    window_overruns = 0;
+    if (overrun) {
+        recovered_windows = 0;
+        if (++overrun_windows < config.escalate_windows || level_ >= config.ladder.size ())
+            return false;
+        overrun_windows = 0;
+        last_step = config.ladder[level_++];
+        return true;
+    }
+    overrun_windows = 0;
+    if (++recovered_windows < config.recover_windows || !level_)
+        return false;
+    recovered_windows = 0;
+    last_step = config.ladder[--level_];
+    return true;
+}
+uint32_t TickWatchdog::level () const
+{
+    return level_;
+}
+TickWatchdog::Step TickWatchdog::lastStep () const
+{
+    return last_step;
+}
+bool TickWatchdog::active (Step step) const
+{
+    std::vector<Step>::const_iterator end = config.ladder.begin () + level_;
+    return std::find (config.ladder.begin (), end, step) != end;
+}
+double TickWatchdog::lastOverrunShare () const
+{
+    return last_overrun_share;
+}
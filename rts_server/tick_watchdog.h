@@ -0,0 +1,61 @@
+#pragma once
+
+#include <QString>
+#include <string>
+#include <vector>
+
+
+// Tracks tick cost of one room against its tick duration. A tick also counts as overrun when it started
+// overrun_fraction of a tick duration late, and so does every tick the scheduler dropped, since a saturated
+// worker pool shows up as lateness rather than as long ticks. Once a room overran for escalate_windows
+// windows in a row the next step of the degradation ladder is applied, after recover_windows windows
+// within budget the last applied step is lifted, so loaded rooms shed work one step at a time
+class TickWatchdog
+{
+public:
+    enum class Step {
+        SnapshotRate, // Snapshot interval of every session doubled
+        InterestDetail, // No viewport margin, far units refreshed half as often, snapshot budgets halved
+        Spectators, // Spectators dropped from the room
+        NewMatches, // Server refuses to start matches in any room
+    };
+    struct Config {
+        double overrun_fraction = 0.8; // Tick counts as overrun once it takes this share of the tick duration
+        double overrun_share = 0.2; // Window counts as overrun once this share of its ticks overran
+        uint32_t window_ms = 1000;
+        uint32_t escalate_windows = 3;
+        uint32_t recover_windows = 10;
+        std::vector<Step> ladder = {Step::SnapshotRate, Step::InterestDetail, Step::Spectators, Step::NewMatches};
+    };
+
+    // Reads the [watchdog] group, keys that are missing keep their defaults
+    static bool loadConfig (const QString& path, Config& config, std::string& error_message);
+    static const char* stepName (Step step);
+
+    TickWatchdog (const Config& config, uint32_t tick_rate);
+    // Lateness of the tick about to run, counted by the following record ()
+    void recordLateness (int64_t lateness_ns);
+    // These return true when a step was applied or lifted
+    bool record (int64_t duration_ns);
+    bool recordDropped (uint32_t ticks);
+    uint32_t level () const;
+    // Step applied or lifted by the last transition
+    Step lastStep () const;
+    bool active (Step step) const;
+    double lastOverrunShare () const;
+
+private:
+    bool closeWindow ();
+
+    const Config config;
+    const int64_t overrun_ns;
+    const uint32_t window_ticks;
+    uint32_t window_tick_count = 0;
+    uint32_t window_overruns = 0;
+    bool late = false;
+    uint32_t overrun_windows = 0;
+    uint32_t recovered_windows = 0;
+    uint32_t level_ = 0;
+    Step last_step = Step::SnapshotRate;
+    double last_overrun_share = 0.0;
+};